@@ -0,0 +1,426 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "archive.h"
+#include "export.h"
+#include "game.h"
+#include "globals.h"
+#include "points.h"
+
+#define ARCHIVE_MAGIC "MORPARCH"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_GROWTH_MIN (1 << 20) // bytes, the file grows by doubling from this size
+#define ARCHIVE_EDGE_MAX(n) (8 + 5 + 5 + 5*(n)) // bytes of an edge of n moves at most
+#define ARCHIVE_EXTENSION ".sav"
+
+/**
+ * The archive file header
+ */
+typedef struct _ArchiveHeader {
+  char magic[8];
+  unsigned int version;
+  unsigned int root; // first root edge, 0 if the archive is empty
+  unsigned long long size; // bytes used, the file may be longer while open
+  unsigned long long games;
+} ArchiveHeader;
+
+/**
+ * An edge read from the file
+ */
+typedef struct _ArchiveEdge {
+  unsigned int offset; // 0 for the root (the empty game prefix)
+  unsigned int sibling;
+  unsigned int child;
+  int branch; // moves of the parent edge before this one
+  int nmoves;
+  const unsigned char* codes;
+} ArchiveEdge;
+
+struct _Archive {
+  unsigned char* data; // the whole file
+  size_t length;
+  ArchiveHeader* header;
+#ifdef _WIN32
+  char* filepath; // the file is written back on close
+#else
+  int fd; // kept open to grow the file
+#endif
+};
+
+static unsigned int archive_readU32(const unsigned char* p) {
+  unsigned int value;
+  memcpy(&value, p, sizeof(unsigned int));
+  return value;
+}
+
+static void archive_writeU32(unsigned char* p, unsigned int value) {
+  memcpy(p, &value, sizeof(unsigned int));
+}
+
+static unsigned int archive_readVarint(const unsigned char** p) {
+  unsigned int value = 0;
+  int shift = 0;
+  do {
+    value |= (unsigned int)(**p & 0x7F) << shift;
+    shift += 7;
+  } while(*(*p)++ & 0x80);
+  return value;
+}
+
+static unsigned char* archive_writeVarint(unsigned char* p, unsigned int value) {
+  for(; value>=0x80; value>>=7)
+    *p++ = (value & 0x7F) | 0x80;
+  *p++ = value;
+  return p;
+}
+
+/**
+ * Code a move by its difference with the previous one (zigzag: small differences of both signs are small codes)
+ */
+static unsigned int archive_getCode(int move, int prev) {
+  int delta = move - prev;
+  return delta>=0 ? 2*(unsigned int)delta : 2*(unsigned int)(-delta) - 1;
+}
+
+static int archive_getMove(unsigned int code, int prev) {
+  return prev + (code & 1 ? -(int)(code >> 1) - 1 : (int)(code >> 1));
+}
+
+/**
+ * Read an edge
+ * @param offset: the offset of the edge in the file
+ * @param edge: will be setted by the edge
+ */
+static void archive_readEdge(Archive* archive, unsigned int offset, ArchiveEdge* edge) {
+  const unsigned char* p = archive->data + offset;
+  edge->offset = offset;
+  edge->sibling = archive_readU32(p);
+  edge->child = archive_readU32(p + 4);
+  p += 8;
+  edge->branch = archive_readVarint(&p);
+  edge->nmoves = archive_readVarint(&p);
+  edge->codes = p;
+}
+
+/**
+ * Decode the first moves of an edge
+ * @param count: the number of moves to decode
+ * @param prev: the move before the edge (0 for a root edge)
+ * @param moves: will be setted by the moves
+ */
+static void archive_decode(const ArchiveEdge* edge, int count, int prev, int* moves) {
+  const unsigned char* p = edge->codes;
+  int i;
+  for(i=0; i<count; ++i)
+    prev = moves[i] = archive_getMove(archive_readVarint(&p), prev);
+}
+
+/**
+ * Follow moves down the trie, as far as they match a stored game
+ * @param edge: will be setted by the edge reached (the root if no move matches)
+ * @param pos: will be setted by the number of moves of this edge followed
+ * @return the number of moves followed
+ */
+static int archive_follow(Archive* archive, const int* moves, int nmoves, ArchiveEdge* edge, int* pos) {
+  ArchiveEdge child;
+  const unsigned char* p = NULL;
+  unsigned int next;
+  int d = 0, k = 0, prev, move = 0;
+  memset(edge, 0, sizeof(ArchiveEdge));
+  edge->child = archive->header->root;
+  while(d<nmoves) {
+    // a child leaving the edge here with the next move
+    prev = d>0 ? moves[d-1] : 0;
+    for(next=edge->child; next; next=child.sibling) {
+      archive_readEdge(archive, next, &child);
+      if(child.branch!=k || child.nmoves==0)
+        continue;
+      p = child.codes;
+      if((move = archive_getMove(archive_readVarint(&p), prev))==moves[d])
+        break;
+    }
+    if(next==0)
+      break;
+    *edge = child;
+    for(k=1, ++d; k<edge->nmoves && d<nmoves; ++k, ++d) {
+      prev = move;
+      if((move = archive_getMove(archive_readVarint(&p), prev))!=moves[d])
+        break;
+    }
+  }
+  *pos = k;
+  return d;
+}
+
+/**
+ * Make room at the end of the archive
+ * @param bytes: the number of bytes to append
+ * @return 0 if success, 1 if the archive can't grow
+ */
+static int archive_reserve(Archive* archive, size_t bytes) {
+  size_t size = archive->header->size, length = archive->length;
+  unsigned char* data;
+  if(size+bytes<=archive->length)
+    return 0;
+  if(size+bytes>ARCHIVE_MAX_SIZE)
+    return 1;
+  while(length<size+bytes)
+    length = MAX(2*length, ARCHIVE_GROWTH_MIN);
+  length = MIN(length, ARCHIVE_MAX_SIZE);
+#ifdef _WIN32
+  if((data = realloc(archive->data, length))==NULL)
+    return 1;
+#else
+  if(ftruncate(archive->fd, length)!=0)
+    return 1;
+  munmap(archive->data, archive->length);
+  if((data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, archive->fd, 0))==MAP_FAILED) {
+    archive->data = NULL;
+    return 1;
+  }
+#endif
+  archive->data = data;
+  archive->length = length;
+  archive->header = (ArchiveHeader*)data;
+  return 0;
+}
+
+/**
+ * Map an archive file
+ * @param length: the size of the file, 0 to create it
+ * @return 0 if success, 1 else
+ */
+static int archive_map(Archive* archive, const char* filepath, size_t length) {
+  int create = length==0;
+  length = MAX(length, sizeof(ArchiveHeader));
+#ifdef _WIN32
+  FILE* file = fopen(filepath, "rb");
+  archive->data = calloc(1, length);
+  if(!create && (file==NULL || fread(archive->data, 1, length, file)!=length)) {
+    if(file)
+      fclose(file);
+    free(archive->data);
+    return 1;
+  }
+  if(file)
+    fclose(file);
+  archive->filepath = malloc(strlen(filepath)+1);
+  strcpy(archive->filepath, filepath);
+#else
+  struct stat st;
+  if((archive->fd = open(filepath, O_RDWR | O_CREAT, 0644))<0)
+    return 1;
+  if(fstat(archive->fd, &st)!=0 || (create ? st.st_size!=0 || ftruncate(archive->fd, length)!=0
+                                           : (size_t)st.st_size<length)) {
+    close(archive->fd);
+    return 1;
+  }
+  length = create ? length : (size_t)st.st_size; // longer if it wasn't closed: the room left for appends
+  archive->data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, archive->fd, 0);
+  if(archive->data==MAP_FAILED) {
+    close(archive->fd);
+    return 1;
+  }
+#endif
+  archive->length = length;
+  archive->header = (ArchiveHeader*)archive->data;
+  return 0;
+}
+
+/**
+ * Read the size of an existing archive file
+ * @return the size, 0 if the file doesn't exist, -1 if it isn't an archive
+ */
+static long long archive_readSize(const char* filepath) {
+  ArchiveHeader header;
+  FILE* file = fopen(filepath, "rb");
+  if(file==NULL)
+    return 0;
+  if(fread(&header, sizeof(ArchiveHeader), 1, file)!=1) {
+    fclose(file);
+    return -1;
+  }
+  fclose(file);
+  if(memcmp(header.magic, ARCHIVE_MAGIC, 8)!=0 || header.version!=ARCHIVE_VERSION
+     || header.size<sizeof(ArchiveHeader) || header.size>ARCHIVE_MAX_SIZE)
+    return -1;
+  return header.size;
+}
+
+extern Archive* archive_open(const char* filepath) {
+  Archive* archive;
+  long long size = archive_readSize(filepath);
+  if(size<0)
+    return NULL;
+  archive = malloc(sizeof(Archive));
+  if(archive_map(archive, filepath, size)!=0) {
+    free(archive);
+    return NULL;
+  }
+  if(size==0) {
+    memcpy(archive->header->magic, ARCHIVE_MAGIC, 8);
+    archive->header->version = ARCHIVE_VERSION;
+    archive->header->root = 0;
+    archive->header->size = sizeof(ArchiveHeader);
+    archive->header->games = 0;
+  }
+  return archive;
+}
+
+extern void archive_close(Archive* archive) {
+  size_t size = archive->data ? archive->header->size : 0;
+#ifdef _WIN32
+  FILE* file = fopen(archive->filepath, "wb");
+  if(file && archive->data) {
+    fwrite(archive->data, 1, size, file);
+    fclose(file);
+  }
+  else if(file)
+    fclose(file);
+  free(archive->filepath);
+  free(archive->data);
+#else
+  if(archive->data) {
+    msync(archive->data, archive->length, MS_SYNC);
+    munmap(archive->data, archive->length);
+    if(ftruncate(archive->fd, size)!=0) // drop the room left for appends
+      fprintf(stderr, "Unable to truncate the archive.\n");
+  }
+  close(archive->fd);
+#endif
+  free(archive);
+}
+
+extern long long archive_getGames(Archive* archive) {
+  return archive->data ? archive->header->games : 0;
+}
+
+extern long long archive_getBytes(Archive* archive) {
+  return archive->data ? archive->header->size : 0;
+}
+
+extern int archive_addGame(Archive* archive, const int* moves, int nmoves) {
+  ArchiveEdge edge, child;
+  unsigned char* p;
+  unsigned int offset, next;
+  int i, k, d;
+  if(archive->data==NULL || nmoves>MAX_POSSIBILITIES)
+    return 2;
+  d = archive_follow(archive, moves, nmoves, &edge, &k);
+  if(d==nmoves) { // the game ends at the end of the edge, or in it: it may be there already
+    if(edge.offset && k==edge.nmoves)
+      return 1;
+    for(next=edge.child; next; next=child.sibling) {
+      archive_readEdge(archive, next, &child);
+      if(child.branch==k && child.nmoves==0)
+        return 1;
+    }
+  }
+  if(archive_reserve(archive, ARCHIVE_EDGE_MAX(nmoves-d))!=0)
+    return 2;
+  // the new edge is the first child of the edge reached
+  offset = archive->header->size;
+  p = archive->data + offset;
+  archive_writeU32(p, edge.child);
+  archive_writeU32(p + 4, 0);
+  p = archive_writeVarint(p + 8, k);
+  p = archive_writeVarint(p, nmoves-d);
+  for(i=d; i<nmoves; ++i)
+    p = archive_writeVarint(p, archive_getCode(moves[i], i>0 ? moves[i-1] : 0));
+  archive->header->size = p - archive->data;
+  if(edge.offset)
+    archive_writeU32(archive->data + edge.offset + 4, offset);
+  else
+    archive->header->root = offset;
+  ++ archive->header->games;
+  return 0;
+}
+
+/**
+ * Visit the game of an edge and the games leaving it
+ * @param start: the number of moves before the edge, path holds them
+ * @param from: the first branch of the children visited
+ * @param path: the moves of the games, from the start cross
+ * @return the number of games visited
+ */
+static long long archive_visit(Archive* archive, const ArchiveEdge* edge, int start, int from, int* path,
+                               ArchiveVisitor visitor, void* data) {
+  ArchiveEdge child;
+  unsigned int next;
+  long long count = 1;
+  int prev = start>0 ? path[start-1] : 0;
+  archive_decode(edge, edge->nmoves, prev, path+start);
+  visitor(path, start+edge->nmoves, data);
+  for(next=edge->child; next; next=child.sibling) {
+    archive_readEdge(archive, next, &child);
+    if(child.branch<from)
+      continue;
+    archive_decode(edge, child.branch, prev, path+start); // the moves of the edge before the child
+    count += archive_visit(archive, &child, start+child.branch, 0, path, visitor, data);
+  }
+  return count;
+}
+
+extern long long archive_forEach(Archive* archive, const int* prefix, int nprefix, ArchiveVisitor visitor, void* data) {
+  ArchiveEdge edge, child;
+  unsigned int next;
+  long long count = 0;
+  int k, d, *path;
+  if(archive->data==NULL || nprefix>MAX_POSSIBILITIES
+     || (d = archive_follow(archive, prefix, nprefix, &edge, &k))<nprefix)
+    return 0;
+  path = malloc(sizeof(int)*(MAX_POSSIBILITIES+1));
+  memcpy(path, prefix, sizeof(int)*nprefix);
+  if(edge.offset) // the games leaving the edge from the end of the prefix, and the game of the edge
+    count = archive_visit(archive, &edge, d-k, k, path, visitor, data);
+  else
+    for(next=edge.child; next; next=child.sibling) {
+      archive_readEdge(archive, next, &child);
+      count += archive_visit(archive, &child, 0, 0, path, visitor, data);
+    }
+  free(path);
+  return count;
+}
+
+extern int archive_addDirectory(Archive* archive, const char* directory, int* added) {
+  DIR* dir = opendir(directory);
+  struct dirent* entry;
+  Game* game;
+  Line* lines;
+  char* path;
+  int i, n, length, moves[MAX_POSSIBILITIES];
+  const char* separator = directory[0] && directory[strlen(directory)-1]=='/' ? "" : "/";
+  *added = 0;
+  if(dir==NULL)
+    return 1;
+  while((entry = readdir(dir))!=NULL) {
+    length = strlen(entry->d_name);
+    if(length<=strlen(ARCHIVE_EXTENSION)
+       || strcmp(entry->d_name+length-strlen(ARCHIVE_EXTENSION), ARCHIVE_EXTENSION)!=0)
+      continue;
+    path = malloc(strlen(directory)+strlen(separator)+length+1);
+    sprintf(path, "%s%s%s", directory, separator, entry->d_name);
+    game = game_init();
+    if(ie_importGame(path, game)==0) {
+      lines = game_getLines(game, &n);
+      for(i=0; i<n; ++i)
+        moves[i] = line_getIndex(lines[i]);
+      if(archive_addGame(archive, moves, n)==0)
+        ++ *added;
+      free(game_getNickname(game));
+    }
+    game_close(game);
+    free(path);
+  }
+  closedir(dir);
+  return 0;
+}
@@ -0,0 +1,79 @@
+#ifndef _ARCHIVE_H
+#define _ARCHIVE_H
+/**
+ * Archive module
+ *
+ * A corpus of games stored as a trie of their line indices, so games sharing an opening store it once.
+ * Each game is one edge of the trie: the moves following the point where it leaves an earlier game
+ * (its parent edge), so adding a game appends its edge at the end of the file and links it to its
+ * parent, without rewriting anything. A game ending inside an earlier one is an edge without moves.
+ * Moves are coded as the zigzag varint of their difference with the previous move.
+ * The file is mapped in memory: games are read in place, and those under a prefix are visited
+ * without decoding the others.
+ *
+ * File: a header (magic, version, first root edge, bytes used, games) followed by the edges:
+ *   u32 next sibling edge (0 if none), u32 first child edge (0 if none),
+ *   varint branch (moves of the parent edge before this one), varint n, n varint move codes
+ * Offsets are 32 bits: an archive holds at most ARCHIVE_MAX_SIZE bytes.
+ * An archive is used by one thread at a time.
+ */
+
+#define ARCHIVE_MAX_SIZE 0xFFFFFFFFULL // bytes
+
+/**
+ * An archive
+ */
+typedef struct _Archive Archive;
+
+/**
+ * Called for each game visited ( @see archive_forEach )
+ * @param moves, nmoves: the line indices of the game ( @see line_getIndex ), from the start cross
+ * @param data: the data passed to archive_forEach
+ */
+typedef void (*ArchiveVisitor)(const int* moves, int nmoves, void* data);
+
+/**
+ * Open an archive file, created if it doesn't exist
+ * @return the archive, or NULL if the file can't be opened or isn't an archive
+ */
+extern Archive* archive_open(const char* filepath);
+
+/**
+ * Close an archive (its content is saved into its file)
+ */
+extern void archive_close(Archive* archive);
+
+/**
+ * Get the number of games of an archive
+ */
+extern long long archive_getGames(Archive* archive);
+
+/**
+ * Get the size of an archive file (bytes)
+ */
+extern long long archive_getBytes(Archive* archive);
+
+/**
+ * Add a game to an archive
+ * @param moves, nmoves: the line indices of the game, from the start cross
+ * @return 0 if added, 1 if the archive already holds the game, 2 if the archive is full
+ */
+extern int archive_addGame(Archive* archive, const int* moves, int nmoves);
+
+/**
+ * Visit the games of an archive starting with a prefix
+ * @param prefix, nprefix: the first line indices of the games (nprefix 0 for all the games)
+ * @param visitor: called for each game
+ * @return the number of games visited
+ */
+extern long long archive_forEach(Archive* archive, const int* prefix, int nprefix, ArchiveVisitor visitor, void* data);
+
+/**
+ * Add the saved games of a directory to an archive
+ * @param directory: the directory of the .sav files
+ * @param added: will be setted by the number of games added (those already held are skipped)
+ * @return 0 if success, 1 if the directory can't be read
+ */
+extern int archive_addDirectory(Archive* archive, const char* directory, int* added);
+
+#endif
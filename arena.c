@@ -0,0 +1,95 @@
+#include <stdlib.h>
+
+#include "arena.h"
+#include "globals.h"
+
+#define ARENA_ALIGN 16
+
+typedef struct _ArenaBlock {
+  struct _ArenaBlock* next;
+  size_t size;
+  size_t used;
+  size_t padding; // keeps data aligned on ARENA_ALIGN
+  unsigned char data[];
+} ArenaBlock;
+
+struct _Arena {
+  ArenaBlock* first;
+  ArenaBlock* current; // the block allocations are taken from
+  size_t blockSize;
+  size_t capacity;
+};
+
+static ArenaBlock* arena_newBlock(Arena* arena, size_t size) {
+  ArenaBlock* block = malloc(sizeof(ArenaBlock) + size);
+  if(block==NULL)
+    return NULL;
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  arena->capacity += size;
+  return block;
+}
+
+extern Arena* arena_new(size_t blockSize) {
+  Arena* arena = malloc(sizeof(Arena));
+  arena->blockSize = MAX(blockSize, (size_t)ARENA_ALIGN);
+  arena->capacity = 0;
+  arena->first = arena->current = arena_newBlock(arena, arena->blockSize);
+  return arena;
+}
+
+extern void arena_close(Arena* arena) {
+  ArenaBlock *block, *next;
+  for(block = arena->first; block; block = next) {
+    next = block->next;
+    free(block);
+  }
+  free(arena);
+}
+
+extern void* arena_alloc(Arena* arena, size_t size) {
+  ArenaBlock *block = arena->current, *next;
+  size = (size + ARENA_ALIGN-1) & ~(size_t)(ARENA_ALIGN-1);
+  if(block==NULL)
+    return NULL;
+  // move to the next block until one is large enough (blocks after current are free)
+  while(block->size - block->used < size) {
+    next = block->next;
+    if(next==NULL || next->size < size) {
+      next = arena_newBlock(arena, MAX(size, arena->blockSize));
+      if(next==NULL)
+        return NULL;
+      next->next = block->next;
+      block->next = next;
+    }
+    block = next;
+    block->used = 0;
+  }
+  arena->current = block;
+  block->used += size;
+  return block->data + block->used - size;
+}
+
+extern ArenaMark arena_getMark(Arena* arena) {
+  ArenaMark mark;
+  mark.block = arena->current;
+  mark.used = arena->current ? arena->current->used : 0;
+  return mark;
+}
+
+extern void arena_rewind(Arena* arena, ArenaMark mark) {
+  arena->current = mark.block;
+  if(mark.block)
+    mark.block->used = mark.used;
+}
+
+extern void arena_reset(Arena* arena) {
+  arena->current = arena->first;
+  if(arena->first)
+    arena->first->used = 0;
+}
+
+extern size_t arena_getCapacity(Arena* arena) {
+  return arena->capacity;
+}
@@ -0,0 +1,68 @@
+#ifndef _ARENA_H
+#define _ARENA_H
+/**
+ * Arena module
+ * 
+ * A bump allocator for short-lived search data (nodes, move lists, sequences).
+ * Memory is taken from large blocks and is never freed one allocation at a time:
+ * the arena is rewound to a mark or reset wholesale, and its blocks are reused.
+ * An arena is not thread safe: searches use one arena per thread.
+ */
+
+#include <stddef.h>
+
+/**
+ * An arena
+ */
+typedef struct _Arena Arena;
+
+/**
+ * A position in an arena ( @see arena_getMark )
+ */
+typedef struct _ArenaMark {
+  struct _ArenaBlock* block;
+  size_t used;
+} ArenaMark;
+
+/**
+ * Create an arena
+ * @param blockSize: the size of the blocks allocated when the arena is full (bytes)
+ */
+extern Arena* arena_new(size_t blockSize);
+
+/**
+ * Close an arena and free all its blocks
+ */
+extern void arena_close(Arena* arena);
+
+/**
+ * Allocate memory from an arena
+ * The memory is aligned for any type and is valid until the arena is rewound or reset.
+ * @param size: the size of the memory (bytes)
+ * @return the memory, or NULL if the system is out of memory
+ */
+extern void* arena_alloc(Arena* arena, size_t size);
+
+/**
+ * Get the current position of an arena
+ */
+extern ArenaMark arena_getMark(Arena* arena);
+
+/**
+ * Free all the memory allocated since a mark was taken
+ * @param mark: a mark of the arena, taken after the last reset
+ */
+extern void arena_rewind(Arena* arena, ArenaMark mark);
+
+/**
+ * Free all the memory allocated from an arena (blocks are kept for reuse)
+ */
+extern void arena_reset(Arena* arena);
+
+/**
+ * Get the memory reserved by an arena
+ * @return the total size of the arena blocks (bytes)
+ */
+extern size_t arena_getCapacity(Arena* arena);
+
+#endif
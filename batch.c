@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "game.h"
+#include "globals.h"
+#include "points.h"
+#include "utils.h"
+
+#define BATCH_CASES (GRID_SIZE*GRID_SIZE)
+#define BATCH_DIRECTIONS 4
+
+typedef unsigned long long BatchMask; // bit i: lane i
+
+// line index directions ( @see line_fromIndex ): the case after x*GRID_SIZE+y is at +stride
+static const int strides[BATCH_DIRECTIONS] = { GRID_SIZE, 1, GRID_SIZE+1, GRID_SIZE-1 };
+// start cases of the lines of each direction which fit in the grid
+static const int minY[BATCH_DIRECTIONS] = { 0, 0, 0, LINE_LENGTH-1 };
+static const int maxX[BATCH_DIRECTIONS] = { GRID_SIZE-LINE_LENGTH, GRID_SIZE-1, GRID_SIZE-LINE_LENGTH, GRID_SIZE-LINE_LENGTH };
+static const int maxY[BATCH_DIRECTIONS] = { GRID_SIZE-1, GRID_SIZE-LINE_LENGTH, GRID_SIZE-LINE_LENGTH, GRID_SIZE-1 };
+
+/**
+ * The bit-sliced boards of a batch
+ */
+typedef struct _BatchBoard {
+  BatchMask cases[BATCH_CASES]; // by x*GRID_SIZE+y: lanes where the case is occupied
+  BatchMask segments[BATCH_DIRECTIONS][BATCH_CASES]; // lanes where a line joins the case to the next one
+  BatchMask legal[LEGAL_SET_WORDS*64]; // by line index: lanes where the line is playable
+  LegalSet sets[BATCH_LANES]; // legal, transposed
+} BatchBoard;
+
+/**
+ * Compute the legal masks of the lines of a direction
+ */
+static inline void batch_computeDirection(BatchBoard* board, int dir, BatchMask active) {
+  const BatchMask* cases = board->cases;
+  const BatchMask* segments = board->segments[dir];
+  BatchMask* legal = board->legal + dir*BATCH_CASES;
+  BatchMask empty, twoEmpty, used;
+  int s = strides[dir];
+  int x, y, c, k;
+  for(x=0; x<=maxX[dir]; ++x) {
+    for(y=minY[dir]; y<=maxY[dir]; ++y) { // contiguous cases: vectorized
+      c = x*GRID_SIZE + y;
+      empty = twoEmpty = used = 0;
+      for(k=0; k<LINE_LENGTH; ++k) {
+        twoEmpty |= empty & ~cases[c+k*s];
+        empty |= ~cases[c+k*s];
+      }
+      for(k=0; k<LINE_LENGTH-1; ++k)
+        used |= segments[c+k*s];
+      legal[c] = active & ~twoEmpty & ~used;
+    }
+  }
+}
+
+/**
+ * Transpose a 64x64 bits matrix: bit j of a[i] is swapped with bit i of a[j]
+ */
+static inline void batch_transpose(BatchMask* a) {
+  BatchMask m = 0x00000000FFFFFFFFULL, t;
+  int j, k;
+  for(j=32; j!=0; j>>=1, m^=m<<j) {
+    for(k=0; k<64; k=((k|j)+1) & ~j) {
+      t = ((a[k] >> j) ^ a[k|j]) & m;
+      a[k|j] ^= t;
+      a[k] ^= t << j;
+    }
+  }
+}
+
+/**
+ * Make the legal set of each lane from the legal masks
+ */
+static void batch_transposeLegal(BatchBoard* board, int n) {
+  BatchMask block[64], any;
+  int w, i;
+  for(w=0; w<LEGAL_SET_WORDS; ++w) {
+    for(i=0, any=0; i<64; ++i)
+      any |= block[i] = board->legal[w*64+i];
+    if(any)
+      batch_transpose(block);
+    for(i=0; i<n; ++i)
+      board->sets[i].bits[w] = block[i];
+  }
+}
+
+/**
+ * Play a line on the board of a lane
+ * @return the points won
+ */
+static inline int batch_play(BatchBoard* board, int lane, int index) {
+  BatchMask bit = 1ULL << lane;
+  int dir = index/BATCH_CASES, c = index%BATCH_CASES, s = strides[dir];
+  int k, occupied = 0;
+  for(k=0; k<LINE_LENGTH; ++k) {
+    occupied += (board->cases[c+k*s] >> lane) & 1;
+    board->cases[c+k*s] |= bit;
+  }
+  for(k=0; k<LINE_LENGTH-1; ++k)
+    board->segments[dir][c+k*s] |= bit;
+  return occupied==LINE_LENGTH ? POINTS_TRACE_LINE : POINTS_PUT_POINT;
+}
+
+/**
+ * Set the board of a lane to a game position
+ */
+static void batch_setPosition(BatchBoard* board, int lane, Game* game) {
+  Grid* grid = game_getGrid(game);
+  Line* lines;
+  int x, y, i, k, index, dir, nlines;
+  for(x=0; x<GRID_SIZE; ++x)
+    for(y=0; y<GRID_SIZE; ++y)
+      if(grid->grid[x][y]!=CASE_EMPTY)
+        board->cases[x*GRID_SIZE+y] |= 1ULL << lane;
+  lines = game_getLines(game, &nlines);
+  for(i=0; i<nlines; ++i) {
+    index = line_getIndex(lines[i]);
+    dir = index/BATCH_CASES;
+    for(k=0; k<LINE_LENGTH-1; ++k)
+      board->segments[dir][index%BATCH_CASES + k*strides[dir]] |= 1ULL << lane;
+  }
+}
+
+extern long batch_playout(Game** games, int n, unsigned long long* random, int* scores, int* sequences, int* lengths) {
+  BatchBoard* board;
+  BatchMask active;
+  long played = 0;
+  int i, w, dir, count, index, length[BATCH_LANES];
+  if(n<1 || n>BATCH_LANES)
+    return -1;
+  board = calloc(1, sizeof(BatchBoard));
+  active = n==BATCH_LANES ? ~0ULL : (1ULL << n) - 1;
+  for(i=0; i<n; ++i) {
+    batch_setPosition(board, i, games[i]);
+    scores[i] = game_getScore(games[i]);
+    length[i] = 0;
+  }
+  while(active) {
+    for(dir=0; dir<BATCH_DIRECTIONS; ++dir)
+      batch_computeDirection(board, dir, active);
+    batch_transposeLegal(board, n);
+    for(i=0; i<n; ++i) {
+      if(!((active >> i) & 1))
+        continue;
+      for(w=0, count=0; w<LEGAL_SET_WORDS; ++w)
+        count += __builtin_popcountll(board->sets[i].bits[w]);
+      if(count==0) { // game over: the lane is masked off
+        active &= ~(1ULL << i);
+        continue;
+      }
+      index = legalset_select(&board->sets[i], util_random(&random[i]) % count);
+      scores[i] += batch_play(board, i, index);
+      if(sequences)
+        sequences[i*MAX_POSSIBILITIES + length[i]] = index;
+      ++ length[i];
+      ++ played;
+    }
+  }
+  if(lengths)
+    memcpy(lengths, length, sizeof(int)*n);
+  free(board);
+  return played;
+}
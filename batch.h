@@ -0,0 +1,32 @@
+#ifndef _BATCH_H
+#define _BATCH_H
+/**
+ * Batch module
+ *
+ * Random games played in lockstep, one game per lane of a 64 bits mask.
+ * Boards are bit-sliced: each case holds the mask of the lanes where it is occupied, and each
+ * case and direction the mask of the lanes where a line joins it to the next case of the direction.
+ * The rules of game_isPlayableLine are then checked for every line and every lane at once
+ * (at most one empty case, no common segment with a played line of the same direction),
+ * the legal masks are transposed into one legal set per lane ( @see LegalSet ), and each lane
+ * plays a uniform random line of its set. Lanes of finished games are masked off.
+ * A lane draws its lines as a uniform rollout does ( @see rollout_play ): with the same random
+ * state, it plays the same game.
+ */
+
+#include "game.h"
+
+#define BATCH_LANES 64 // games of a batch at most
+
+/**
+ * Play random games in lockstep until their end
+ * @param games: the n positions the games start from (not modified), n in [1, BATCH_LANES]
+ * @param random: the n random states of the games, updated
+ * @param scores: will be setted by the n final scores
+ * @param sequences: will be setted by the line indices played in game i, from sequences[i*MAX_POSSIBILITIES] (can be NULL)
+ * @param lengths: will be setted by the n numbers of lines played (can be NULL)
+ * @return the total number of lines played, -1 if n is out of range
+ */
+extern long batch_playout(Game** games, int n, unsigned long long* random, int* scores, int* sequences, int* lengths);
+
+#endif
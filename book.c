@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "book.h"
+#include "game.h"
+#include "globals.h"
+#include "points.h"
+
+#define BOOK_MAGIC "MORPBOOK"
+#define BOOK_VERSION 1
+#define BOOK_HEADER_SIZE 64 // bytes, entries start aligned
+#define BOOK_CAPACITY_MIN 64
+#define BOOK_MAX_PROBES 32 // a position is stored in one of the 32 slots following its hash
+
+/**
+ * The book file header
+ */
+typedef struct _BookHeader {
+  char magic[8];
+  unsigned int version;
+  unsigned int capacity; // entries, a power of two
+  atomic_llong size; // entries used
+} BookHeader;
+
+/**
+ * A book file entry, the key 0 marks an empty entry
+ */
+typedef struct _BookSlot {
+  atomic_ullong key; // canonical position hash
+  atomic_uint visits;
+  atomic_int bestScore;
+} BookSlot;
+
+struct _Book {
+  unsigned char* data; // the whole file
+  size_t length;
+  BookHeader* header;
+  BookSlot* slots;
+  unsigned long long mask;
+#ifdef _WIN32
+  char* filepath; // the file is written back on close
+#endif
+};
+
+static unsigned long long book_getKey(unsigned long long hash) {
+  return hash==0 ? 1 : hash; // 0 marks empty entries
+}
+
+/**
+ * Get the hashes of the images of a position by the grid symmetries
+ */
+static void book_getHashes(Line* lines, int nlines, unsigned long long* hashes) {
+  Line line;
+  int i, s;
+  for(s=0; s<SYMMETRY_COUNT; ++s)
+    for(i=0, hashes[s]=0; i<nlines; ++i) {
+      line_transform(lines[i], s, &line);
+      hashes[s] ^= line_getKey(line);
+    }
+}
+
+/**
+ * Get the canonical hash of a position with one more line
+ * @param hashes: the hashes of the position images ( @see book_getHashes )
+ */
+static unsigned long long book_getChildHash(unsigned long long* hashes, Line line) {
+  unsigned long long hash, canonical = 0;
+  Line image;
+  int s;
+  for(s=0; s<SYMMETRY_COUNT; ++s) {
+    line_transform(line, s, &image);
+    hash = hashes[s] ^ line_getKey(image);
+    canonical = s==0 ? hash : MIN(canonical, hash);
+  }
+  return canonical;
+}
+
+/**
+ * Find the entry of a position
+ * @param create: TRUE to insert the position if it isn't in the book
+ * @return the entry, or NULL if the position isn't in the book (or if the book is full around its hash)
+ */
+static BookSlot* book_find(Book* book, unsigned long long hash, int create) {
+  unsigned long long key = book_getKey(hash), current;
+  BookSlot* slot;
+  int i;
+  for(i=0; i<BOOK_MAX_PROBES; ++i) {
+    slot = &book->slots[(key + i) & book->mask];
+    current = atomic_load_explicit(&slot->key, memory_order_acquire);
+    if(current==key)
+      return slot;
+    if(current!=0)
+      continue;
+    if(!create)
+      return NULL;
+    if(atomic_compare_exchange_strong(&slot->key, &current, key)) {
+      atomic_fetch_add_explicit(&book->header->size, 1, memory_order_relaxed);
+      return slot;
+    }
+    if(current==key) // inserted by another thread
+      return slot;
+  }
+  return NULL;
+}
+
+static void book_record(Book* book, unsigned long long hash, int score) {
+  BookSlot* slot = book_find(book, hash, TRUE);
+  int best;
+  if(slot==NULL)
+    return;
+  atomic_fetch_add_explicit(&slot->visits, 1, memory_order_relaxed);
+  best = atomic_load_explicit(&slot->bestScore, memory_order_relaxed);
+  while(score>best && !atomic_compare_exchange_weak(&slot->bestScore, &best, score));
+}
+
+static int book_getEntry(Book* book, unsigned long long hash, BookEntry* entry) {
+  BookSlot* slot = book_find(book, hash, FALSE);
+  if(slot==NULL)
+    return 1;
+  entry->visits = atomic_load_explicit(&slot->visits, memory_order_relaxed);
+  entry->bestScore = atomic_load_explicit(&slot->bestScore, memory_order_relaxed);
+  return entry->visits>0 ? 0 : 1;
+}
+
+/**
+ * Map (or load) the content of a book file
+ * @return 0 if success, 1 else
+ */
+static int book_map(Book* book, const char* filepath, size_t length, int create) {
+#ifdef _WIN32
+  FILE* file = fopen(filepath, "rb");
+  book->data = calloc(1, length);
+  if(!create && (file==NULL || fread(book->data, 1, length, file)!=length)) {
+    if(file)
+      fclose(file);
+    free(book->data);
+    return 1;
+  }
+  if(file)
+    fclose(file);
+  book->filepath = malloc(strlen(filepath)+1);
+  strcpy(book->filepath, filepath);
+#else
+  struct stat st;
+  int fd = open(filepath, O_RDWR | O_CREAT, 0644);
+  if(fd<0)
+    return 1;
+  if(fstat(fd, &st)!=0 || (create ? st.st_size!=0 || ftruncate(fd, length)!=0 : (size_t)st.st_size!=length)) {
+    close(fd);
+    return 1;
+  }
+  book->data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(book->data==MAP_FAILED)
+    return 1;
+#endif
+  book->length = length;
+  book->header = (BookHeader*)book->data;
+  book->slots = (BookSlot*)(book->data + BOOK_HEADER_SIZE);
+  return 0;
+}
+
+/**
+ * Read the capacity of an existing book file
+ * @return the capacity, 0 if the file doesn't exist, -1 if it isn't a book
+ */
+static long book_readCapacity(const char* filepath) {
+  BookHeader header;
+  FILE* file = fopen(filepath, "rb");
+  if(file==NULL)
+    return 0;
+  if(fread(&header, sizeof(BookHeader), 1, file)!=1) {
+    fclose(file);
+    return -1;
+  }
+  fclose(file);
+  if(memcmp(header.magic, BOOK_MAGIC, 8)!=0 || header.version!=BOOK_VERSION
+     || header.capacity<BOOK_CAPACITY_MIN || (header.capacity & (header.capacity-1))!=0)
+    return -1;
+  return header.capacity;
+}
+
+extern Book* book_open(const char* filepath, int capacity) {
+  Book* book;
+  long size = book_readCapacity(filepath);
+  int create = size==0;
+  if(size<0)
+    return NULL;
+  if(create)
+    for(size=BOOK_CAPACITY_MIN; size<capacity; size*=2);
+  book = malloc(sizeof(Book));
+  if(book_map(book, filepath, BOOK_HEADER_SIZE + sizeof(BookSlot)*size, create)!=0) {
+    free(book);
+    return NULL;
+  }
+  if(create) { // the new file is zero filled: all entries are empty
+    memcpy(book->header->magic, BOOK_MAGIC, 8);
+    book->header->version = BOOK_VERSION;
+    book->header->capacity = size;
+    atomic_init(&book->header->size, 0);
+  }
+  book->mask = size-1;
+  return book;
+}
+
+extern void book_close(Book* book) {
+#ifdef _WIN32
+  FILE* file = fopen(book->filepath, "wb");
+  if(file) {
+    fwrite(book->data, 1, book->length, file);
+    fclose(file);
+  }
+  free(book->filepath);
+  free(book->data);
+#else
+  msync(book->data, book->length, MS_SYNC);
+  munmap(book->data, book->length);
+#endif
+  free(book);
+}
+
+extern long book_getSize(Book* book) {
+  return atomic_load_explicit(&book->header->size, memory_order_relaxed);
+}
+
+extern long book_getCapacity(Book* book) {
+  return book->header->capacity;
+}
+
+extern void book_recordGame(Book* book, Line* lines, int nlines, int score) {
+  unsigned long long hashes[SYMMETRY_COUNT], canonical;
+  Line image;
+  int i, s;
+  memset(hashes, 0, sizeof(hashes));
+  for(i=0; i<=MIN(nlines, BOOK_MAX_DEPTH); ++i) {
+    for(s=0, canonical=hashes[0]; s<SYMMETRY_COUNT; ++s)
+      canonical = MIN(canonical, hashes[s]);
+    book_record(book, canonical, score);
+    if(i==nlines)
+      break;
+    for(s=0; s<SYMMETRY_COUNT; ++s) {
+      line_transform(lines[i], s, &image);
+      hashes[s] ^= line_getKey(image);
+    }
+  }
+}
+
+extern int book_lookup(Book* book, Game* game, BookEntry* entry) {
+  return book_getEntry(book, game_getCanonicalHash(game), entry);
+}
+
+extern int book_getBestLine(Book* book, Game* game, unsigned int minVisits, Line* line, BookEntry* entry) {
+  unsigned long long hashes[SYMMETRY_COUNT];
+  BookEntry child, best;
+  Line *lines, *possibilities;
+  int i, n, nlines, found = FALSE;
+  lines = game_getLines(game, &nlines);
+  if(nlines>=BOOK_MAX_DEPTH)
+    return 1;
+  book_getHashes(lines, nlines, hashes);
+  possibilities = game_getAllPossibilities(game, &n);
+  for(i=0; i<n; ++i) {
+    if(book_getEntry(book, book_getChildHash(hashes, possibilities[i]), &child)!=0 || child.visits<MAX(minVisits, 1))
+      continue;
+    if(!found || child.bestScore>best.bestScore || (child.bestScore==best.bestScore && child.visits>best.visits)) {
+      found = TRUE;
+      best = child;
+      *line = possibilities[i];
+    }
+  }
+  if(found && entry)
+    *entry = best;
+  return found ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+#ifndef _BOOK_H
+#define _BOOK_H
+/**
+ * Opening book module
+ *
+ * A persistent book of the positions met by searches in the first BOOK_MAX_DEPTH lines of a game.
+ * Positions are keyed by canonical hash ( @see game_getCanonicalHash ), so symmetric openings share
+ * their entry, and store how many games went through them and the best final score of these games.
+ * The book file is an open addressing hash table mapped in memory: entries are read and updated
+ * with atomic operations, without locks, by any number of threads.
+ * The table size is fixed when the book is created: positions which find no free slot are not stored.
+ */
+
+#include "game.h"
+#include "points.h"
+
+#define BOOK_MAX_DEPTH 20 // lines
+#define BOOK_CAPACITY_DEFAULT (1<<20) // positions
+
+/**
+ * An opening book
+ */
+typedef struct _Book Book;
+
+/**
+ * Statistics of a book position
+ */
+typedef struct _BookEntry {
+  unsigned int visits; // games recorded through the position
+  int bestScore; // best final score of these games
+} BookEntry;
+
+/**
+ * Open a book file, created if it doesn't exist
+ * @param filepath: the book file path
+ * @param capacity: the number of positions of a new book (rounded up to a power of two)
+ * @return the book, or NULL if the file can't be opened or isn't a book
+ */
+extern Book* book_open(const char* filepath, int capacity);
+
+/**
+ * Close a book (its content is saved into its file)
+ */
+extern void book_close(Book* book);
+
+/**
+ * Get the number of positions stored in a book
+ */
+extern long book_getSize(Book* book);
+
+/**
+ * Get the number of positions a book can store
+ */
+extern long book_getCapacity(Book* book);
+
+/**
+ * Record a game: each of its positions in the first BOOK_MAX_DEPTH lines gets a visit and the score
+ * @param lines, nlines: the lines of the game, from the start cross
+ * @param score: the final score of the game
+ */
+extern void book_recordGame(Book* book, Line* lines, int nlines, int score);
+
+/**
+ * Look a position up
+ * @param entry: will be setted by the position statistics
+ * @return 0 if the position is in the book, 1 else
+ */
+extern int book_lookup(Book* book, Game* game, BookEntry* entry);
+
+/**
+ * Get the possible line leading to the best book position
+ * @param minVisits: the minimum number of visits of the position
+ * @param line: will be setted by the line to play
+ * @param entry: will be setted by the statistics of the position after the line (can be NULL)
+ * @return 0 if a line was found, 1 else
+ */
+extern int book_getBestLine(Book* book, Game* game, unsigned int minVisits, Line* line, BookEntry* entry);
+
+#endif
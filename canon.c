@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "canon.h"
+#include "export.h"
+#include "globals.h"
+#include "points.h"
+#include "utils.h"
+
+#define CANON_EXTENSION ".sav"
+
+/**
+ * A save file of an archive
+ */
+typedef struct _CanonFile {
+  char* path;
+  int* lines; // canonical form, NULL if the file is invalid
+  int nlines;
+  long long bytes;
+} CanonFile;
+
+/**
+ * Work shared by the dedup threads: files are taken one by one
+ */
+typedef struct _CanonShared {
+  pthread_mutex_t lock;
+  CanonFile* files;
+  int nfiles;
+  int next; // next file to read
+} CanonShared;
+
+extern int canon_getForm(Game* game, int* lines, int* symmetry) {
+  LegalSet set;
+  Line image, *played;
+  int i, s, index, n, smaller, best = 0;
+  played = game_getLines(game, &n);
+  for(s=0; s<SYMMETRY_COUNT; ++s) {
+    memset(&set, 0, sizeof(LegalSet));
+    for(i=0; i<n; ++i) {
+      line_transform(played[i], s, &image);
+      index = line_getIndex(image);
+      set.bits[index/64] |= 1ULL << (index%64);
+    }
+    // the indices come out sorted: compare them to the smallest image so far while copying
+    for(i=0, smaller=(s==0), index=legalset_next(&set, 0); index>=0; index=legalset_next(&set, index+1), ++i) {
+      if(!smaller && index>lines[i])
+        break;
+      smaller = smaller || index<lines[i];
+      lines[i] = index;
+    }
+    if(smaller)
+      best = s;
+  }
+  if(symmetry)
+    *symmetry = best;
+  return n;
+}
+
+extern int canon_compare(const int* a, int na, const int* b, int nb) {
+  int i;
+  if(na!=nb)
+    return na - nb;
+  for(i=0; i<na && a[i]==b[i]; ++i);
+  return i<na ? a[i] - b[i] : 0;
+}
+
+extern int canon_rebuild(const int* lines, int nlines, Game* game) {
+  int* left = malloc(sizeof(int)*MAX(nlines, 1));
+  int i, n, nleft = nlines, played = TRUE;
+  Line line;
+  memcpy(left, lines, sizeof(int)*nlines);
+  while(nleft>0 && played) { // a pass over the lines left
+    played = FALSE;
+    for(i=0, n=0; i<nleft; ++i) {
+      if(left[i]>=0 && left[i]<LINE_INDEX_COUNT && line_fromIndex(left[i], &line)
+         && game_isPlayableLine(game, line)) {
+        game_consumeLine(game, line);
+        played = TRUE;
+      }
+      else
+        left[n++] = left[i];
+    }
+    nleft = n;
+  }
+  free(left);
+  return nleft>0;
+}
+
+/**
+ * Read a save file and check its canonical form
+ */
+static void canon_readFile(CanonFile* file) {
+  Game *game = game_init(), *check;
+  int lines[LINE_INDEX_COUNT], n;
+  struct stat st;
+  file->lines = NULL;
+  file->nlines = 0;
+  file->bytes = stat(file->path, &st)==0 ? st.st_size : 0;
+  if(ie_importGame(file->path, game)==0) {
+    n = canon_getForm(game, lines, NULL);
+    check = game_init();
+    // the lines of a save file are played without a check: they must be a legal game
+    if(canon_rebuild(lines, n, check)==0 && game_getScore(check)==game_getScore(game)) {
+      file->lines = malloc(sizeof(int)*MAX(n, 1));
+      memcpy(file->lines, lines, sizeof(int)*n);
+      file->nlines = n;
+    }
+    game_close(check);
+    free(game_getNickname(game));
+  }
+  game_close(game);
+}
+
+static void* canon_worker(void* arg) {
+  CanonShared* shared = arg;
+  int i;
+  for(;;) {
+    pthread_mutex_lock(&shared->lock);
+    i = shared->next++;
+    pthread_mutex_unlock(&shared->lock);
+    if(i>=shared->nfiles)
+      break;
+    canon_readFile(&shared->files[i]);
+  }
+  return NULL;
+}
+
+/**
+ * List the save files of a directory
+ * @param nfiles: will be setted by the number of files
+ * @return the files, NULL if the directory can't be read
+ */
+static CanonFile* canon_listFiles(const char* directory, int* nfiles) {
+  DIR* dir = opendir(directory);
+  struct dirent* entry;
+  CanonFile* files = NULL;
+  int length, capacity = 0;
+  const char* separator = directory[0] && directory[strlen(directory)-1]=='/' ? "" : "/";
+  *nfiles = 0;
+  if(dir==NULL)
+    return NULL;
+  while((entry = readdir(dir))!=NULL) {
+    length = strlen(entry->d_name);
+    if(length<=strlen(CANON_EXTENSION) || strcmp(entry->d_name+length-strlen(CANON_EXTENSION), CANON_EXTENSION)!=0)
+      continue;
+    if(*nfiles==capacity) {
+      capacity = MAX(2*capacity, 64);
+      files = realloc(files, sizeof(CanonFile)*capacity);
+    }
+    files[*nfiles].path = malloc(strlen(directory)+strlen(separator)+length+1);
+    sprintf(files[*nfiles].path, "%s%s%s", directory, separator, entry->d_name);
+    ++ *nfiles;
+  }
+  closedir(dir);
+  return files ? files : malloc(sizeof(CanonFile));
+}
+
+static int canon_comparePaths(const void* a, const void* b) {
+  return strcmp(((CanonFile*)a)->path, ((CanonFile*)b)->path);
+}
+
+/**
+ * Order the files by canonical form, then by path (invalid files last)
+ */
+static int canon_compareFiles(const void* a, const void* b) {
+  const CanonFile *x = *(CanonFile**)a, *y = *(CanonFile**)b;
+  int c;
+  if(!x->lines || !y->lines)
+    return (x->lines==NULL) - (y->lines==NULL);
+  c = canon_compare(x->lines, x->nlines, y->lines, y->nlines);
+  return c ? c : strcmp(x->path, y->path);
+}
+
+extern int canon_dedup(const char* directory, int threads, int removeDuplicates, CanonDedupResult* result) {
+  CanonShared shared;
+  CanonFile **order, *kept = NULL;
+  pthread_t* tids;
+  int i;
+  double start = util_getTime();
+
+  memset(result, 0, sizeof(CanonDedupResult));
+  if((shared.files = canon_listFiles(directory, &shared.nfiles))==NULL)
+    return 1;
+  qsort(shared.files, shared.nfiles, sizeof(CanonFile), canon_comparePaths);
+  threads = MAX(MIN(threads, shared.nfiles), 1);
+  pthread_mutex_init(&shared.lock, NULL);
+  shared.next = 0;
+  tids = malloc(sizeof(pthread_t)*threads);
+  for(i=0; i<threads; ++i)
+    pthread_create(&tids[i], NULL, canon_worker, &shared);
+  for(i=0; i<threads; ++i)
+    pthread_join(tids[i], NULL);
+
+  // equal forms are next to each other, the first path of a game first
+  order = malloc(sizeof(CanonFile*)*MAX(shared.nfiles, 1));
+  for(i=0; i<shared.nfiles; ++i)
+    order[i] = &shared.files[i];
+  qsort(order, shared.nfiles, sizeof(CanonFile*), canon_compareFiles);
+  result->files = shared.nfiles;
+  for(i=0; i<shared.nfiles; ++i) {
+    result->bytes += order[i]->bytes;
+    if(order[i]->lines==NULL) {
+      printf("%s: invalid game\n", order[i]->path);
+      ++ result->invalid;
+    }
+    else if(kept && canon_compare(kept->lines, kept->nlines, order[i]->lines, order[i]->nlines)==0) {
+      printf("%s: same game as %s\n", order[i]->path, kept->path);
+      result->duplicateBytes += order[i]->bytes;
+      ++ result->duplicates;
+      if(removeDuplicates && remove(order[i]->path)!=0)
+        fprintf(stderr, "Unable to remove %s.\n", order[i]->path);
+    }
+    else {
+      kept = order[i];
+      ++ result->games;
+    }
+  }
+  result->seconds = util_getTime() - start;
+
+  for(i=0; i<shared.nfiles; ++i) {
+    free(shared.files[i].path);
+    free(shared.files[i].lines);
+  }
+  free(shared.files);
+  free(order);
+  free(tids);
+  pthread_mutex_destroy(&shared.lock);
+  return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef _CANON_H
+#define _CANON_H
+/**
+ * Canon module
+ *
+ * The canonical form of a game: the set of its lines, whatever the order they were played in.
+ * A line adds the one case of its 5 which isn't occupied yet, or none: the cases added are those
+ * of the lines outside of the start cross, so the score only depends on the set too.
+ * The form is the sorted line indices ( @see line_getIndex ) of the game transformed by the
+ * symmetry giving the smallest sequence, so rotated or reflected games share it.
+ * A form is checked by rebuilding a legal order: any line of the set which is playable is played,
+ * until none is left. Occupied cases only grow and the lines of a legal game never share a
+ * segment, so this finds an order whenever one exists.
+ * An archive of saved games is deduplicated by comparing their forms ( @see canon_dedup ).
+ */
+
+#include "game.h"
+
+/**
+ * Archive deduplication results
+ */
+typedef struct _CanonDedupResult {
+  int files; // save files read
+  int games; // distinct games
+  int duplicates; // files holding the same game as another one
+  int invalid; // files which can't be read, or whose lines can't be played in any order
+  long long bytes; // size of the save files
+  long long duplicateBytes; // size of the duplicate files
+  double seconds;
+} CanonDedupResult;
+
+/**
+ * Get the canonical form of a game
+ * @param lines: will be setted by the sorted line indices (game_getLinesCount(game) of them)
+ * @param symmetry: will be setted by the symmetry applied to the game ( @see line_transform ), can be NULL
+ * @return the number of lines
+ */
+extern int canon_getForm(Game* game, int* lines, int* symmetry);
+
+/**
+ * Compare two canonical forms (by number of lines, then line indices)
+ * @return <0, 0 or >0 as for strcmp
+ */
+extern int canon_compare(const int* a, int na, const int* b, int nb);
+
+/**
+ * Play a set of lines in a legal order
+ * @param lines, nlines: the line indices, in any order
+ * @param game: a new game ( @see game_init ), the lines are played into it
+ * @return 0 if every line was played, 1 if the set isn't a legal game
+ */
+extern int canon_rebuild(const int* lines, int nlines, Game* game);
+
+/**
+ * Find the save files of a directory holding the same game (up to the order and a symmetry)
+ * Files are read and checked in parallel, the first file of a game in name order is kept.
+ * @param directory: the directory of the .sav files
+ * @param threads: the number of threads
+ * @param removeDuplicates: TRUE to remove the duplicate files
+ * @param result: will be setted by the results
+ * @return 0 if success, 1 if the directory can't be read
+ */
+extern int canon_dedup(const char* directory, int threads, int removeDuplicates, CanonDedupResult* result);
+
+#endif
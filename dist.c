@@ -0,0 +1,598 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dist.h"
+
+#ifdef _WIN32
+
+extern int dist_coordinate(const char* address, Game* game, SearchAlgorithm algorithm, int level, int units,
+                           int budget, unsigned long long seed, const char* savepath, DistResult* result) {
+  fprintf(stderr, "The distributed search is not available on this platform.\n");
+  return 1;
+}
+
+extern int dist_work(const char* address, int threads) {
+  fprintf(stderr, "The distributed search is not available on this platform.\n");
+  return 1;
+}
+
+#else
+
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "export.h"
+#include "game.h"
+#include "globals.h"
+#include "points.h"
+#include "utils.h"
+
+#define DIST_MAX_WORKERS 64
+#define DIST_MESSAGE_MAX 65536 // bytes, larger than any message
+#define DIST_HEADER_SIZE 5
+#define DIST_CONNECT_RETRIES 50 // a worker may start before its coordinator
+#define DIST_CONNECT_DELAY 100000 // us between two connection attempts
+
+typedef enum {
+  DIST_PULL=1,
+  DIST_UNIT,
+  DIST_RESULT,
+  DIST_STOP
+} DistMessageType;
+
+/**
+ * A message being written or read
+ */
+typedef struct _DistMessage {
+  unsigned char data[DIST_MESSAGE_MAX];
+  int length; // written bytes
+  int position; // read bytes
+  int error; // true if a read went past the end
+} DistMessage;
+
+typedef struct _DistConnection {
+  int fd;
+  int id;
+  int unit; // unit held, -1 if none
+  int waiting; // asked for work when none was available
+  DistMessage input;
+} DistConnection;
+
+/**
+ * A unit: the search of a position by a worker
+ */
+typedef struct _DistUnit {
+  SearchAlgorithm algorithm;
+  int level;
+  unsigned long long seed;
+  int budget; // ms
+  int nmoves;
+  int moves[LINE_INDEX_COUNT]; // start position, then continuation in a result
+  SearchPolicy policy;
+} DistUnit;
+
+static volatile sig_atomic_t dist_stopRequested = 0;
+
+static void dist_onSignal(int sig) {
+  dist_stopRequested = 1;
+}
+
+/**
+ * Make the line of a received line index
+ * @return true if the index is the index of a grid line
+ */
+static int dist_toLine(int move, Line* line) {
+  return move>=0 && move<LINE_INDEX_COUNT && line_fromIndex(move, line)==LINE_LENGTH && line_isValid(*line);
+}
+
+/// Encoding
+
+static void dist_begin(DistMessage* m, DistMessageType type) {
+  m->length = DIST_HEADER_SIZE;
+  m->data[4] = type;
+}
+
+static void dist_put(DistMessage* m, unsigned long long value, int bytes) {
+  int i;
+  for(i=0; i<bytes; ++i)
+    m->data[m->length++] = (value >> (8*i)) & 0xFF;
+}
+
+static unsigned long long dist_get(DistMessage* m, int bytes) {
+  unsigned long long value = 0;
+  int i;
+  if(m->position+bytes>m->length) {
+    m->error = TRUE;
+    return 0;
+  }
+  for(i=0; i<bytes; ++i)
+    value |= (unsigned long long)m->data[m->position++] << (8*i);
+  return value;
+}
+
+static void dist_putPolicy(DistMessage* m, SearchPolicy* policy) {
+  int i, count = m->length, n = 0;
+  unsigned int bits;
+  dist_put(m, 0, 2);
+  for(i=0; policy && i<LINE_INDEX_COUNT; ++i) {
+    if(policy->weights[i]!=0) {
+      memcpy(&bits, &policy->weights[i], sizeof(bits));
+      dist_put(m, i, 2);
+      dist_put(m, bits, 4);
+      ++ n;
+    }
+  }
+  m->data[count] = n & 0xFF;
+  m->data[count+1] = n >> 8;
+}
+
+static void dist_getPolicy(DistMessage* m, SearchPolicy* policy) {
+  int i, line, n = dist_get(m, 2);
+  unsigned int bits;
+  memset(policy, 0, sizeof(SearchPolicy));
+  for(i=0; i<n && !m->error; ++i) {
+    line = dist_get(m, 2);
+    bits = dist_get(m, 4);
+    if(line<LINE_INDEX_COUNT)
+      memcpy(&policy->weights[line], &bits, sizeof(bits));
+    else
+      m->error = TRUE;
+  }
+}
+
+static void dist_putMoves(DistMessage* m, int* moves, int n) {
+  int i;
+  dist_put(m, n, 2);
+  for(i=0; i<n; ++i)
+    dist_put(m, moves[i], 2);
+}
+
+static int dist_getMoves(DistMessage* m, int* moves) {
+  int i, n = dist_get(m, 2);
+  if(n>LINE_INDEX_COUNT) {
+    m->error = TRUE;
+    return 0;
+  }
+  for(i=0; i<n; ++i)
+    moves[i] = dist_get(m, 2);
+  return n;
+}
+
+/// Transport
+
+static int dist_write(int fd, DistMessage* m) {
+  int n, length = m->length, done = 0;
+  unsigned int payload = m->length - DIST_HEADER_SIZE;
+  m->data[0] = payload & 0xFF;
+  m->data[1] = (payload >> 8) & 0xFF;
+  m->data[2] = (payload >> 16) & 0xFF;
+  m->data[3] = payload >> 24;
+  while(done<length) {
+    n = write(fd, m->data+done, length-done);
+    if(n<0 && errno==EINTR)
+      continue;
+    if(n<=0)
+      return 1;
+    done += n;
+  }
+  return 0;
+}
+
+static void dist_send(int fd, DistMessageType type) {
+  DistMessage* m = malloc(sizeof(DistMessage));
+  dist_begin(m, type);
+  dist_write(fd, m);
+  free(m);
+}
+
+/**
+ * Check if a whole message was received
+ * @return the message size (header included), 0 if incomplete, -1 if invalid
+ */
+static int dist_getReceivedSize(DistMessage* m) {
+  unsigned int payload;
+  if(m->length<DIST_HEADER_SIZE)
+    return 0;
+  payload = m->data[0] | m->data[1]<<8 | m->data[2]<<16 | (unsigned)m->data[3]<<24;
+  if(payload>DIST_MESSAGE_MAX-DIST_HEADER_SIZE)
+    return -1;
+  return m->length>=(int)(DIST_HEADER_SIZE+payload) ? (int)(DIST_HEADER_SIZE+payload) : 0;
+}
+
+/**
+ * Read a whole message (blocking)
+ * @return the message type, or 0 if the connection is lost
+ */
+static int dist_read(int fd, DistMessage* m) {
+  int n, size;
+  m->length = 0;
+  while((size = dist_getReceivedSize(m))==0) {
+    n = read(fd, m->data+m->length, (m->length<DIST_HEADER_SIZE ? DIST_HEADER_SIZE : DIST_MESSAGE_MAX) - m->length);
+    if(n<0 && errno==EINTR)
+      continue;
+    if(n<=0)
+      return 0;
+    m->length += n;
+  }
+  if(size<0)
+    return 0;
+  m->position = DIST_HEADER_SIZE;
+  m->error = FALSE;
+  return m->data[4];
+}
+
+/**
+ * Open a socket on an address ("host:port", ":port" or "unix:path")
+ * @param server: true to listen on the address, false to connect to it
+ * @return the socket, or -1 if error
+ */
+static int dist_open(const char* address, int server) {
+  struct sockaddr_un addr;
+  struct addrinfo hints, *infos, *info;
+  char host[256];
+  const char* port = strrchr(address, ':');
+  int fd = -1, yes = 1;
+  if(strncmp(address, "unix:", 5)==0) {
+    if(strlen(address+5)>=sizeof(addr.sun_path))
+      return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, address+5);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(server)
+      unlink(addr.sun_path);
+    if(fd>=0 && (server ? bind(fd, (struct sockaddr*)&addr, sizeof(addr))!=0 || listen(fd, SOMAXCONN)!=0
+                        : connect(fd, (struct sockaddr*)&addr, sizeof(addr))!=0)) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+  if(port==NULL || port-address>=(int)sizeof(host))
+    return -1;
+  memcpy(host, address, port-address);
+  host[port-address] = 0;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = server ? AI_PASSIVE : 0;
+  if(getaddrinfo(host[0] ? host : NULL, port+1, &hints, &infos)!=0)
+    return -1;
+  for(info = infos; info; info = info->ai_next) {
+    fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    if(fd<0)
+      continue;
+    if(server)
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    if(server ? bind(fd, info->ai_addr, info->ai_addrlen)==0 && listen(fd, SOMAXCONN)==0
+              : connect(fd, info->ai_addr, info->ai_addrlen)==0)
+      break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(infos);
+  return fd;
+}
+
+/// Coordinator
+
+typedef struct _DistCoordinator {
+  Game* root;
+  Game* check; // replays the results
+  DistUnit* unit; // message scratch
+  SearchAlgorithm algorithm;
+  int level;
+  int units;
+  int budget;
+  unsigned long long seed;
+  const char* savepath;
+  int* pending; // units to hand again
+  int npending;
+  int next; // next new unit
+  int completed;
+  int bestScore;
+  int* best; // continuation of the best game
+  int nbest;
+  SearchPolicy* bestPolicy;
+  DistMessage* output;
+  DistResult* result;
+} DistCoordinator;
+
+static void dist_sendUnit(DistCoordinator* c, DistConnection* conn, int unit) {
+  DistMessage* m = c->output;
+  Line* lines;
+  int i, n;
+  conn->unit = unit;
+  conn->waiting = FALSE;
+  dist_begin(m, DIST_UNIT);
+  dist_put(m, unit, 4);
+  dist_put(m, c->algorithm, 1);
+  dist_put(m, c->level, 2);
+  dist_put(m, util_randomStream(c->seed, unit), 8);
+  dist_put(m, c->budget, 4);
+  lines = game_getLines(c->root, &n);
+  dist_put(m, n, 2);
+  for(i=0; i<n; ++i)
+    dist_put(m, line_getIndex(lines[i]), 2);
+  dist_putPolicy(m, c->algorithm==SEARCH_NRPA && c->nbest>0 ? c->bestPolicy : NULL);
+  dist_write(conn->fd, m);
+}
+
+/**
+ * Answer a worker asking for work
+ */
+static void dist_serve(DistCoordinator* c, DistConnection* conn) {
+  if(c->npending>0)
+    dist_sendUnit(c, conn, c->pending[--c->npending]);
+  else if(c->next<c->units)
+    dist_sendUnit(c, conn, c->next++);
+  else if(c->completed<c->units)
+    conn->waiting = TRUE; // a unit may come back from a lost worker
+  else
+    dist_send(conn->fd, DIST_STOP);
+}
+
+static void dist_saveBest(DistCoordinator* c) {
+  Game* game;
+  Line line;
+  int i;
+  if(c->savepath==NULL)
+    return;
+  game = game_clone(c->root);
+  for(i=0; i<c->nbest; ++i) {
+    line_fromIndex(c->best[i], &line);
+    game_consumeLine(game, line);
+  }
+  game_setFilepath(game, (char*)c->savepath);
+  if(ie_exportGame(game)!=0)
+    fprintf(stderr, "Unable to save the best game into %s.\n", c->savepath);
+  game_close(game);
+}
+
+/**
+ * Take the result of a unit: replay its continuation and keep it if it is the best
+ */
+static void dist_onResult(DistCoordinator* c, DistConnection* conn, DistMessage* m) {
+  DistUnit* u = c->unit;
+  Line line;
+  int i, unit = dist_get(m, 4);
+  dist_get(m, 4); // the score is computed again from the lines
+  u->nmoves = dist_getMoves(m, u->moves);
+  dist_getPolicy(m, &u->policy);
+  if(m->error || unit!=conn->unit) { // the unit held is handed again, as if the worker was lost
+    if(conn->unit>=0) {
+      c->pending[c->npending++] = conn->unit;
+      ++ c->result->reassigned;
+      fprintf(stderr, "worker %d sent an invalid result, unit %d will be handed again\n", conn->id, conn->unit);
+      conn->unit = -1;
+    }
+    return;
+  }
+  conn->unit = -1;
+  ++ c->completed;
+  game_copy(c->check, c->root);
+  for(i=0; i<u->nmoves; ++i) {
+    if(!dist_toLine(u->moves[i], &line) || !game_isPlayableLine(c->check, line)) {
+      fprintf(stderr, "unit %d: worker %d sent an illegal line, result ignored\n", unit, conn->id);
+      return;
+    }
+    game_consumeLine(c->check, line);
+  }
+  if(game_getScore(c->check)>c->bestScore) {
+    c->bestScore = game_getScore(c->check);
+    c->nbest = u->nmoves;
+    memcpy(c->best, u->moves, sizeof(int)*u->nmoves);
+    *c->bestPolicy = u->policy;
+    printf("unit %d (worker %d): new best score %d, %d lines\n", unit, conn->id, c->bestScore,
+           game_getLinesCount(c->check));
+    fflush(stdout);
+    dist_saveBest(c);
+  }
+}
+
+static void dist_onLost(DistCoordinator* c, DistConnection* conn) {
+  if(conn->unit>=0) {
+    c->pending[c->npending++] = conn->unit;
+    ++ c->result->reassigned;
+    fprintf(stderr, "worker %d lost, unit %d will be handed again\n", conn->id, conn->unit);
+  }
+  close(conn->fd);
+  conn->fd = -1;
+}
+
+extern int dist_coordinate(const char* address, Game* game, SearchAlgorithm algorithm, int level, int units,
+                           int budget, unsigned long long seed, const char* savepath, DistResult* result) {
+  DistCoordinator c;
+  DistConnection* conns;
+  struct pollfd fds[DIST_MAX_WORKERS+1];
+  struct sigaction action;
+  DistMessage* m;
+  Line line;
+  int i, j, n, size, fd, nconns = 0, listener = dist_open(address, TRUE);
+  double start = util_getTime();
+  if(listener<0)
+    return 1;
+
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = dist_onSignal;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN); // a worker may die while it is written to
+
+  memset(result, 0, sizeof(DistResult));
+  c.root = game;
+  c.check = game_clone(game);
+  c.unit = malloc(sizeof(DistUnit));
+  c.algorithm = algorithm;
+  c.level = level;
+  c.units = MAX(units, 1);
+  c.budget = MAX(budget, 0);
+  c.seed = seed;
+  c.savepath = savepath;
+  c.pending = malloc(sizeof(int)*c.units);
+  c.npending = 0;
+  c.next = 0;
+  c.completed = 0;
+  c.bestScore = -1;
+  c.best = malloc(sizeof(int)*LINE_INDEX_COUNT);
+  c.nbest = 0;
+  c.bestPolicy = calloc(1, sizeof(SearchPolicy));
+  c.output = malloc(sizeof(DistMessage));
+  c.result = result;
+  conns = malloc(sizeof(DistConnection)*DIST_MAX_WORKERS);
+
+  while(!dist_stopRequested && c.completed<c.units) {
+    fds[0].fd = listener;
+    fds[0].events = POLLIN;
+    for(i=0; i<nconns; ++i) {
+      fds[i+1].fd = conns[i].fd;
+      fds[i+1].events = POLLIN;
+    }
+    if(poll(fds, nconns+1, -1)<0)
+      continue; // interrupted by a signal
+    for(i=0; i<nconns; ++i) {
+      if(!(fds[i+1].revents & (POLLIN|POLLHUP|POLLERR)))
+        continue;
+      m = &conns[i].input;
+      n = read(conns[i].fd, m->data+m->length, DIST_MESSAGE_MAX-m->length);
+      if(n<=0) {
+        if(n<0 && errno==EINTR)
+          continue;
+        dist_onLost(&c, &conns[i]);
+        continue;
+      }
+      m->length += n;
+      while((size = dist_getReceivedSize(m))>0) {
+        m->position = DIST_HEADER_SIZE;
+        m->error = FALSE;
+        if(m->data[4]==DIST_PULL)
+          dist_serve(&c, &conns[i]);
+        else if(m->data[4]==DIST_RESULT) { // a result also asks for the next unit
+          dist_onResult(&c, &conns[i], m);
+          if(c.completed<c.units)
+            dist_serve(&c, &conns[i]);
+        }
+        memmove(m->data, m->data+size, m->length-size);
+        m->length -= size;
+      }
+      if(size<0)
+        dist_onLost(&c, &conns[i]);
+    }
+    // forget lost workers, then hand the units they held to waiting ones
+    for(i=0, j=0; i<nconns; ++i)
+      if(conns[i].fd>=0)
+        conns[j++] = conns[i];
+    nconns = j;
+    for(i=0; i<nconns; ++i)
+      if(conns[i].waiting && (c.npending>0 || c.completed>=c.units))
+        dist_serve(&c, &conns[i]);
+    if(fds[0].revents & POLLIN) {
+      fd = accept(listener, NULL, NULL);
+      if(fd>=0 && nconns==DIST_MAX_WORKERS)
+        close(fd);
+      else if(fd>=0) {
+        conns[nconns].fd = fd;
+        conns[nconns].id = ++result->workers;
+        conns[nconns].unit = -1;
+        conns[nconns].waiting = FALSE;
+        conns[nconns].input.length = 0;
+        ++ nconns;
+      }
+    }
+  }
+
+  for(i=0; i<nconns; ++i) {
+    dist_send(conns[i].fd, DIST_STOP);
+    close(conns[i].fd);
+  }
+  close(listener);
+  if(strncmp(address, "unix:", 5)==0)
+    unlink(address+5);
+  for(i=0; i<c.nbest; ++i) {
+    line_fromIndex(c.best[i], &line);
+    game_consumeLine(game, line);
+  }
+  result->score = game_getScore(game);
+  result->units = c.completed;
+  result->seconds = util_getTime() - start;
+  game_close(c.check);
+  free(c.unit);
+  free(c.pending);
+  free(c.best);
+  free(c.bestPolicy);
+  free(c.output);
+  free(conns);
+  dist_stopRequested = 0;
+  return 0;
+}
+
+/// Worker
+
+/**
+ * Search a unit received from the coordinator and write the result message
+ * @return 0 if success, 1 if the unit is invalid
+ */
+static int dist_searchUnit(DistMessage* m, DistUnit* u, int threads) {
+  Game* game = game_init();
+  Line line, *lines;
+  int i, n, start, unit = dist_get(m, 4);
+  u->algorithm = dist_get(m, 1);
+  u->level = dist_get(m, 2);
+  u->seed = dist_get(m, 8);
+  u->budget = dist_get(m, 4);
+  u->nmoves = dist_getMoves(m, u->moves);
+  dist_getPolicy(m, &u->policy);
+  for(i=0; i<u->nmoves && !m->error; ++i) {
+    if(!dist_toLine(u->moves[i], &line) || !game_isPlayableLine(game, line))
+      m->error = TRUE;
+    else
+      game_consumeLine(game, line);
+  }
+  if(m->error || u->algorithm>SEARCH_MCTS) {
+    game_close(game);
+    return 1;
+  }
+  start = game_getLinesCount(game);
+  search_run(game, u->algorithm, u->level, &u->policy, threads, u->budget>0 ? 0 : 1, u->budget/1000.0, u->seed);
+
+  lines = game_getLines(game, &n);
+  for(i=start; i<n; ++i)
+    u->moves[i-start] = line_getIndex(lines[i]);
+  dist_begin(m, DIST_RESULT);
+  dist_put(m, unit, 4);
+  dist_put(m, game_getScore(game), 4);
+  dist_putMoves(m, u->moves, n-start);
+  dist_putPolicy(m, u->algorithm==SEARCH_NRPA ? &u->policy : NULL);
+  game_close(game);
+  return 0;
+}
+
+extern int dist_work(const char* address, int threads) {
+  DistMessage* m;
+  DistUnit* u;
+  int type, retries = DIST_CONNECT_RETRIES, fd;
+  while((fd = dist_open(address, FALSE))<0 && --retries>0)
+    usleep(DIST_CONNECT_DELAY);
+  if(fd<0)
+    return 1;
+  signal(SIGPIPE, SIG_IGN);
+  m = malloc(sizeof(DistMessage));
+  u = malloc(sizeof(DistUnit));
+  dist_begin(m, DIST_PULL);
+  type = dist_write(fd, m)==0 ? dist_read(fd, m) : 0;
+  while(type==DIST_UNIT && dist_searchUnit(m, u, threads)==0 && dist_write(fd, m)==0)
+    type = dist_read(fd, m);
+  close(fd);
+  free(m);
+  free(u);
+  return type==DIST_STOP ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef _DIST_H
+#define _DIST_H
+/**
+ * Distributed search module
+ *
+ * A coordinator splits a search into work units and hands them to worker processes
+ * over TCP ("host:port") or Unix domain sockets ("unix:path").
+ * Workers share nothing: a unit holds the start position, the search parameters and, for NRPA,
+ * the policy to start from. A worker pulls a unit, searches it with search_run ( @see search.h )
+ * and pushes back the best sequence found and its adapted policy. The coordinator checks
+ * the sequence, keeps the best game and sends the policy of the best unit with the next units.
+ * A unit held by a worker which disconnects (or dies) is handed to the next worker asking for work.
+ *
+ * Messages are [u32 payload length][u8 type][payload], integers in little endian:
+ *   PULL    worker -> coordinator, no payload: asks for the first unit (a result asks for the next one)
+ *   UNIT    coordinator -> worker: u32 unit, u8 algorithm, u16 level, u64 seed, u32 budget (ms),
+ *           u16 n, n x u16 start position lines, u16 m, m x (u16 line, u32 float weight)
+ *   RESULT  worker -> coordinator: u32 unit, u32 score, u16 n, n x u16 continuation lines,
+ *           u16 m, m x (u16 line, u32 float weight)
+ *   STOP    coordinator -> worker, no payload: the search is over
+ * Lines are line indices ( @see line_getIndex ), policies only hold non-zero weights.
+ */
+
+#include "game.h"
+#include "search.h"
+
+/**
+ * Distributed search results
+ */
+typedef struct _DistResult {
+  int score; // best final score found
+  int units; // units completed
+  int reassigned; // units handed again after a worker loss
+  int workers; // workers connected during the search
+  double seconds;
+} DistResult;
+
+/**
+ * Coordinate a distributed search until all units are completed (or SIGINT / SIGTERM)
+ * @param address: the address to listen on ("host:port", ":port" or "unix:path")
+ * @param game: the start position, the best game found is played into it
+ * @param algorithm, level: the search of each unit ( @see search_run )
+ * @param units: the number of work units
+ * @param budget: the time budget of a unit (ms), 0 to run a single search iteration
+ * @param seed: the random seed (each unit gets its own random streams)
+ * @param savepath: the file the best game is exported to at each improvement (NULL to not save it)
+ * @param result: will be setted by the search results
+ * @return 0 if success, 1 if the address can't be listened on
+ */
+extern int dist_coordinate(const char* address, Game* game, SearchAlgorithm algorithm, int level, int units,
+                           int budget, unsigned long long seed, const char* savepath, DistResult* result);
+
+/**
+ * Work for a coordinator until it stops the search
+ * @param address: the coordinator address ( @see dist_coordinate )
+ * @param threads: the number of search threads
+ * @return 0 if success, 1 if the coordinator can't be reached or the connection is lost
+ */
+extern int dist_work(const char* address, int threads);
+
+#endif
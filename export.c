@@ -1,5 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <pthread.h>
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -8,10 +11,27 @@
 #include "export.h"
 #include "game.h"
 #include "globals.h"
+#include "profile.h"
 
 #define SAVE_DIR "saved/"
 #define SAVE_FILE_EXTENSION "sav"
+#define SAVE_SLOT_MAX 99
+#define SAVE_INDEX SAVE_DIR "index.bin"
+#define SAVE_INDEX_TMP SAVE_DIR "index.bin.tmp"
+#define SAVE_INDEX_MAGIC "MORPSAVE"
+#define SAVE_INDEX_VERSION 1
 
+/**
+ * The save index file header, followed by the entries sorted by nickname and slot
+ */
+typedef struct _SaveIndexHeader {
+  char magic[8];
+  unsigned int version;
+  int count;
+  long long dirMtime; // of the save directory once the index is written (ns), -1 while writing
+} SaveIndexHeader;
+
+static pthread_mutex_t ieIndexLock = PTHREAD_MUTEX_INITIALIZER; // the saver thread exports too
 
 static char* ie_guessNicknameFromFilepath(char* filepath) {
   int start, end, len;
@@ -25,34 +45,268 @@ static char* ie_guessNicknameFromFilepath(char* filepath) {
   return nickname;
 }
 
+/**
+ * Get the modification time of a file
+ * @return the time (ns), -1 if the file doesn't exist
+ */
+static long long ie_getMtime(const char* path) {
+  struct stat st;
+  if(stat(path, &st)!=0)
+    return -1;
+#if defined(_WIN32)
+  return st.st_mtime * 1000000000LL;
+#elif defined(__APPLE__)
+  return st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+  return st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+}
+
+/**
+ * Read the nickname and slot of a save file path ({SAVE_DIR}{nickname}.{slot}.{SAVE_FILE_EXTENSION})
+ * @param entry: will be setted by the nickname and slot
+ * @return 0 if success, 1 if the path isn't a save slot
+ */
+static int ie_parseSavePath(const char* filepath, SaveEntry* entry) {
+  const char* name = filepath + strlen(SAVE_DIR);
+  int length;
+  if(strncmp(filepath, SAVE_DIR, strlen(SAVE_DIR))!=0 || strchr(name, '/'))
+    return 1;
+  length = (int)strlen(name) - (int)strlen("." SAVE_FILE_EXTENSION) - 3; // before ".{slot}"
+  if(length<1 || length>NICKNAME_LENGTH || name[length]!='.' || !isdigit((unsigned char)name[length+1])
+     || !isdigit((unsigned char)name[length+2]) || strcmp(name+length+3, "." SAVE_FILE_EXTENSION)!=0)
+    return 1;
+  memset(entry, 0, sizeof(SaveEntry)); // written as is into the index
+  memcpy(entry->nickname, name, length);
+  entry->nickname[length] = 0;
+  entry->slot = (name[length+1]-'0')*10 + name[length+2]-'0';
+  return entry->slot<1;
+}
+
+static int ie_compareEntries(const void* a, const void* b) {
+  const SaveEntry *x = a, *y = b;
+  int c = strcmp(x->nickname, y->nickname);
+  return c ? c : x->slot - y->slot;
+}
+
+/**
+ * Read the save index
+ * @param count: will be setted by the number of entries
+ * @param dirMtime: the time of the save directory the index must be stamped with, -1 for any stamp
+ * @return the entries, NULL if the index is missing, invalid or stale (the save directory changed since)
+ */
+static SaveEntry* ie_readIndex(int* count, long long dirMtime) {
+  SaveIndexHeader header;
+  SaveEntry* entries;
+  FILE* file = fopen(SAVE_INDEX, "rb");
+  if(file==NULL)
+    return NULL;
+  if(fread(&header, sizeof(SaveIndexHeader), 1, file)!=1 || memcmp(header.magic, SAVE_INDEX_MAGIC, 8)!=0
+     || header.version!=SAVE_INDEX_VERSION || header.count<0 || header.dirMtime<0
+     || (dirMtime>=0 && header.dirMtime!=dirMtime)) {
+    fclose(file);
+    return NULL;
+  }
+  entries = malloc(sizeof(SaveEntry)*MAX(header.count, 1));
+  if(fread(entries, sizeof(SaveEntry), header.count, file)!=(size_t)header.count) {
+    free(entries);
+    entries = NULL;
+  }
+  fclose(file);
+  *count = header.count;
+  return entries;
+}
+
+/**
+ * Write the save index: a new file replaces the index at once, then it is stamped with the directory time
+ * @return 0 if success, 1 if error
+ */
+static int ie_writeIndex(SaveEntry* entries, int count) {
+  SaveIndexHeader header;
+  FILE* file = fopen(SAVE_INDEX_TMP, "wb");
+  int ok;
+  if(file==NULL)
+    return 1;
+  memcpy(header.magic, SAVE_INDEX_MAGIC, 8);
+  header.version = SAVE_INDEX_VERSION;
+  header.count = count;
+  header.dirMtime = -1; // stale until stamped
+  ok = fwrite(&header, sizeof(SaveIndexHeader), 1, file)==1
+       && fwrite(entries, sizeof(SaveEntry), count, file)==(size_t)count;
+  if(fclose(file)!=0 || !ok) {
+    remove(SAVE_INDEX_TMP);
+    return 1;
+  }
+#ifdef _WIN32
+  remove(SAVE_INDEX); // rename doesn't replace a file
+#endif
+  if(rename(SAVE_INDEX_TMP, SAVE_INDEX)!=0)
+    return 1;
+  // a save file added or removed from now on changes the directory time, and the index gets rebuilt
+  header.dirMtime = ie_getMtime(SAVE_DIR);
+  if((file = fopen(SAVE_INDEX, "r+b"))==NULL)
+    return 1;
+  ok = fwrite(&header, sizeof(SaveIndexHeader), 1, file)==1;
+  return (fclose(file)!=0 || !ok);
+}
+
+/**
+ * Rebuild the save index from the save files
+ * @param count: will be setted by the number of entries
+ * @return the entries
+ */
+static SaveEntry* ie_rebuildIndex(int* count) {
+  DIR* dir = opendir(SAVE_DIR);
+  struct dirent* entry;
+  SaveEntry* entries = malloc(sizeof(SaveEntry));
+  Game* game;
+  char path[FILENAME_BUFFER_SIZE];
+  int capacity = 1;
+  *count = 0;
+  while(dir && (entry = readdir(dir))!=NULL) {
+    if(*count==capacity)
+      entries = realloc(entries, sizeof(SaveEntry)*(capacity *= 2));
+    if(snprintf(path, FILENAME_BUFFER_SIZE, "%s%s", SAVE_DIR, entry->d_name)>=FILENAME_BUFFER_SIZE
+       || ie_parseSavePath(path, &entries[*count])!=0)
+      continue;
+    game = game_init();
+    if(ie_importGame(path, game)==0) {
+      entries[*count].lines = game_getLinesCount(game);
+      entries[*count].score = game_getScore(game);
+      entries[*count].mtime = ie_getMtime(path);
+      ++ *count;
+      free(game_getNickname(game));
+    }
+    game_close(game);
+  }
+  if(dir)
+    closedir(dir);
+  qsort(entries, *count, sizeof(SaveEntry), ie_compareEntries);
+  return entries;
+}
+
+/**
+ * Load the save index, rebuilt if it is missing or stale
+ * @param count: will be setted by the number of entries
+ * @return the entries
+ */
+static SaveEntry* ie_loadIndex(int* count) {
+  SaveEntry* entries = ie_readIndex(count, ie_getMtime(SAVE_DIR));
+  if(entries==NULL) {
+    entries = ie_rebuildIndex(count);
+    ie_writeIndex(entries, *count);
+  }
+  return entries;
+}
+
+/**
+ * Record or remove the entry of a save file in the save index
+ * The index is only changed if the directory didn't change since it was stamped, but for this
+ * file: else it is rebuilt.
+ * @param lines: the number of lines of the game, -1 to remove the entry
+ * @param dirMtime: the time of the save directory before the file was written or removed
+ */
+static void ie_updateIndex(const char* filepath, int lines, int score, long long dirMtime) {
+  SaveEntry key, *entries, *found;
+  int count;
+  if(ie_parseSavePath(filepath, &key)!=0)
+    return;
+  pthread_mutex_lock(&ieIndexLock);
+  // the file was created or removed (only this file changed the directory time), or written in place
+  entries = ie_readIndex(&count, dirMtime);
+  if(entries==NULL)
+    entries = ie_readIndex(&count, ie_getMtime(SAVE_DIR));
+  if(entries==NULL) {
+    entries = ie_rebuildIndex(&count);
+    ie_writeIndex(entries, count);
+    pthread_mutex_unlock(&ieIndexLock);
+    free(entries);
+    return;
+  }
+  found = bsearch(&key, entries, count, sizeof(SaveEntry), ie_compareEntries);
+  if(lines<0 && found) {
+    memmove(found, found+1, sizeof(SaveEntry)*(entries+count-found-1));
+    -- count;
+  }
+  else if(lines>=0) {
+    if(found==NULL) {
+      entries = realloc(entries, sizeof(SaveEntry)*(count+1));
+      found = &entries[count++];
+      *found = key;
+    }
+    found->lines = lines;
+    found->score = score;
+    found->mtime = ie_getMtime(filepath);
+    qsort(entries, count, sizeof(SaveEntry), ie_compareEntries);
+  }
+  ie_writeIndex(entries, count);
+  pthread_mutex_unlock(&ieIndexLock);
+  free(entries);
+}
+
 extern int ie_getAvailableFile(char* nickname, char* store) {
-  FILE* f;
-  int i;
+  SaveEntry key, *entries;
+  int i, count;
   char buf[FILENAME_BUFFER_SIZE];
-  struct stat st;
-  if(stat(SAVE_DIR, &st) != 0)
+  if(ie_getMtime(SAVE_DIR)<0) // create save directory if not exists
   {
-    //mkdir(SAVE_DIR, 0700); // create save directory if not exists
-    mkdir("save"); // create save directory if not exists
+#ifdef _WIN32
+    mkdir(SAVE_DIR);
+#else
+    mkdir(SAVE_DIR, 0700);
+#endif
   }
-  for(i=1; i<100; ++i) {
+  pthread_mutex_lock(&ieIndexLock);
+  entries = ie_loadIndex(&count);
+  pthread_mutex_unlock(&ieIndexLock);
+  snprintf(key.nickname, NICKNAME_LENGTH+1, "%s", nickname);
+  for(i=1; i<=SAVE_SLOT_MAX; ++i) {
+    key.slot = i;
+    if(strlen(nickname)<=NICKNAME_LENGTH && bsearch(&key, entries, count, sizeof(SaveEntry), ie_compareEntries))
+      continue;
     snprintf(buf, FILENAME_BUFFER_SIZE, "%s%s.%02d.%s", SAVE_DIR, nickname, i, SAVE_FILE_EXTENSION);
-    f = fopen(buf, "r");
-    if(f==NULL) { // file not exists
+    if(ie_getMtime(buf)<0) { // file not exists (a nickname too long for the index is checked on each slot)
       strcpy(store, buf);
+      free(entries);
       return 0;
     }
-    else
-      fclose(f);
   }
+  free(entries);
   return 1;
 }
 
+extern int ie_listGames(SaveEntry** entries) {
+  char path[FILENAME_BUFFER_SIZE];
+  int i, count;
+  pthread_mutex_lock(&ieIndexLock);
+  *entries = ie_loadIndex(&count);
+  for(i=0; i<count; ++i) { // a save file changed in place doesn't change the directory time
+    snprintf(path, FILENAME_BUFFER_SIZE, "%s%s.%02d.%s", SAVE_DIR, (*entries)[i].nickname, (*entries)[i].slot,
+             SAVE_FILE_EXTENSION);
+    if(ie_getMtime(path)!=(*entries)[i].mtime)
+      break;
+  }
+  if(i<count) {
+    free(*entries);
+    *entries = ie_rebuildIndex(&count);
+    ie_writeIndex(*entries, count);
+  }
+  pthread_mutex_unlock(&ieIndexLock);
+  return count;
+}
+
 extern int ie_exportGame(Game* game) {
-  FILE* file = fopen(game_getFilepath(game), "w");
+  int length;
+  Line* lines = game_getLines(game, &length);
+  return ie_exportLines(game_getFilepath(game), lines, length, game_getScore(game));
+}
+extern int ie_exportLines(char* filepath, Line* lines, int length, int score) {
+  PROFILE_SCOPE(PROFILE_EXPORT);
+  long long dirMtime = ie_getMtime(SAVE_DIR); // a new file changes it
+  FILE* file = fopen(filepath, "w");
   if(file==NULL) return 1;
-  int length, i, j;
-  Line line, *lines = game_getLines(game, &length);
+  int i, j;
+  Line line;
   for(i=0; i<length; ++i) {
     line = lines[i];
     for(j=0; j<LINE_LENGTH; ++j) {
@@ -63,6 +317,7 @@ extern int ie_exportGame(Game* game) {
     fprintf(file, "\n");
   }
   fclose(file);
+  ie_updateIndex(filepath, length, score, dirMtime);
   return 0;
 }
 extern int ie_importGame(char* filepath, Game* game) {
@@ -91,6 +346,10 @@ extern int ie_importGame(char* filepath, Game* game) {
   return 0;
 }
 extern int ie_removeGame(Game* game) {
-  return remove(game_getFilepath(game));
+  long long dirMtime = ie_getMtime(SAVE_DIR);
+  int ret = remove(game_getFilepath(game));
+  if(ret==0)
+    ie_updateIndex(game_getFilepath(game), -1, 0, dirMtime);
+  return ret;
 }
 
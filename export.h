@@ -4,6 +4,13 @@
  * Save and Load module
  * 
  * (functions are prefixed by ie_ for Import/Export)
+ *
+ * Games are saved into numbered slots of the saved/ directory ({nickname}.{slot}.sav).
+ * An index of the slots (saved/index.bin) is updated on each export and removal: it is written
+ * into a new file which then replaces it, and stamped with the time of the directory. An index
+ * missing, or stamped before a save file was added or removed, is rebuilt from the save files.
+ * On Windows the directory time is in seconds: a save file added or removed by another program
+ * in the second the index was stamped isn't noticed until the directory changes again.
  * 
  * @author Gaetan Renaudeau <pro@grenlibre.fr>
  */
@@ -12,6 +19,17 @@
 
 #define FILENAME_BUFFER_SIZE 100
 
+/**
+ * A save slot of the index
+ */
+typedef struct _SaveEntry {
+  char nickname[NICKNAME_LENGTH+1];
+  int slot;
+  int lines;
+  int score;
+  long long mtime; // modification time of the save file (ns)
+} SaveEntry;
+
 /**
  * Search an available save file path
  * @param nickname: The nickname of the player
@@ -27,6 +45,15 @@ extern int ie_getAvailableFile(char* nickname, char* store);
  */
 extern int ie_exportGame(Game* game);
 
+/**
+ * Export lines into a file, as a game ( @see ie_exportGame )
+ * @param filepath: the file path
+ * @param lines, length: the lines of the game
+ * @param score: the score of the game (for the index)
+ * @return 0 if success, 1 if error
+ */
+extern int ie_exportLines(char* filepath, Line* lines, int length, int score);
+
 /**
  * Import a game from a file
  * @param filepath: the filepath of the saved game
@@ -35,6 +62,13 @@ extern int ie_exportGame(Game* game);
  */
 extern int ie_importGame(char* filepath, Game* game);
 
+/**
+ * List the saved games from the index (rebuilt if it is missing or stale)
+ * @param entries: will be setted by the save slots sorted by nickname and slot, to free
+ * @return the number of save slots
+ */
+extern int ie_listGames(SaveEntry** entries);
+
 /**
  * Remove a game saved file
  * @return the result of the remove() call ( @see man remove )
@@ -1,34 +1,40 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <math.h>
 #include <string.h>
+#include <stdatomic.h>
 
 #include "game.h"
 #include "globals.h"
 #include "utils.h"
-#include "export.h"
 #include "points.h"
-#include "highscore.h"
+#include "profile.h"
 
-#include "ui.h"
+#define LINES_ALLOC_WINDOW 32 // initial history capacity, doubled when full
 
-#define LINES_ALLOC_WINDOW 10
-
-static int game_moveCursorForAction(Action action, Point* cursor);
-static int game_saveScore(Game* game);
 static void game_addLine(Game* game, Line l);
+static void game_applyLine(Game* game, Line line);
+
+/**
+ * Played lines, shared copy-on-write between cloned games
+ * A game only writes into its history when it is the only one using it.
+ */
+typedef struct _History {
+  atomic_int refs; // number of games using the history
+  int capacity;
+  Line lines[];
+} History;
 
 struct _Game {
-  Line* lines;
+  // compact game state: copied as is by game_clone
+  History* history;
   int nlines;
-  int lines_current_max; // lines capacity for current allocation
   
   Grid grid; // computed turn by turn
   
   int score;
-  
-  Line possibilities[MAX_POSSIBILITIES];
-  int possibilities_length;
+  unsigned long long hash; // xor of the keys of played lines
   
   char* nickname;
   char* filepath;
@@ -36,14 +42,66 @@ struct _Game {
   GameMode mode;
   
   PlayEvaluation lastPlayEvalution;
+  
+  // computed on demand: not copied by game_clone
+  int possibilities_length; // -1 if not computed for the current state
+  LegalSet legal; // the possibilities, by line index
+  int possibilities_lines; // TRUE if possibilities holds the lines of legal
+  Line* possibilities; // MAX_POSSIBILITIES lines, allocated on first use
+  History* spare; // a released history kept for the next copy-on-write
 };
 
+#define GAME_STATE_SIZE offsetof(Game, possibilities_length)
+
+static void game_releaseHistory(Game* game) {
+  History* history = game->history;
+  game->history = 0;
+  if(history==0 || atomic_fetch_sub(&history->refs, 1)!=1)
+    return;
+  // keep the largest history for reuse, so a game copied over and over doesn't allocate
+  if(game->spare && game->spare->capacity>=history->capacity) {
+    free(history);
+    return;
+  }
+  free(game->spare);
+  game->spare = history;
+}
+
+/**
+ * Make the game the only user of a history of at least capacity lines
+ */
+static void game_ownHistory(Game* game, int capacity) {
+  History* history = game->history;
+  if(history && atomic_load(&history->refs)==1 && history->capacity>=capacity)
+    return;
+  if(history && atomic_load(&history->refs)==1) {
+    history = realloc(history, sizeof(History) + sizeof(Line)*capacity);
+  }
+  else {
+    if(game->spare && game->spare->capacity>=capacity) {
+      history = game->spare;
+      capacity = history->capacity;
+      game->spare = 0;
+    }
+    else
+      history = malloc(sizeof(History) + sizeof(Line)*capacity);
+    atomic_init(&history->refs, 1);
+    if(game->nlines>0)
+      memcpy(history->lines, game->history->lines, sizeof(Line)*game->nlines);
+    game_releaseHistory(game);
+  }
+  history->capacity = capacity;
+  game->history = history;
+}
+
 extern Game* game_init() {
   Game* game = malloc(sizeof(Game));
-  game->lines = 0;
+  game->history = 0;
+  game->possibilities = 0;
+  game->spare = 0;
   game->nlines = 0;
   game->score = 0;
-  game->lines_current_max = 0;
+  game->hash = 0;
   game_initGrid(&(game->grid));
   game->mode = GM_SOBER;
   game->nickname = 0;
@@ -54,148 +112,29 @@ extern Game* game_init() {
 }
 
 extern void game_close(Game* game) {
-  if(game->lines)
-    free(game->lines);
+  game_releaseHistory(game);
+  free(game->spare);
+  free(game->possibilities);
   free(game);
 }
 
-extern void game_onStart(Game* game) {
-  game_computeAllPossibilities(game);
-  ui_printMessage_info("Move your cursor with arrows or ZSQD keys");
-  ui_updateGrid(game);
-  ui_refresh();
-}
-
-extern void game_onStop(Game* game) {
-  int rank;
-  char buf[100], buf2[100];
-  if(game_getPossibilitiesNumber(game)==0) {
-    rank = game_saveScore(game);
-    if(rank)
-      snprintf(buf2, 100, " You take the %dth place!", rank);
-    else
-      *buf2 = 0;
-    snprintf(buf, 100, "Game over.%s Press <enter> to quit", buf2);
-    ui_printMessage_success(buf);
-    ie_removeGame(game);
-    ui_updateGrid(game);
-    ui_printInfos(game);
-    ui_refresh();
-    while(ui_getAction() != Action_VALID);
-  }
-}
-
-extern void game_onActionUndo(Game* game) {
-  game_setSelect(game, point_empty());
-  game_undoLine(game);
-  game->lastPlayEvalution = PE_NONE;
-  game_computeAllPossibilities(game);
-  ie_exportGame(game);
-  ui_printMessage_success("Time machine has done... Going back in time!");
-}
-
-extern void game_onActionValid(Game* game) {
-  int possibilitiesCount, diff;
-  int count;
-  Line line;
-  Point cursor = game_getCursor(game);
-  Point select = game_getSelect(game);
-  game_setSelect(game, cursor);
-  
-  if(line_isValidLineBetween(select, cursor) && line_getLineBetween(select, cursor, &line)==LINE_LENGTH) {
-    count = game_countOccupiedCases(game, line);
-    if((count==LINE_LENGTH || count==LINE_LENGTH-1) && game_isPlayableLine(game, line)) {
-      ui_printMessage_success("Line played. ");
-      possibilitiesCount = game_getPossibilitiesNumber(game);
-      game_consumeLine(game, line);
-      if(game_getLinesCount(game)) {
-        diff = game_computeAllPossibilities(game) - possibilitiesCount + 1;
-        if(diff<=-2) {
-          game->lastPlayEvalution = PE_BAD;
-        }
-        else if(diff<=1) {
-          game->lastPlayEvalution = PE_ORDINARY;
-        }
-        else if(diff<4) {
-          game->lastPlayEvalution = PE_GREAT;
-        }
-        else if(diff<7) {
-          game->lastPlayEvalution = PE_IMPRESSIVE;
-        }
-        else {
-          game->lastPlayEvalution = PE_AWESOME;
-        }
-        if(count==LINE_LENGTH)
-          game->lastPlayEvalution = MIN(PE_AWESOME, game->lastPlayEvalution+3);
-      }
-      else {
-        game->lastPlayEvalution = PE_NONE;
-      }
-      ie_exportGame(game);
-    }
-    else if(point_exists(select)) {
-      ui_printMessage_error("Invalid action. You better stop now!");
-    }
-    game_setSelect(game, point_empty());
-  }
-  else if(point_exists(select)) {
-    ui_printMessage_error("Invalid line. You better stop now!");
-    game_setSelect(game, point_empty());
-  }
-}
-
-extern void game_beforeAction(Game* game) {
-  ui_updateGrid(game);
-  ui_printInfos(game);
-  ui_refresh();
+extern Game* game_clone(Game* game) {
+  Game* clone = malloc(sizeof(Game));
+  clone->history = 0;
+  clone->possibilities = 0;
+  clone->spare = 0;
+  game_copy(clone, game);
+  return clone;
 }
 
-extern int game_onAction(Game* game, Action action) {
-  Point cursor, select;
-  if(action==Action_CANCEL && !point_exists(game_getSelect(game))) {
-    ui_printMessage_info("Quit? Oh really? [y/n]");
-    return TRUE;
-  }
-  else {
-    if(!point_exists(select))
-      ui_printMessage_info("Select the endpoint of the line by pressing <enter> or <space>");
-    else
-      ui_printMessage_info("Select a line startpoint with your cursor by pressing <enter> or <space>");
-    
-    cursor = game_getCursor(game);
-    if(game_moveCursorForAction(action, &cursor))
-      game_setCursor(game, cursor);
-    
-    else if(action==Action_UNDO && game_getLinesCount(game)>0)
-      game_onActionUndo(game);
-    else if(action==Action_TOGGLE_HELP)
-      game_setMode(game, game_getMode(game) == GM_VISUAL ? GM_SOBER : GM_VISUAL); // toggle mode
-    else if(action==Action_VALID)
-      game_onActionValid(game);
-    else if(action==Action_CANCEL)
-      game_setSelect(game, point_empty());
-    return FALSE;
-  }
-}
-
-static int game_moveCursorForAction(Action action, Point* cursor) {
-  if(action==Action_LEFT && cursor->x>0) {
-    cursor->x --;
-    return TRUE;
-  }
-  else if(action==Action_DOWN && cursor->y>0) {
-    cursor->y --;
-    return TRUE;
-  }
-  else if(action==Action_RIGHT && cursor->x<GRID_SIZE-1) {
-    cursor->x ++;
-    return TRUE;
-  }
-  else if(action==Action_UP && cursor->y<GRID_SIZE-1) {
-    cursor->y ++;
-    return TRUE;
-  }
-  return FALSE;
+extern void game_copy(Game* dst, Game* src) {
+  if(dst==src)
+    return;
+  if(src->history)
+    atomic_fetch_add(&src->history->refs, 1);
+  game_releaseHistory(dst);
+  memcpy(dst, src, GAME_STATE_SIZE);
+  dst->possibilities_length = -1;
 }
 
 extern Grid* game_getGrid(Game* game) {
@@ -210,31 +149,44 @@ extern int game_countOccupiedCases(Game* game, Line line) {
   return count;
 }
 
+/**
+ * Add a line to the possibilities if it is playable
+ * @return 1 if the line was added, 0 else
+ */
+static inline int game_addPossibility(Game* game, Line line) {
+  int index;
+  if(!game_isPlayableLine(game, line))
+    return 0;
+  index = line_getIndex(line);
+  game->legal.bits[index>>6] |= 1ULL << (index & 63);
+  return 1;
+}
+
 extern int game_computeAllPossibilities(Game* game) {
-  Line* lines = game->possibilities;
+  PROFILE_SCOPE(PROFILE_COMPUTE_POSSIBILITIES);
   Line line;
   int possibilities = 0;
   int x, y;
   
+  memset(&game->legal, 0, sizeof(LegalSet));
+  game->possibilities_lines = FALSE;
+  
+  // lines ending at (x, y), from the point LINE_LENGTH-1 cases before
   for(y=0; y<GRID_SIZE; ++y) {
     for(x=0; x<GRID_SIZE; ++x) {
-      if(x>=5) {
-        line_getLineBetween(point_new(x-5, y), point_new(x, y), &line);
-        if(game_isPlayableLine(game, line))
-          lines[possibilities++] = line;
+      if(x>=LINE_LENGTH-1) {
+        line_getLineBetween(point_new(x-LINE_LENGTH+1, y), point_new(x, y), &line);
+        possibilities += game_addPossibility(game, line);
       }
-      if(y>=5) {
-        line_getLineBetween(point_new(x, y-5), point_new(x, y), &line);
-        if(game_isPlayableLine(game, line))
-          lines[possibilities++] = line;
+      if(y>=LINE_LENGTH-1) {
+        line_getLineBetween(point_new(x, y-LINE_LENGTH+1), point_new(x, y), &line);
+        possibilities += game_addPossibility(game, line);
       }
-      if(x>=5 && y>=5) {
-        line_getLineBetween(point_new(x-5, y-5), point_new(x, y), &line);
-        if(game_isPlayableLine(game, line))
-          lines[possibilities++] = line;
-        line_getLineBetween(point_new(x-5, y), point_new(x, y-5), &line);
-        if(game_isPlayableLine(game, line))
-          lines[possibilities++] = line;
+      if(x>=LINE_LENGTH-1 && y>=LINE_LENGTH-1) {
+        line_getLineBetween(point_new(x-LINE_LENGTH+1, y-LINE_LENGTH+1), point_new(x, y), &line);
+        possibilities += game_addPossibility(game, line);
+        line_getLineBetween(point_new(x-LINE_LENGTH+1, y), point_new(x, y-LINE_LENGTH+1), &line);
+        possibilities += game_addPossibility(game, line);
       }
     }
   }
@@ -242,11 +194,26 @@ extern int game_computeAllPossibilities(Game* game) {
 }
 
 extern int game_getPossibilitiesNumber(Game* game) {
+  if(game->possibilities_length<0)
+    game_computeAllPossibilities(game);
   return game->possibilities_length;
 }
 
+extern const LegalSet* game_getLegalSet(Game* game) {
+  game_getPossibilitiesNumber(game);
+  return &game->legal;
+}
+
 extern Line* game_getAllPossibilities(Game* game, int* length) {
-  *length = game->possibilities_length;
+  int i, n = 0;
+  *length = game_getPossibilitiesNumber(game);
+  if(game->possibilities_lines)
+    return game->possibilities;
+  if(game->possibilities==0)
+    game->possibilities = malloc(sizeof(Line)*MAX_POSSIBILITIES);
+  for(i=legalset_next(&game->legal, 0); i>=0; i=legalset_next(&game->legal, i+1))
+    line_fromIndex(i, &game->possibilities[n++]);
+  game->possibilities_lines = TRUE;
   return game->possibilities;
 }
 
@@ -270,6 +237,24 @@ extern int game_getScore(Game* game) {
   return game->score;
 }
 
+extern unsigned long long game_getHash(Game* game) {
+  return game->hash;
+}
+
+extern unsigned long long game_getCanonicalHash(Game* game) {
+  unsigned long long hash, canonical = game->hash;
+  Line line;
+  int i, s;
+  for(s=1; s<SYMMETRY_COUNT; ++s) {
+    for(i=0, hash=0; i<game->nlines; ++i) {
+      line_transform(game->history->lines[i], s, &line);
+      hash ^= line_getKey(line);
+    }
+    canonical = MIN(canonical, hash);
+  }
+  return canonical;
+}
+
 extern void game_setSelect(Game* game, Point p) {
   game->grid.select = p;
 }
@@ -310,78 +295,83 @@ extern PlayEvaluation game_getLastPlayEvaluation(Game* game) {
   return game->lastPlayEvalution;
 }
 
+extern void game_setLastPlayEvaluation(Game* game, PlayEvaluation evaluation) {
+  game->lastPlayEvalution = evaluation;
+}
+
 extern int game_mustDisplayPossibilities(Game* game) {
   return game->mode!=GM_SOBER;
 }
 
 extern Line* game_getLines(Game* game, int* length) {
   *length = game->nlines;
-  return game->lines;
+  return game->history ? game->history->lines : 0;
 }
 
 static void game_addLine(Game* game, Line l) {
-  if(game->nlines==game->lines_current_max) {
-    game->lines_current_max += LINES_ALLOC_WINDOW;
-    game->lines = game->lines==0 ? malloc(sizeof(Line)*game->lines_current_max) : realloc(game->lines, sizeof(Line)*game->lines_current_max);
-  }
-  game->lines[game->nlines++] = l;
+  int capacity = game->history ? game->history->capacity : 0;
+  game_ownHistory(game, game->nlines<capacity ? capacity : MAX(2*capacity, LINES_ALLOC_WINDOW));
+  game->history->lines[game->nlines++] = l;
 }
 
 extern int game_isPlayableLine(Game* game, Line line) {
+    PROFILE_SCOPE(PROFILE_IS_PLAYABLE_LINE);
     int count = game_countOccupiedCases(game, line);
     return ((count==LINE_LENGTH || count==LINE_LENGTH-1) 
-    && !line_hasCollinearAndContains(game->lines, game->nlines, line));
+    && !(game->history && line_hasCollinearAndContains(game->history->lines, game->nlines, line)));
 }
 
 extern void game_recomputeGrid(Game* game) {
   int i;
   game_initGrid(&(game->grid));
-  Line* lines = game->lines;
-  int nlines = game->nlines;
   game->score = 0;
-  game->lines = 0;
-  game->nlines = 0;
-  game->lines = malloc(sizeof(Line)*game->lines_current_max);
-  for(i=0; i<nlines; ++i) {
-    game_consumeLine(game, lines[i]);
-  }
-  free(lines);
+  game->hash = 0;
+  game->possibilities_length = -1;
+  for(i=0; i<game->nlines; ++i)
+    game_applyLine(game, game->history->lines[i]);
 }
 
 extern void game_undoLine(Game* game) {
+  PROFILE_SCOPE(PROFILE_UNDO_LINE);
   Point cursor = game->grid.cursor;
   game->nlines = MAX(game->nlines-1, 0);
   game_recomputeGrid(game);
   game->grid.cursor = cursor;
 }
 
-extern void game_consumeLine(Game* game, Line line) {
+extern void game_restore(Game* game, Line* lines, int nlines, Grid* grid, int score) {
+  int i;
+  Point cursor = game->grid.cursor;
+  Point select = game->grid.select;
+  game->nlines = 0; // nothing to keep from the current history
+  game_ownHistory(game, nlines + LINES_ALLOC_WINDOW);
+  if(nlines>0)
+    memcpy(game->history->lines, lines, sizeof(Line)*nlines);
+  game->nlines = nlines;
+  game->possibilities_length = -1;
+  game->hash = 0;
+  for(i=0; i<nlines; ++i)
+    game->hash ^= line_getKey(lines[i]);
+  game->grid = *grid;
+  game->grid.cursor = cursor;
+  game->grid.select = select;
+  game->score = score;
+}
+
+static void game_applyLine(Game* game, Line line) {
   int i;
   int count = game_countOccupiedCases(game, line);
   for(i=0; i<LINE_LENGTH; ++i)
     game_occupyCase(game, line.points[i]);
   game->score += (count==LINE_LENGTH) ? POINTS_TRACE_LINE : POINTS_PUT_POINT;
-  game_addLine(game, line);
+  game->hash ^= line_getKey(line);
 }
 
-static int game_saveScore(Game* game) {
-  int rank, i;
-  Highscore highscores[HIGHSCORE_MAX];
-  Highscore highscore;
-  highscore.score = game_getScore(game);
-  strncpy(highscore.nickname, game_getNickname(game), NICKNAME_LENGTH);
-  int length = highscore_retrieve(highscores, HIGHSCORE_MAX);
-  highscore_sort(highscores, length);
-  for(rank=0; rank<length && (highscores[rank].score>highscore.score || highscore_equals(&highscore, &highscores[rank])); ++rank);
-  if(rank<length) {
-    if(length<HIGHSCORE_MAX-1)
-      ++ length;
-    for(i=length-1; i>rank; --i)
-      highscores[i] = highscores[i-1];
-    highscores[rank] = highscore;
-  }
-  highscore_store(highscores, MIN(HIGHSCORE_MAX, length));
-  return rank>=HIGHSCORE_MAX ? 0 : rank+1;
+extern void game_consumeLine(Game* game, Line line) {
+  PROFILE_SCOPE(PROFILE_CONSUME_LINE);
+  game_applyLine(game, line);
+  game_addLine(game, line);
+  game->possibilities_length = -1;
 }
 
 extern void game_initGrid(Grid* grid) {
@@ -4,6 +4,8 @@
  * Game module
  * 
  * Most of function defined here take an instance of Game as @param
+ * The game module only holds the game state and rules: it has no user interface
+ * or file side effect ( @see play.h for game events )
  * @author Gaetan Renaudeau <pro@grenlibre.fr>
  */
 
@@ -11,6 +13,7 @@
 #include "points.h"
 
 #define MAX_POSSIBILITIES (4*GRID_SIZE*GRID_SIZE)
+#define LEGAL_SET_WORDS ((LINE_INDEX_COUNT+63)/64)
 
 /**
  * The whole game structure
@@ -18,6 +21,13 @@
  */
 typedef struct _Game Game;
 
+/**
+ * A set of line indices ( @see line_getIndex ), one bit per possible line
+ */
+typedef struct _LegalSet {
+  unsigned long long bits[LEGAL_SET_WORDS];
+} LegalSet;
+
 /**
  * Type of a case : empty or occupied
  */
@@ -30,7 +40,7 @@ typedef enum {
  * Grid infos ready to display (2d grid, cursor position, select case)
  */
 typedef struct _Grid {
-  CaseType grid[GRID_SIZE][GRID_SIZE];
+  unsigned char grid[GRID_SIZE][GRID_SIZE]; // CaseType of each case
   Point cursor;
   Point select;
 } Grid;
@@ -59,7 +69,10 @@ typedef enum {
   Action_UNDO,
   Action_TOGGLE_HELP,
   Action_VALID, /* Valid action */
-  Action_CANCEL /* Cancel a state (ex: quit the game) */
+  Action_CANCEL, /* Cancel a state (ex: quit the game) */
+  Action_HOME, Action_END, /* jump to the first / last move (replay) */
+  Action_FASTER, Action_SLOWER, /* change the autoplay speed (replay) */
+  Action_GOTO /* ask a move number to jump to (replay) */
 } Action;
 
 /**
@@ -84,28 +97,20 @@ extern Game* game_init();
  */
 extern void game_close(Game*);
 
-// Game events
-/**
- * function called on game start
- */
-extern void game_onStart(Game* game);
-
-/**
- * function called on game stop (before closing)
- */
-extern void game_onStop(Game* game);
-
 /**
- * function called just before waiting ui action
+ * Clone a game
+ * Only the compact game state is copied: played lines are shared with the clone
+ * until one of the games plays a line (copy-on-write).
+ * @return a new game in the same state
  */
-extern void game_beforeAction(Game* game);
+extern Game* game_clone(Game* game);
 
 /**
- * function called just after getting a ui action
- * @param action: the action triggered
- * @return true if quit is requested, false else
+ * Copy a game state into another game ( @see game_clone )
+ * @param dst: an initialized game, its previous state is released
+ * @param src: the game to copy
  */
-extern int game_onAction(Game* game, Action action);
+extern void game_copy(Game* dst, Game* src);
 
 // Getters / Setters
 /**
@@ -119,6 +124,19 @@ extern void game_setMode(Game* game, GameMode mode);
  */
 extern int game_getScore(Game* game);
 
+/**
+ * Get the position hash
+ * The hash depends on the set of played lines, not on the order they were played.
+ */
+extern unsigned long long game_getHash(Game* game);
+
+/**
+ * Get the canonical position hash
+ * The hash is the same for positions which are images of each other by a symmetry of the grid
+ * ( @see point_transform ): the smallest hash of the images of the position.
+ */
+extern unsigned long long game_getCanonicalHash(Game* game);
+
 /**
  * Get / Set the select case
  */
@@ -144,9 +162,10 @@ extern char* game_getFilepath(Game* game);
 extern void game_setFilepath(Game* game, char* filepath);
 
 /**
- * Get the last play evaluation
+ * Get / Set the last play evaluation
  */
 extern PlayEvaluation game_getLastPlayEvaluation(Game* game);
+extern void game_setLastPlayEvaluation(Game* game, PlayEvaluation evaluation);
 
 /**
  * Init a grid
@@ -174,6 +193,7 @@ extern int game_countOccupiedCases(Game* game, Line);
 
 /**
  * Get the number of possibilities
+ * Possibilities are computed if the game changed since they were last computed.
  * @return the number of line possibilities
  */
 extern int game_getPossibilitiesNumber(Game* game);
@@ -191,6 +211,47 @@ extern Line* game_getAllPossibilities(Game* game, int* length);
  */
 extern int game_computeAllPossibilities(Game* game);
 
+/**
+ * Get the line possibilities as a set of line indices
+ * Possibilities are computed if the game changed since they were last computed. The lines of
+ * game_getAllPossibilities are only made from the set when asked, in line index order.
+ * @return the set, valid until the game changes
+ */
+extern const LegalSet* game_getLegalSet(Game* game);
+
+/**
+ * Get the first line index of a set from an index
+ * @param from: the first index to check
+ * @return the index, or -1 if there is none
+ */
+static inline int legalset_next(const LegalSet* set, int from) {
+  int w = from>>6;
+  unsigned long long bits;
+  if(from>=LINE_INDEX_COUNT)
+    return -1;
+  bits = set->bits[w] & (~0ULL << (from & 63));
+  while(bits==0) {
+    if(++w>=LEGAL_SET_WORDS)
+      return -1;
+    bits = set->bits[w];
+  }
+  return (w<<6) + __builtin_ctzll(bits);
+}
+
+/**
+ * Get the k-th line index of a set (in index order)
+ * @param k: in [0, number of indices), e.g. a uniform random index
+ */
+static inline int legalset_select(const LegalSet* set, int k) {
+  unsigned long long bits;
+  int w, count;
+  for(w=0; (count = __builtin_popcountll(set->bits[w]))<=k; ++w)
+    k -= count;
+  for(bits=set->bits[w]; k>0; --k)
+    bits &= bits-1; // clear the lowest bit
+  return (w<<6) + __builtin_ctzll(bits);
+}
+
 /**
  * Check if the UI must display line possibilities
  * @return true if UI must display line possibilities
@@ -228,4 +289,12 @@ extern void game_consumeLine(Game* game, Line line);
  */
 extern void game_undoLine(Game* game);
 
+/**
+ * Restore a game state from a snapshot (cursor and select are kept)
+ * @param lines, nlines: the lines played in the snapshot
+ * @param grid: the grid of the snapshot
+ * @param score: the score of the snapshot
+ */
+extern void game_restore(Game* game, Line* lines, int nlines, Grid* grid, int score);
+
 #endif
@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "improve.h"
+#include "export.h"
+#include "globals.h"
+#include "points.h"
+#include "utils.h"
+
+#define IMPROVE_TRIED_MIN 1024 // slots of the table of searched positions
+
+/**
+ * Positions searched since the last improvement, by hash (open addressing, 0 marks a free slot)
+ */
+typedef struct _ImproveTried {
+  unsigned long long* hashes;
+  int capacity;
+  int size;
+} ImproveTried;
+
+static void improve_clearTried(ImproveTried* tried) {
+  memset(tried->hashes, 0, sizeof(unsigned long long)*tried->capacity);
+  tried->size = 0;
+}
+
+/**
+ * Add a position to the searched ones
+ * @return TRUE if it was already searched
+ */
+static int improve_addTried(ImproveTried* tried, unsigned long long hash) {
+  unsigned long long* old;
+  int i, capacity;
+  hash = hash ? hash : 1;
+  for(i=hash%tried->capacity; tried->hashes[i]; i=(i+1)%tried->capacity)
+    if(tried->hashes[i]==hash)
+      return TRUE;
+  tried->hashes[i] = hash;
+  if(2*(++ tried->size)>tried->capacity) { // keep the table half empty
+    old = tried->hashes;
+    capacity = tried->capacity;
+    tried->capacity *= 2;
+    tried->hashes = calloc(tried->capacity, sizeof(unsigned long long));
+    tried->size = 0;
+    for(i=0; i<capacity; ++i)
+      if(old[i])
+        improve_addTried(tried, old[i]);
+    free(old);
+  }
+  return FALSE;
+}
+
+/**
+ * Mark a window of consecutive lines of the record
+ * @param removed: will be setted by TRUE for the lines of the window
+ */
+static void improve_drawWindow(int nlines, int window, unsigned long long* random, char* removed) {
+  int i, start = util_random(random) % nlines;
+  for(i=0; i<nlines; ++i)
+    removed[i] = i>=start && i<start+window;
+}
+
+/**
+ * Mark the lines of the record crossing a square region, centered on the middle of a line of the record
+ * @param removed: will be setted by TRUE for the lines crossing the region
+ */
+static void improve_drawRegion(Line* lines, int nlines, int region, unsigned long long* random, char* removed) {
+  Point center = lines[util_random(random) % nlines].points[LINE_LENGTH/2];
+  int i, j, x0 = center.x - region/2, y0 = center.y - region/2;
+  for(i=0; i<nlines; ++i)
+    for(j=0, removed[i]=FALSE; j<LINE_LENGTH && !removed[i]; ++j)
+      removed[i] = lines[i].points[j].x>=x0 && lines[i].points[j].x<x0+region
+                   && lines[i].points[j].y>=y0 && lines[i].points[j].y<y0+region;
+}
+
+/**
+ * Play the lines of the record left by a neighborhood, in their order, while they stay playable
+ * @param start: the start position
+ * @param game: will be setted by the position left
+ * @return the number of lines played
+ */
+static int improve_replay(Line* lines, int nlines, char* removed, Game* start, Game* game) {
+  int i, played = 0;
+  game_copy(game, start);
+  for(i=0; i<nlines; ++i) {
+    if(removed[i] || !game_isPlayableLine(game, lines[i]))
+      continue;
+    game_consumeLine(game, lines[i]);
+    ++ played;
+  }
+  return played;
+}
+
+extern ImproveResult improve_run(Game* game, SearchAlgorithm algorithm, int level, int window, int region,
+                                 int threads, int iterations, int neighborhoods, double timeLimit,
+                                 unsigned long long seed, const char* savepath) {
+  ImproveResult result;
+  ImproveTried tried;
+  Game* start = game_init();
+  Game* neighborhood = game_init();
+  char *nickname = game_getNickname(game), *filepath = game_getFilepath(game);
+  Line *record, *lines = malloc(sizeof(Line)*LINE_INDEX_COUNT); // a copy of the record lines
+  char* removed = malloc(LINE_INDEX_COUNT);
+  unsigned long long random = seed;
+  int i, nlines, score;
+  double startTime = util_getTime();
+
+  window = MAX(window, 1);
+  region = MAX(region, 1);
+  threads = MAX(threads, 1);
+  iterations = iterations>0 ? iterations : threads;
+  if(neighborhoods<=0 && timeLimit<=0)
+    neighborhoods = IMPROVE_NEIGHBORHOODS_DEFAULT;
+  tried.capacity = IMPROVE_TRIED_MIN;
+  tried.hashes = calloc(tried.capacity, sizeof(unsigned long long));
+  tried.size = 0;
+  record = game_getLines(game, &nlines);
+  memcpy(lines, record, sizeof(Line)*nlines);
+  result.startScore = result.score = game_getScore(game);
+  result.neighborhoods = result.skipped = result.improvements = 0;
+
+  for(i=0; nlines>0 && (neighborhoods<=0 || i<neighborhoods)
+           && (timeLimit<=0 || util_getTime()-startTime<timeLimit); ++i) {
+    if(util_random(&random) & 1)
+      improve_drawWindow(nlines, window, &random, removed);
+    else
+      improve_drawRegion(lines, nlines, region, &random, removed);
+    improve_replay(lines, nlines, removed, start, neighborhood);
+    if(improve_addTried(&tried, game_getHash(neighborhood))) {
+      ++ result.skipped;
+      continue;
+    }
+    search_run(neighborhood, algorithm, level, NULL, threads, iterations, 0, util_randomStream(seed, i));
+    ++ result.neighborhoods;
+    if((score = game_getScore(neighborhood))<=result.score)
+      continue;
+    game_copy(game, neighborhood);
+    game_setNickname(game, nickname);
+    record = game_getLines(game, &nlines);
+    memcpy(lines, record, sizeof(Line)*nlines);
+    result.score = score;
+    ++ result.improvements;
+    improve_clearTried(&tried); // the neighborhoods of the new record
+    printf("neighborhood %d: score %d, %d lines (%.3f s)\n", i, score, nlines, util_getTime()-startTime);
+    fflush(stdout);
+    if(savepath) {
+      game_setFilepath(game, (char*)savepath);
+      if(ie_exportGame(game)!=0)
+        fprintf(stderr, "Unable to save the best game into %s.\n", savepath);
+    }
+  }
+  game_setFilepath(game, filepath);
+  result.seconds = util_getTime() - startTime;
+
+  free(tried.hashes);
+  free(removed);
+  free(lines);
+  game_close(neighborhood);
+  game_close(start);
+  return result;
+}
@@ -0,0 +1,53 @@
+#ifndef _IMPROVE_H
+#define _IMPROVE_H
+/**
+ * Improve module
+ *
+ * Large neighborhood search on a played game (a record): a neighborhood removes part of the
+ * record, either a window of consecutive lines or all the lines crossing a square region of the
+ * board. The other lines are played again in their order while they stay playable (a line
+ * resting on a removed one is removed too), and the position is completed by a short search on
+ * all the threads ( @see search_run ). The completed game replaces the record only if its score
+ * is strictly better.
+ * Neighborhoods are drawn at random around the record; a position already searched since the
+ * last improvement (same hash) is skipped. Each improvement is exported as soon as it is found.
+ */
+
+#include "game.h"
+#include "search.h"
+
+#define IMPROVE_WINDOW_DEFAULT 10 // lines removed by a window neighborhood
+#define IMPROVE_REGION_DEFAULT 5 // side of the region of a region neighborhood
+#define IMPROVE_NEIGHBORHOODS_DEFAULT 100 // neighborhoods searched without a time limit
+
+/**
+ * Large neighborhood search results
+ */
+typedef struct _ImproveResult {
+  int startScore; // score of the record
+  int score; // best final score found
+  int neighborhoods; // neighborhoods searched
+  int skipped; // neighborhoods skipped (position already searched)
+  int improvements;
+  double seconds;
+} ImproveResult;
+
+/**
+ * Improve a record by large neighborhood search
+ * @param game: the record, the best game found is played into it
+ * @param algorithm, level: the search completing each neighborhood ( @see search_run )
+ * @param window: the number of lines removed by a window neighborhood
+ * @param region: the side of the square removed by a region neighborhood
+ * @param threads: the number of search threads
+ * @param iterations: the number of search iterations of a neighborhood (0 for one per thread)
+ * @param neighborhoods: the number of neighborhoods to search (0 for no limit)
+ * @param timeLimit: the time limit (s), 0 for no limit
+ * @param seed: the random seed (each neighborhood gets its own random streams)
+ * @param savepath: the file the best game is exported to at each improvement (NULL to not save it)
+ * @return the results
+ */
+extern ImproveResult improve_run(Game* game, SearchAlgorithm algorithm, int level, int window, int region,
+                                 int threads, int iterations, int neighborhoods, double timeLimit,
+                                 unsigned long long seed, const char* savepath);
+
+#endif
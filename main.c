@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 // #include <unistd.h>
 #include <time.h>
 
@@ -9,6 +10,24 @@
 #include "ui.h"
 #include "export.h"
 #include "highscore.h"
+#include "play.h"
+#include "replay.h"
+#include "perft.h"
+#include "search.h"
+#include "serve.h"
+#include "dist.h"
+#include "improve.h"
+#include "canon.h"
+#include "book.h"
+#include "archive.h"
+#include "batch.h"
+#include "rollout.h"
+#include "telemetry.h"
+#include "profile.h"
+
+#define REPLAY_SPEED_DEFAULT 500
+#define REPLAY_SPEED_MIN 25
+#define REPLAY_SPEED_MAX 4000
 
 typedef enum
 {
@@ -21,7 +40,19 @@ typedef enum
 static GameEndStatus loadGame(char *filepath);
 static GameEndStatus newGame(char *nickname);
 static GameEndStatus runGame(Game *game);
-static void demo();
+static GameEndStatus replayGame(char *filepath, int speed, int start);
+static void demo(RolloutPolicy *policy);
+static int queryServer(char *socket, char *filepath, int budget);
+static int searchGame(int level, int threads, char *from, char *nickname, int argc, char *argv[]);
+static int coordinateSearch(char *address, int level, char *from, char *nickname, int argc, char *argv[]);
+static int improveGame(char *filepath, int level, int threads, char *nickname, int argc, char *argv[]);
+static int getSearchAlgorithm(int argc, char *argv[]);
+static int getRolloutPolicy(int argc, char *argv[], RolloutPolicy *policy);
+static Game *loadSearchGame(char *from);
+static int getSaveFile(char *nickname, char *filepath);
+static int printBook(char *filepath);
+static int archiveGames(char *filepath, int argc, char *argv[]);
+static void listGames(char *nickname);
 
 static void printHelp(char *argv0)
 {
@@ -41,15 +72,98 @@ static void printHelp(char *argv0)
     printf("* note that games are saved into the saved/ directory.\n");
     printf("\n");
 
+    printf("Replay a saved game:\n");
+    printf("       %s --replay {game file} [--speed {ms per move}] [--at {move}]\n", argv0);
+    printf("       %s  -r {game file}\n", argv0);
+    printf("\n");
+
     printf("Show highscores:\n");
     printf("       %s --highscores\n", argv0);
     printf("\n");
 
+    printf("List the saved games (of a nickname):\n");
+    printf("       %s --list [{nickname}]\n", argv0);
+    printf("\n");
+
     printf("Start a random game demo:\n");
-    printf("       %s --demo\n", argv0);
+    printf("       %s --demo [--rollout uniform|mobility|central|{weights file}]\n", argv0);
     printf("       %s -d\n", argv0);
     printf("\n");
 
+    printf("Show the debug overlay (frame time, dropped frames, save latency):\n");
+    printf("       add --debug to any game mode\n");
+    printf("\n");
+
+    printf("Write timings of the engine hot paths as a Chrome trace at exit (builds with MORPION_PROFILE):\n");
+    printf("       add --profile {file} to any mode\n");
+    printf("\n");
+
+    printf("Report search counters as JSON lines (file, or - for the standard error):\n");
+    printf("       add --telemetry {file} [--telemetry-interval {s}] to any search mode\n");
+    printf("\n");
+
+    printf("Count the positions reachable in {depth} moves (move generator check and benchmark):\n");
+    printf("       %s --perft {depth} [--threads {n}] [--unique] [--divide]\n", argv0);
+    printf("* --unique also counts distinct positions, --divide prints the count of each first move.\n");
+    printf("\n");
+
+    printf("Search a high score game (nmcs and nrpa: {level} is the nesting level, beam: the beam width):\n");
+    printf("       %s --search {level} [--algorithm nmcs|nrpa|beam|mcts] [--threads {n}] [--iterations {n}]\n", argv0);
+    printf("                [--time {s}] [--seed {n}] [--from {game file}] [--save {nickname}] [--nodes {n}]\n");
+    printf("                [--book {book file} [--book-skip {visits}]]\n");
+    printf("                [--rollout uniform|mobility|central|{weights file}] [--save-policy {weights file}]\n");
+    printf("* --from starts from a saved game, --save saves the best game found into the saved/ directory.\n");
+    printf("* the same --seed and --iterations give the same game whatever the number of threads.\n");
+    printf("* --book records the openings of the searched games into a book file (created if missing),\n");
+    printf("  --book-skip first follows the book while the next position has at least {visits} games.\n");
+    printf("* --rollout sets the policy of the random games (nmcs, beam and mcts), --save-policy saves the policy\n");
+    printf("  learned by nrpa, to be used as a rollout weights file.\n");
+    printf("* mcts grows one tree of at most --nodes nodes (%d by default), an iteration is one random game:\n",
+           TREE_CAPACITY_DEFAULT);
+    printf("  the tree is searched by one thread, the random games run on all the threads.\n");
+    printf("\n");
+
+    printf("Show the content of an opening book:\n");
+    printf("       %s --book-info {book file}\n", argv0);
+    printf("\n");
+
+    printf("Store games into an archive file (created if missing) and show its size:\n");
+    printf("       %s --archive {archive file} [--add {directory}] [--generate {n} [--seed {n}]]\n", argv0);
+    printf("                [--prefix {game file}]\n");
+    printf("* --add adds the saved games of a directory, --generate adds {n} random games.\n");
+    printf("* --prefix only counts the games starting with the lines of a saved game.\n");
+    printf("\n");
+
+    printf("Improve a saved game by large neighborhood search:\n");
+    printf("       %s --improve {game file} [--level {level}] [--algorithm nmcs|nrpa|beam|mcts] [--threads {n}]\n", argv0);
+    printf("                [--iterations {n}] [--window {lines}] [--region {side}] [--neighborhoods {n}]\n");
+    printf("                [--time {s}] [--seed {n}] [--rollout {policy}] [--save {nickname}]\n");
+    printf("* each neighborhood removes a window of --window lines (%d by default) or the lines crossing a\n",
+           IMPROVE_WINDOW_DEFAULT);
+    printf("  square of --region cases (%d by default), and is completed by a search of --iterations\n",
+           IMPROVE_REGION_DEFAULT);
+    printf("  iterations (one per thread by default). Better games are saved as soon as they are found.\n");
+    printf("\n");
+
+    printf("Find the saved games holding the same lines as another one (in any order, rotated or reflected):\n");
+    printf("       %s --dedup [{directory}] [--threads {n}] [--remove]\n", argv0);
+    printf("* the directory is saved/ by default, --remove removes the duplicates (the first file is kept).\n");
+    printf("\n");
+
+    printf("Distribute a search between worker processes (address: host:port, :port or unix:path):\n");
+    printf("       %s --coordinate {address} [--level {level}] [--algorithm nmcs|nrpa|beam|mcts] [--units {n}]\n", argv0);
+    printf("                [--budget {ms per unit}] [--seed {n}] [--from {game file}] [--save {nickname}]\n");
+    printf("       %s --work {address} [--threads {n}]\n", argv0);
+    printf("\n");
+
+    printf("Run a solver daemon answering best continuation requests on a Unix domain socket:\n");
+    printf("       %s --serve [--socket {path}] [--threads {n}] [--level {level}] [--budget {ms}]\n", argv0);
+    printf("Ask the daemon the best continuation of a saved game, or its statistics:\n");
+    printf("       %s --query {game file} [--socket {path}] [--budget {ms}]\n", argv0);
+    printf("       %s --query-stats [--socket {path}]\n", argv0);
+    printf("* the socket is %s by default, the daemon stops on SIGINT or SIGTERM.\n", SERVE_SOCKET_DEFAULT);
+    printf("\n");
+
     printf("Display this help:\n");
     printf("       %s --help\n", argv0);
     printf("       %s -h\n", argv0);
@@ -61,6 +175,15 @@ static void printHelp(char *argv0)
     printf(" * Quit the game \tEscape then Y key\n");
     printf(" * Toggle the help \tH key\n");
     printf(" * Undo last play \tBackspace key\n");
+    printf("\n");
+
+    printf("How to use the replay:\n");
+    printf(" * Step a move \t\tLeft / Right arrows\n");
+    printf(" * Step %d moves \tUp / Down arrows\n", REPLAY_KEYFRAME_INTERVAL);
+    printf(" * First / last move \tHome / End keys\n");
+    printf(" * Go to a move \tG key\n");
+    printf(" * Play / pause \tSpace or Enter key\n");
+    printf(" * Change the speed \t+ / - keys\n");
 }
 int main(int argc, char *argv[])
 {
@@ -68,6 +191,23 @@ int main(int argc, char *argv[])
     GameEndStatus status = GES_NONE;
     char *str = 0;
     Highscore highscores[HIGHSCORE_MAX];
+    int debug = util_containsArg(argc, argv, "--debug");
+    int depth, threads = util_getCpuCount(), interval = TELEMETRY_INTERVAL_DEFAULT;
+    char *telemetry = 0, *profile = 0;
+    PerftResult perft;
+    if (util_getArgString(argc, argv, "--profile", &profile) == 0)
+    {
+        if (profile_start(profile) != 0)
+            fprintf(stderr, "Unable to profile into %s (the profiler is built with MORPION_PROFILE).\n", profile);
+        free(profile);
+    }
+    if (util_getArgString(argc, argv, "--telemetry", &telemetry) == 0)
+    {
+        util_getArgValue(argc, argv, "--telemetry-interval", &interval);
+        if (telemetry_start(telemetry, interval) != 0)
+            fprintf(stderr, "Unable to report the telemetry into %s.\n", telemetry);
+        free(telemetry);
+    }
     if (util_containsArg(argc, argv, "--help") || util_containsArg(argc, argv, "-h"))
     {
         printHelp(argv[0]);
@@ -75,25 +215,167 @@ int main(int argc, char *argv[])
     else if (util_getArgString(argc, argv, "--new", &str) == 0 || util_getArgString(argc, argv, "-n", &str) == 0)
     {
         ui_init();
+        ui_setDebug(debug);
         status = newGame(str);
         ui_close();
     }
     else if (util_getArgString(argc, argv, "--load", &str) == 0 || util_getArgString(argc, argv, "-l", &str) == 0)
     {
         ui_init();
+        ui_setDebug(debug);
         status = loadGame(str);
         ui_close();
     }
+    else if (util_getArgString(argc, argv, "--replay", &str) == 0 || util_getArgString(argc, argv, "-r", &str) == 0)
+    {
+        int speed = REPLAY_SPEED_DEFAULT, start = -1;
+        util_getArgValue(argc, argv, "--speed", &speed);
+        util_getArgValue(argc, argv, "--at", &start);
+        ui_init();
+        ui_setDebug(debug);
+        status = replayGame(str, speed, start);
+        ui_close();
+    }
+    else if (util_getArgValue(argc, argv, "--perft", &depth) == 0)
+    {
+        util_getArgValue(argc, argv, "--threads", &threads);
+        perft = perft_run(depth, threads, util_containsArg(argc, argv, "--unique"),
+                          util_containsArg(argc, argv, "--divide"));
+        printf("perft %d: %lld leaves", depth, perft.leaves);
+        if (perft.unique >= 0)
+            printf(", %lld unique", perft.unique);
+        printf(", %lld nodes in %.3f s (%.0f nodes/s, %d threads)\n", perft.nodes, perft.seconds,
+               perft.nodes / MAX(perft.seconds, 1e-9), MAX(threads, 1));
+    }
+    else if (util_getArgValue(argc, argv, "--search", &depth) == 0)
+    {
+        char *from = 0, *nickname = 0;
+        util_getArgValue(argc, argv, "--threads", &threads);
+        util_getArgString(argc, argv, "--from", &from);
+        util_getArgString(argc, argv, "--save", &nickname);
+        if (searchGame(depth, threads, from, nickname, argc, argv) != 0)
+            status = GES_ERROR_ONLOAD;
+        free(from);
+        free(nickname);
+    }
+    else if (util_getArgString(argc, argv, "--book-info", &str) == 0)
+    {
+        if (printBook(str) != 0)
+        {
+            fprintf(stderr, "Unable to open the book %s.\n", str);
+            status = GES_ERROR_ONLOAD;
+        }
+    }
+    else if (util_getArgString(argc, argv, "--archive", &str) == 0)
+    {
+        if (archiveGames(str, argc, argv) != 0)
+            status = GES_ERROR_ONLOAD;
+    }
+    else if (util_getArgString(argc, argv, "--coordinate", &str) == 0)
+    {
+        char *from = 0, *nickname = 0;
+        int level = 1;
+        util_getArgValue(argc, argv, "--level", &level);
+        util_getArgString(argc, argv, "--from", &from);
+        util_getArgString(argc, argv, "--save", &nickname);
+        if (coordinateSearch(str, level, from, nickname, argc, argv) != 0)
+            status = GES_ERROR_ONLOAD;
+        free(from);
+        free(nickname);
+    }
+    else if (util_getArgString(argc, argv, "--improve", &str) == 0)
+    {
+        char *nickname = 0;
+        int level = 1;
+        util_getArgValue(argc, argv, "--level", &level);
+        util_getArgValue(argc, argv, "--threads", &threads);
+        util_getArgString(argc, argv, "--save", &nickname);
+        if (improveGame(str, level, threads, nickname, argc, argv) != 0)
+            status = GES_ERROR_ONLOAD;
+        free(nickname);
+    }
+    else if (util_containsArg(argc, argv, "--dedup"))
+    {
+        CanonDedupResult dedup;
+        int removeDuplicates = util_containsArg(argc, argv, "--remove");
+        char *directory = "saved";
+        util_getArgValue(argc, argv, "--threads", &threads);
+        if (util_getArgString(argc, argv, "--dedup", &str) == 0 && str[0] != '\0' && str[0] != '-')
+            directory = str;
+        if (canon_dedup(directory, threads, removeDuplicates, &dedup) != 0)
+        {
+            fprintf(stderr, "Unable to read the directory %s.\n", directory);
+            status = GES_ERROR_ONLOAD;
+        }
+        else
+            printf("dedup: %d files, %d games, %d duplicates (%lld of %lld bytes), %d invalid in %.3f s\n",
+                   dedup.files, dedup.games, dedup.duplicates, dedup.duplicateBytes, dedup.bytes, dedup.invalid,
+                   dedup.seconds);
+    }
+    else if (util_getArgString(argc, argv, "--work", &str) == 0)
+    {
+        util_getArgValue(argc, argv, "--threads", &threads);
+        if (dist_work(str, threads) != 0)
+        {
+            fprintf(stderr, "Lost the coordinator on %s.\n", str);
+            status = GES_ERROR_ONLOAD;
+        }
+    }
+    else if (util_containsArg(argc, argv, "--serve"))
+    {
+        char *socket = 0;
+        int level = 1, budget = SERVE_BUDGET_DEFAULT;
+        util_getArgString(argc, argv, "--socket", &socket);
+        util_getArgValue(argc, argv, "--threads", &threads);
+        util_getArgValue(argc, argv, "--level", &level);
+        util_getArgValue(argc, argv, "--budget", &budget);
+        if (serve_run(socket ? socket : SERVE_SOCKET_DEFAULT, threads, level, budget) != 0)
+        {
+            fprintf(stderr, "Unable to listen on %s.\n", socket ? socket : SERVE_SOCKET_DEFAULT);
+            status = GES_ERROR_ONLOAD;
+        }
+        free(socket);
+    }
+    else if (util_containsArg(argc, argv, "--query-stats"))
+    {
+        char *socket = 0;
+        util_getArgString(argc, argv, "--socket", &socket);
+        if (serve_request(socket ? socket : SERVE_SOCKET_DEFAULT, "STATS\n.\n", stdout) != 0)
+            status = GES_ERROR_ONLOAD;
+        free(socket);
+    }
+    else if (util_getArgString(argc, argv, "--query", &str) == 0)
+    {
+        char *socket = 0;
+        int budget = SERVE_BUDGET_DEFAULT;
+        util_getArgString(argc, argv, "--socket", &socket);
+        util_getArgValue(argc, argv, "--budget", &budget);
+        if (queryServer(socket ? socket : SERVE_SOCKET_DEFAULT, str, budget) != 0)
+            status = GES_ERROR_ONLOAD;
+        free(socket);
+    }
     else if (util_containsArg(argc, argv, "--highscores"))
     {
         highscore_retrieve(highscores, HIGHSCORE_MAX);
         highscore_print(highscores, HIGHSCORE_MAX);
     }
+    else if (util_containsArg(argc, argv, "--list"))
+    {
+        char *nickname = 0;
+        if (util_getArgString(argc, argv, "--list", &str) == 0 && str[0] != '\0' && str[0] != '-')
+            nickname = str;
+        listGames(nickname);
+    }
     else if (util_containsArg(argc, argv, "--demo") || util_containsArg(argc, argv, "-d"))
     {
-        ui_init();
-        demo();
-        ui_close();
+        RolloutPolicy policy;
+        if (getRolloutPolicy(argc, argv, &policy) == 0)
+        {
+            ui_init();
+            ui_setDebug(debug);
+            demo(&policy);
+            ui_close();
+        }
     }
     else
     {
@@ -103,6 +385,9 @@ int main(int argc, char *argv[])
         printf("More infos with %s --help\n", argv[0]);
     }
 
+    free(str);
+    telemetry_stop();
+
     if (status == GES_ERROR_ONLOAD)
     {
         fprintf(stderr, "Unable to load the game.\n");
@@ -126,6 +411,7 @@ static GameEndStatus loadGame(char *filepath)
         return GES_ERROR_ONLOAD;
     }
     GameEndStatus status = runGame(game);
+    free(game_getNickname(game));
     game_close(game);
     return status;
 }
@@ -150,33 +436,550 @@ static GameEndStatus runGame(Game *game)
 {
     Action action;
     int end = FALSE, quitRequest = FALSE;
-    game_onStart(game);
+    play_onStart(game);
     do
     {
-        game_beforeAction(game);
+        play_beforeAction(game);
         action = ui_getAction();
         if (action == Action_YES && quitRequest)
             end = TRUE;
         else
-            quitRequest = game_onAction(game, action);
+            quitRequest = play_onAction(game, action);
     } while (!end && game_getPossibilitiesNumber(game) > 0);
-    game_onStop(game);
+    play_onStop(game);
     return game_getPossibilitiesNumber(game) == 0 ? GES_FINISHED : GES_INTERRUPT;
 }
 
+/**
+ * Replay viewer
+ * @param speed: the autoplay delay between two moves (ms)
+ * @param start: the first move displayed (-1 for the last one)
+ */
+static GameEndStatus replayGame(char *filepath, int speed, int start)
+{
+    Action action;
+    Replay *replay;
+    Game *game;
+    int end = FALSE, autoplay = FALSE, move;
+    char buf[100];
+    replay = replay_init(filepath, REPLAY_KEYFRAME_INTERVAL);
+    if (replay == NULL)
+        return GES_ERROR_ONLOAD;
+    game = replay_getGame(replay);
+    game_setCursor(game, point_empty());
+    speed = MAX(REPLAY_SPEED_MIN, MIN(speed, REPLAY_SPEED_MAX));
+    replay_seek(replay, start < 0 ? replay_getLength(replay) : start);
+    do
+    {
+        snprintf(buf, 100, "Move %d/%d - %s (%d ms/move)", replay_getPosition(replay), replay_getLength(replay),
+                 autoplay ? "playing" : "paused", speed);
+        ui_printMessage_info(buf);
+        ui_printInfos(game);
+        ui_updateGrid(game);
+        ui_refresh();
+        ui_setActionTimeout(autoplay ? speed : -1);
+        action = ui_getAction();
+        move = replay_getPosition(replay);
+        if (action == Action_CANCEL)
+            end = TRUE;
+        else if (action == Action_NONE && autoplay)
+        {
+            replay_seek(replay, move + 1);
+            autoplay = replay_getPosition(replay) < replay_getLength(replay);
+        }
+        else if (action == Action_RIGHT)
+            replay_seek(replay, move + 1);
+        else if (action == Action_LEFT)
+            replay_seek(replay, move - 1);
+        else if (action == Action_UP)
+            replay_seek(replay, move + REPLAY_KEYFRAME_INTERVAL);
+        else if (action == Action_DOWN)
+            replay_seek(replay, move - REPLAY_KEYFRAME_INTERVAL);
+        else if (action == Action_HOME || action == Action_UNDO)
+            replay_seek(replay, 0);
+        else if (action == Action_END)
+            replay_seek(replay, replay_getLength(replay));
+        else if (action == Action_GOTO)
+        {
+            ui_setActionTimeout(-1);
+            if (ui_promptNumber("Go to move:", &move) == 0)
+                replay_seek(replay, move);
+        }
+        else if (action == Action_VALID)
+        {
+            if (move == replay_getLength(replay))
+                replay_seek(replay, 0);
+            autoplay = !autoplay;
+        }
+        else if (action == Action_FASTER)
+            speed = MAX(REPLAY_SPEED_MIN, speed / 2);
+        else if (action == Action_SLOWER)
+            speed = MIN(REPLAY_SPEED_MAX, speed * 2);
+        else if (action == Action_TOGGLE_HELP)
+        {
+            game_setMode(game, game_getMode(game) == GM_SOBER ? GM_VISUAL : GM_SOBER);
+            game_computeAllPossibilities(game);
+        }
+    } while (!end);
+    ui_setActionTimeout(-1);
+    replay_close(replay);
+    return GES_FINISHED;
+}
+
+/**
+ * Ask the solver daemon the best continuation of a saved game
+ * @return 0 if success, 1 if the game file can't be read or the request failed
+ */
+static int queryServer(char *socket, char *filepath, int budget)
+{
+    char *request;
+    int length, ret;
+    FILE *file = fopen(filepath, "r");
+    if (file == NULL)
+        return 1;
+    request = malloc(SERVE_REQUEST_TEXT_MAX);
+    length = snprintf(request, SERVE_REQUEST_TEXT_MAX, "SOLVE %d\n", budget);
+    length += fread(request + length, 1, SERVE_REQUEST_TEXT_MAX - length - 4, file);
+    fclose(file);
+    if (length > 0 && request[length - 1] != '\n')
+        request[length++] = '\n';
+    strcpy(request + length, ".\n");
+    ret = serve_request(socket, request, stdout);
+    if (ret == 1)
+        fprintf(stderr, "Unable to reach the solver daemon on %s.\n", socket);
+    free(request);
+    return ret != 0;
+}
+
+/**
+ * Get the search algorithm given by --algorithm (NMCS by default)
+ * @return the algorithm, or -1 if unknown
+ */
+static int getSearchAlgorithm(int argc, char *argv[])
+{
+    char *name = 0;
+    int algorithm = SEARCH_NMCS;
+    if (util_getArgString(argc, argv, "--algorithm", &name) == 0)
+        algorithm = search_getAlgorithm(name);
+    if (algorithm < 0)
+        fprintf(stderr, "Unknown search algorithm %s.\n", name);
+    free(name);
+    return algorithm;
+}
+
+/**
+ * Get the rollout policy given by --rollout: a policy name or a weights file (uniform by default)
+ * @return 0 if success, 1 if the policy is unknown or its weights can't be read
+ */
+static int getRolloutPolicy(int argc, char *argv[], RolloutPolicy *policy)
+{
+    char *name = 0;
+    int type = ROLLOUT_UNIFORM, ret = 0;
+    if (util_getArgString(argc, argv, "--rollout", &name) == 0)
+        type = rollout_getType(name);
+    if (type == ROLLOUT_LEARNED || type < 0)
+    {
+        ret = type < 0 ? rollout_loadWeights(name, policy) : 1;
+        if (ret != 0)
+            fprintf(stderr, "Unknown rollout policy or unreadable weights file %s.\n", name);
+    }
+    else
+        rollout_init(policy, type);
+    free(name);
+    return ret;
+}
+
+/**
+ * Create the start game of a search
+ * @param from: the saved game to start from (NULL for a new game)
+ * @return the game, or NULL if the saved game can't be loaded
+ */
+static Game *loadSearchGame(char *from)
+{
+    Game *game = game_init();
+    if (from == NULL)
+        return game;
+    if (ie_importGame(from, game) != 0)
+    {
+        game_close(game);
+        return NULL;
+    }
+    free(game_getNickname(game));
+    game_setNickname(game, 0);
+    return game;
+}
+
+/**
+ * Get the save file of a search result
+ * @return 0 if success, 1 if no save file is available
+ */
+static int getSaveFile(char *nickname, char *filepath)
+{
+    str_formatOnlyAlphaAndUnderscore(nickname);
+    return ie_getAvailableFile(nickname, filepath);
+}
+
+/**
+ * Search a game without user interface
+ * @param from: the saved game to start from (NULL for a new game)
+ * @param nickname: the nickname to save the best game under (NULL to not save it)
+ * @return 0 if success, 1 if a game file error occurred
+ */
+static int searchGame(int level, int threads, char *from, char *nickname, int argc, char *argv[])
+{
+    Game *game;
+    Book *book = NULL;
+    SearchResult result;
+    RolloutPolicy rollout;
+    SearchPolicy *policy = NULL;
+    char filepath[FILENAME_BUFFER_SIZE], *bookpath = 0, *policypath = 0;
+    int iterations = 0, seconds = 0, seed = time(NULL), skip = 0, nodes = 0, ret = 0, i;
+    int algorithm = getSearchAlgorithm(argc, argv);
+    util_getArgValue(argc, argv, "--iterations", &iterations);
+    util_getArgValue(argc, argv, "--nodes", &nodes);
+    util_getArgValue(argc, argv, "--time", &seconds);
+    util_getArgValue(argc, argv, "--seed", &seed);
+    util_getArgValue(argc, argv, "--book-skip", &skip);
+    if (algorithm < 0 || getRolloutPolicy(argc, argv, &rollout) != 0)
+        return 1;
+    if (util_getArgString(argc, argv, "--book", &bookpath) == 0)
+    {
+        book = book_open(bookpath, BOOK_CAPACITY_DEFAULT);
+        if (book == NULL)
+            fprintf(stderr, "Unable to open the book %s.\n", bookpath);
+        free(bookpath);
+        if (book == NULL)
+            return 1;
+    }
+    if (algorithm < 0 || (game = loadSearchGame(from)) == NULL)
+    {
+        if (book != NULL)
+            book_close(book);
+        return 1;
+    }
+
+    if (algorithm == SEARCH_NRPA && util_getArgString(argc, argv, "--save-policy", &policypath) == 0)
+        policy = calloc(1, sizeof(SearchPolicy));
+
+    search_setBook(book, MAX(skip, 0));
+    search_setRollout(&rollout);
+    search_setTreeCapacity(nodes);
+    result = search_run(game, algorithm, level, policy, threads, iterations, seconds, (unsigned)seed);
+    search_setRollout(NULL);
+    search_setBook(NULL, 0);
+    printf("search %s level %d: score %d, %d lines (%d iterations, %lld playouts in %.3f s, %.0f playouts/s, "
+           "seed %u)\n",
+           search_getAlgorithmName(algorithm), level, result.score, game_getLinesCount(game), result.iterations,
+           result.playouts, result.seconds, result.playouts / MAX(result.seconds, 1e-9), (unsigned)seed);
+    if (algorithm == SEARCH_MCTS)
+        printf("tree: %d nodes, %d collections\n", result.treeNodes, result.treeCollections);
+    for (i = 0; result.threads > 1 && i < result.threads; i++)
+        printf("thread %d: %lld tasks, %lld steals, %lld failed steals, %.3f s idle\n", i, result.workers[i].tasks,
+               result.workers[i].steals, result.workers[i].failedSteals, result.workers[i].idleSeconds);
+    if (book != NULL)
+    {
+        printf("book: %d lines followed, %ld positions\n", result.bookLines, book_getSize(book));
+        book_close(book);
+    }
+    if (policy != NULL)
+    {
+        if (rollout_saveWeights(policypath, policy->weights) == 0)
+            printf("policy saved into %s\n", policypath);
+        else
+            fprintf(stderr, "Unable to save the policy into %s.\n", policypath);
+        free(policy);
+    }
+    free(policypath);
+
+    if (nickname != NULL)
+    {
+        if (getSaveFile(nickname, filepath) == 0)
+        {
+            game_setFilepath(game, filepath);
+            ret = ie_exportGame(game);
+        }
+        else
+            ret = 1;
+        if (ret == 0)
+            printf("saved into %s\n", filepath);
+    }
+    game_close(game);
+    return ret;
+}
+
+/**
+ * Print the size of an opening book and its statistics along the best line from the start
+ * @return 0 if success, 1 if the book can't be opened
+ */
+static int printBook(char *filepath)
+{
+    Book *book;
+    Game *game;
+    BookEntry entry;
+    Line line;
+    FILE *file = fopen(filepath, "rb");
+    if (file == NULL) // don't create a missing book
+        return 1;
+    fclose(file);
+    if ((book = book_open(filepath, BOOK_CAPACITY_DEFAULT)) == NULL)
+        return 1;
+    printf("%s: %ld positions (capacity %ld)\n", filepath, book_getSize(book), book_getCapacity(book));
+    game = game_init();
+    if (book_lookup(book, game, &entry) == 0)
+        printf("start: %u games, best score %d\n", entry.visits, entry.bestScore);
+    while (book_getBestLine(book, game, 1, &line, &entry) == 0)
+    {
+        game_consumeLine(game, line);
+        printf("%3d. %d,%d -> %d,%d: %u games, best score %d\n", game_getLinesCount(game), line.points[0].x,
+               line.points[0].y, line.points[LINE_LENGTH - 1].x, line.points[LINE_LENGTH - 1].y, entry.visits,
+               entry.bestScore);
+    }
+    game_close(game);
+    book_close(book);
+    return 0;
+}
+
+/**
+ * List the saved games from the save index
+ * @param nickname: the nickname of the games to list (NULL for all the games)
+ */
+static void listGames(char *nickname)
+{
+    SaveEntry *entries;
+    char date[32];
+    time_t mtime;
+    int i, listed = 0, count = ie_listGames(&entries);
+    for (i = 0; i < count; ++i)
+    {
+        if (nickname != NULL && strcmp(entries[i].nickname, nickname) != 0)
+            continue;
+        mtime = (time_t)(entries[i].mtime / 1000000000LL);
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&mtime));
+        printf("%s.%02d.sav: %d lines, score %d, %s\n", entries[i].nickname, entries[i].slot, entries[i].lines,
+               entries[i].score, date);
+        ++listed;
+    }
+    printf("%d saved games\n", listed);
+    free(entries);
+}
+
+/**
+ * Games visited in an archive
+ */
+typedef struct
+{
+    long long games;
+    long long lines;
+    long long textBytes; // size of the games in the save file format
+    int longest;
+} ArchiveCount;
+
+static int countDigits(int value)
+{
+    int digits = 1 + (value < 0);
+    for (value /= 10; value != 0; value /= 10)
+        ++digits;
+    return digits;
+}
+
+static void countArchived(const int *moves, int nmoves, void *data)
+{
+    ArchiveCount *count = data;
+    Line line;
+    int i, j;
+    ++count->games;
+    count->lines += nmoves;
+    count->longest = MAX(count->longest, nmoves);
+    for (i = 0; i < nmoves; ++i)
+    {
+        line_fromIndex(moves[i], &line);
+        for (j = 0; j < LINE_LENGTH; ++j) // "x y" separated by spaces, a line per row
+            count->textBytes += countDigits(line.points[j].x) + 1 + countDigits(line.points[j].y) + 1;
+    }
+}
+
+/**
+ * Add games to an archive, then print its size against the save file format
+ * @return 0 if success, 1 if the archive or a game file can't be read
+ */
+static int archiveGames(char *filepath, int argc, char *argv[])
+{
+    Archive *archive;
+    ArchiveCount count;
+    Game *game, *lanes[BATCH_LANES];
+    Line *lines;
+    unsigned long long random[BATCH_LANES];
+    int *sequences, prefix[MAX_POSSIBILITIES], lengths[BATCH_LANES], scores[BATCH_LANES];
+    int i, j, n, added, size, generate = 0, seed = time(NULL), ret = 0;
+    char *directory = 0, *from = 0;
+    double start;
+    if ((archive = archive_open(filepath)) == NULL)
+        return 1;
+    util_getArgValue(argc, argv, "--generate", &generate);
+    util_getArgValue(argc, argv, "--seed", &seed);
+    if (util_getArgString(argc, argv, "--add", &directory) == 0)
+    {
+        start = util_getTime();
+        if (archive_addDirectory(archive, directory, &added) != 0)
+        {
+            fprintf(stderr, "Unable to read the directory %s.\n", directory);
+            ret = 1;
+        }
+        else
+            printf("added %d games of %s in %.3f s\n", added, directory, util_getTime() - start);
+        free(directory);
+    }
+    if (generate > 0)
+    {
+        start = util_getTime();
+        game = game_init();
+        sequences = malloc(sizeof(int) * BATCH_LANES * MAX_POSSIBILITIES);
+        for (i = 0; i < BATCH_LANES; ++i)
+            lanes[i] = game;
+        for (i = 0, added = 0; i < generate; i += BATCH_LANES)
+        {
+            size = MIN(generate - i, BATCH_LANES);
+            for (j = 0; j < size; ++j)
+                random[j] = util_randomStream((unsigned)seed, i + j);
+            batch_playout(lanes, size, random, scores, sequences, lengths);
+            for (j = 0; j < size; ++j)
+                added += archive_addGame(archive, sequences + j * MAX_POSSIBILITIES, lengths[j]) == 0;
+        }
+        printf("generated %d games, %d added in %.3f s (seed %u)\n", generate, added, util_getTime() - start,
+               (unsigned)seed);
+        free(sequences);
+        game_close(game);
+    }
+
+    n = 0;
+    if (util_getArgString(argc, argv, "--prefix", &from) == 0)
+    {
+        game = game_init();
+        if (ie_importGame(from, game) != 0)
+        {
+            fprintf(stderr, "Unable to load the game %s.\n", from);
+            ret = 1;
+        }
+        else
+        {
+            lines = game_getLines(game, &n);
+            for (i = 0; i < n; ++i)
+                prefix[i] = line_getIndex(lines[i]);
+            free(game_getNickname(game));
+        }
+        game_close(game);
+        free(from);
+    }
+    memset(&count, 0, sizeof(ArchiveCount));
+    start = util_getTime();
+    archive_forEach(archive, prefix, n, countArchived, &count);
+    printf("%s: %lld games, %lld bytes (%.1f bytes/game)\n", filepath, archive_getGames(archive),
+           archive_getBytes(archive), (double)archive_getBytes(archive) / MAX(archive_getGames(archive), 1));
+    printf("%lld games after %d lines (longest %d lines, %.1f lines/game) visited in %.3f s,\n", count.games, n,
+           count.longest, (double)count.lines / MAX(count.games, 1), util_getTime() - start);
+    printf("%lld bytes as save files (%.1f bytes/game)\n", count.textBytes,
+           (double)count.textBytes / MAX(count.games, 1));
+    archive_close(archive);
+    return ret;
+}
+
+/**
+ * Coordinate a distributed search, the best game is saved at each improvement
+ * @return 0 if success, 1 if an error occurred
+ */
+static int coordinateSearch(char *address, int level, char *from, char *nickname, int argc, char *argv[])
+{
+    Game *game;
+    DistResult result;
+    char filepath[FILENAME_BUFFER_SIZE];
+    int units = 64, budget = 0, seed = time(NULL), ret, algorithm = getSearchAlgorithm(argc, argv);
+    util_getArgValue(argc, argv, "--units", &units);
+    util_getArgValue(argc, argv, "--budget", &budget);
+    util_getArgValue(argc, argv, "--seed", &seed);
+    if (algorithm < 0 || (game = loadSearchGame(from)) == NULL)
+        return 1;
+    if (nickname != NULL && getSaveFile(nickname, filepath) != 0)
+    {
+        game_close(game);
+        return 1;
+    }
+
+    printf("coordinating %d %s units on %s\n", units, search_getAlgorithmName(algorithm), address);
+    fflush(stdout);
+    ret = dist_coordinate(address, game, algorithm, level, units, budget, (unsigned)seed,
+                          nickname != NULL ? filepath : NULL, &result);
+    if (ret != 0)
+        fprintf(stderr, "Unable to listen on %s.\n", address);
+    else
+        printf("distributed %s level %d: score %d, %d lines (%d units, %d workers, %d units reassigned in %.3f s, "
+               "seed %u)\n",
+               search_getAlgorithmName(algorithm), level, result.score, game_getLinesCount(game), result.units,
+               result.workers, result.reassigned, result.seconds, (unsigned)seed);
+    game_close(game);
+    return ret;
+}
+
+/**
+ * Improve a saved game by large neighborhood search
+ * @param filepath: the saved game
+ * @param nickname: the nickname to save the improved games under (NULL for the nickname of the saved game)
+ * @return 0 if success, 1 if a game file error occurred
+ */
+static int improveGame(char *filepath, int level, int threads, char *nickname, int argc, char *argv[])
+{
+    Game *game;
+    ImproveResult result;
+    RolloutPolicy rollout;
+    char savepath[FILENAME_BUFFER_SIZE];
+    int window = IMPROVE_WINDOW_DEFAULT, region = IMPROVE_REGION_DEFAULT, iterations = 0, neighborhoods = 0;
+    int seconds = 0, seed = time(NULL), ret = 0, algorithm = getSearchAlgorithm(argc, argv);
+    util_getArgValue(argc, argv, "--window", &window);
+    util_getArgValue(argc, argv, "--region", &region);
+    util_getArgValue(argc, argv, "--iterations", &iterations);
+    util_getArgValue(argc, argv, "--neighborhoods", &neighborhoods);
+    util_getArgValue(argc, argv, "--time", &seconds);
+    util_getArgValue(argc, argv, "--seed", &seed);
+    if (algorithm < 0 || getRolloutPolicy(argc, argv, &rollout) != 0)
+        return 1;
+    game = game_init();
+    if (ie_importGame(filepath, game) != 0)
+    {
+        game_close(game);
+        return 1;
+    }
+    if (getSaveFile(nickname != NULL ? nickname : game_getNickname(game), savepath) != 0)
+        ret = 1;
+    else
+    {
+        printf("improving %s (score %d, %d lines), saving into %s\n", filepath, game_getScore(game),
+               game_getLinesCount(game), savepath);
+        fflush(stdout);
+        search_setRollout(&rollout);
+        result = improve_run(game, algorithm, level, window, region, threads, iterations, neighborhoods, seconds,
+                             (unsigned)seed, savepath);
+        search_setRollout(NULL);
+        printf("improve %s level %d: score %d from %d (%d improvements, %d neighborhoods searched, %d skipped "
+               "in %.3f s, seed %u)\n",
+               search_getAlgorithmName(algorithm), level, result.score, result.startScore, result.improvements,
+               result.neighborhoods, result.skipped, result.seconds, (unsigned)seed);
+    }
+    free(game_getNickname(game));
+    game_close(game);
+    return ret;
+}
+
 /**
  * Random demo
+ * @param policy: the policy drawing the moves
  */
-static void demo()
+static void demo(RolloutPolicy *policy)
 {
     Action action;
     Game *game;
     game = game_init();
-    int r;
-    int length;
+    unsigned long long random = time(NULL);
     int end = FALSE;
-    Line *lines;
-    srand(time(NULL));
+    Line line;
     game_setCursor(game, point_empty());
     game_setNickname(game, "this is a random demo");
     ui_printMessage_info("Press any key to continue...");
@@ -192,50 +995,17 @@ static void demo()
             game_setMode(game, game_getMode(game) == GM_SOBER ? GM_VISUAL : GM_SOBER);
         else
         {
-            game_computeAllPossibilities(game);
-            lines = game_getAllPossibilities(game, &length);
-            if (length > 0)
-            {
-                r = rand() % length;
-                game_consumeLine(game, lines[r]);
-            }
+            if (rollout_choose(game, policy, &random, &line) == 0)
+                game_consumeLine(game, line);
         }
     } while (!end && game_getPossibilitiesNumber(game) > 0);
     if (!end)
     {
         ui_printMessage_success("Demo has finished to play. Press <ESC> to quit.");
+        ui_celebrate();
         ui_refresh();
         while (ui_getAction() != Action_CANCEL)
             ;
     }
     game_close(game);
 }
-
-/*
- // Bonus function to bruteforce best score // seems to be 76
-static void findBestScore(int try) {
-  int best = 0, score;
-  while(try-->0) {
-    Game* game;
-    game = game_init();
-    int r;
-    int length;
-    Line* lines;
-    srand(time(NULL));
-    game_setCursor(game, point_empty());
-    do {
-      game_computeAllPossibilities(game);
-      lines = game_getAllPossibilities(game, &length);
-      if(length>0) {
-        r = rand()%length;
-        game_consumeLine(game, lines[r]);
-      }
-    } while(game_getPossibilitiesNumber(game)>0);
-    score = game_getScore(game);
-    game_close(game);
-    if(score>best)
-      best = score;
-  }
-  printf("best score found: %d\n", best);
-}
-*/
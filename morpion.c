@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "morpion.h"
+#include "batch.h"
+#include "game.h"
+#include "points.h"
+#include "globals.h"
+#include "utils.h"
+
+#if MORPION_MOVE_COUNT != LINE_INDEX_COUNT || MORPION_MOVE_POINTS != LINE_LENGTH
+#error "morpion.h constants do not match the game constants"
+#endif
+
+struct _Morpion {
+  Game* game;
+};
+
+static int morpion_toLine(int move, Line* line) {
+  return move>=0 && move<MORPION_MOVE_COUNT && line_fromIndex(move, line)==LINE_LENGTH;
+}
+
+extern Morpion* morpion_new(void) {
+  Morpion* m = malloc(sizeof(Morpion));
+  m->game = game_init();
+  return m;
+}
+
+extern Morpion* morpion_clone(Morpion* game) {
+  Morpion* m = malloc(sizeof(Morpion));
+  m->game = game_clone(game->game);
+  return m;
+}
+
+extern void morpion_free(Morpion* game) {
+  game_close(game->game);
+  free(game);
+}
+
+extern int morpion_play(Morpion* game, int move) {
+  Line line;
+  if(!morpion_toLine(move, &line) || !game_isPlayableLine(game->game, line))
+    return 1;
+  game_consumeLine(game->game, line);
+  return 0;
+}
+
+extern int morpion_undo(Morpion* game) {
+  if(game_getLinesCount(game->game)==0)
+    return 1;
+  game_undoLine(game->game);
+  return 0;
+}
+
+extern int morpion_legalMoves(Morpion* game, int* moves) {
+  int i = 0, index, length = game_computeAllPossibilities(game->game);
+  const LegalSet* legal = game_getLegalSet(game->game);
+  if(moves)
+    for(index=legalset_next(legal, 0); index>=0; index=legalset_next(legal, index+1))
+      moves[i++] = index;
+  return length;
+}
+
+extern int morpion_isLegal(Morpion* game, int move) {
+  Line line;
+  return morpion_toLine(move, &line) && game_isPlayableLine(game->game, line);
+}
+
+extern int morpion_score(Morpion* game) {
+  return game_getScore(game->game);
+}
+
+extern int morpion_history(Morpion* game, int* moves) {
+  int i, length;
+  Line* lines = game_getLines(game->game, &length);
+  if(moves)
+    for(i=0; i<length; ++i)
+      moves[i] = line_getIndex(lines[i]);
+  return length;
+}
+
+extern unsigned long long morpion_hash(Morpion* game) {
+  return game_getHash(game->game);
+}
+
+extern int morpion_movePoints(int move, int* xy) {
+  int i;
+  Line line;
+  if(!morpion_toLine(move, &line))
+    return 1;
+  for(i=0; i<LINE_LENGTH; ++i) {
+    xy[2*i] = line.points[i].x;
+    xy[2*i+1] = line.points[i].y;
+  }
+  return 0;
+}
+
+extern int morpion_serialize(Morpion* game, char* buf, int size) {
+  int i, j, n, length, total = 0;
+  Line* lines = game_getLines(game->game, &length);
+  if(size>0)
+    *buf = 0;
+  for(i=0; i<length; ++i) {
+    for(j=0; j<LINE_LENGTH; ++j) {
+      n = snprintf(total<size ? buf+total : NULL, total<size ? size-total : 0, j<LINE_LENGTH-1 ? "%d %d " : "%d %d\n",
+                   lines[i].points[j].x, lines[i].points[j].y);
+      total += n;
+    }
+  }
+  return total;
+}
+
+extern Morpion* morpion_deserialize(const char* text) {
+  Morpion* m = morpion_new();
+  Line line;
+  int i, n;
+  for(;;) {
+    for(i=0; i<LINE_LENGTH && sscanf(text, "%d %d%n", &line.points[i].x, &line.points[i].y, &n)==2; ++i)
+      text += n;
+    if(i==0)
+      break;
+    if(i<LINE_LENGTH || !line_isValid(line) || morpion_play(m, line_getIndex(line))!=0) {
+      morpion_free(m);
+      return NULL;
+    }
+  }
+  while(*text==' ' || *text=='\n' || *text=='\r' || *text=='\t')
+    ++ text;
+  if(*text) { // trailing garbage
+    morpion_free(m);
+    return NULL;
+  }
+  return m;
+}
+
+extern int morpion_playBatch(Morpion** games, const int* moves, int n, int* results) {
+  int i, result, played = 0;
+  for(i=0; i<n; ++i) {
+    result = morpion_play(games[i], moves[i]);
+    if(results)
+      results[i] = result;
+    if(result==0)
+      ++ played;
+  }
+  return played;
+}
+
+extern long morpion_playoutBatch(Morpion** games, int n, unsigned long long seed) {
+  Game* lanes[BATCH_LANES];
+  unsigned long long random[BATCH_LANES];
+  int scores[BATCH_LANES], lengths[BATCH_LANES];
+  int* sequences;
+  int i, j, k, size;
+  long played = 0;
+  Line line;
+  if(n<=0)
+    return 0;
+  sequences = malloc(sizeof(int)*BATCH_LANES*MAX_POSSIBILITIES);
+  // games are played in lockstep by batches of BATCH_LANES, then their lines are replayed on them
+  for(i=0; i<n; i+=BATCH_LANES) {
+    size = MIN(n-i, BATCH_LANES);
+    for(j=0; j<size; ++j) {
+      lanes[j] = games[i+j]->game;
+      random[j] = util_random(&seed);
+    }
+    played += batch_playout(lanes, size, random, scores, sequences, lengths);
+    for(j=0; j<size; ++j) {
+      for(k=0; k<lengths[j]; ++k) {
+        line_fromIndex(sequences[j*MAX_POSSIBILITIES+k], &line);
+        game_consumeLine(lanes[j], line);
+      }
+    }
+  }
+  free(sequences);
+  return played;
+}
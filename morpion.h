@@ -0,0 +1,137 @@
+#ifndef _MORPION_H
+#define _MORPION_H
+/**
+ * libmorpion: the embeddable Morpion Solitaire engine
+ * 
+ * A game is an opaque handle. Functions have no global state and do no I/O,
+ * so games can be used from any number of threads (one thread per game at a time).
+ * 
+ * A move is the index of a line on the grid, in [0, MORPION_MOVE_COUNT).
+ * Functions are prefixed by morpion_
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Number of different moves (lines which can be drawn on the 18x18 grid)
+ */
+#define MORPION_MOVE_COUNT 1296
+
+/**
+ * Number of points of a move
+ */
+#define MORPION_MOVE_POINTS 5
+
+/**
+ * A game handle
+ */
+typedef struct _Morpion Morpion;
+
+/**
+ * Create a game at the start cross
+ * @return the new game
+ */
+extern Morpion* morpion_new(void);
+
+/**
+ * Copy a game
+ * @return a new game in the same state as game
+ */
+extern Morpion* morpion_clone(Morpion* game);
+
+/**
+ * Free a game
+ */
+extern void morpion_free(Morpion* game);
+
+/**
+ * Play a move
+ * @param move: a move index
+ * @return 0 if the move was played, 1 if it is not legal
+ */
+extern int morpion_play(Morpion* game, int move);
+
+/**
+ * Undo the last move
+ * @return 0 if a move was undone, 1 if no move was played
+ */
+extern int morpion_undo(Morpion* game);
+
+/**
+ * Get the legal moves
+ * @param moves: array of at least MORPION_MOVE_COUNT moves (can be NULL to only count)
+ * @return the number of legal moves (0 when the game is over)
+ */
+extern int morpion_legalMoves(Morpion* game, int* moves);
+
+/**
+ * Check if a move is legal
+ * @return true if the move can be played
+ */
+extern int morpion_isLegal(Morpion* game, int move);
+
+/**
+ * Get the game score
+ */
+extern int morpion_score(Morpion* game);
+
+/**
+ * Get the played moves
+ * @param moves: array of at least morpion_length(game) moves (can be NULL to only count)
+ * @return the number of played moves
+ */
+extern int morpion_history(Morpion* game, int* moves);
+
+/**
+ * Get the position hash (independent of the order moves were played)
+ */
+extern unsigned long long morpion_hash(Morpion* game);
+
+/**
+ * Get the points of a move
+ * @param move: a move index
+ * @param xy: array of 2*MORPION_MOVE_POINTS coords, filled with x0 y0 x1 y1 ...
+ * @return 0 if success, 1 if move is not a valid index
+ */
+extern int morpion_movePoints(int move, int* xy);
+
+/**
+ * Serialize a game into the save file text format (one line of 5 points "x y" per move)
+ * @param buf: the destination buffer (can be NULL if size is 0)
+ * @param size: the buffer size, the text is truncated to fit (always null-terminated)
+ * @return the text length (without the final null): a return >= size means truncation
+ */
+extern int morpion_serialize(Morpion* game, char* buf, int size);
+
+/**
+ * Create a game from the save file text format
+ * @param text: the serialized game (null-terminated)
+ * @return the game, or NULL if the text is invalid or contains illegal moves
+ */
+extern Morpion* morpion_deserialize(const char* text);
+
+/**
+ * Play one move on each game of a batch
+ * @param games: array of n games
+ * @param moves: array of n moves, moves[i] is played on games[i]
+ * @param results: array of n results (can be NULL), filled with morpion_play results
+ * @return the number of moves played
+ */
+extern int morpion_playBatch(Morpion** games, const int* moves, int n, int* results);
+
+/**
+ * Play random moves on each game of a batch until they are over
+ * Games are played in lockstep, 64 at a time.
+ * @param games: array of n games
+ * @param seed: the random seed (the same seed gives the same games)
+ * @return the total number of moves played
+ */
+extern long morpion_playoutBatch(Morpion** games, int n, unsigned long long seed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "perft.h"
+#include "game.h"
+#include "points.h"
+#include "utils.h"
+
+#define HASHES_ALLOC_WINDOW 4096
+
+/**
+ * Work shared by all perft threads: root moves are taken one by one
+ */
+typedef struct _PerftShared {
+  pthread_mutex_t lock;
+  Line roots[MAX_POSSIBILITIES];
+  long long rootLeaves[MAX_POSSIBILITIES];
+  int nroots;
+  int next; // next root move to search
+  int depth;
+  int unique;
+} PerftShared;
+
+typedef struct _PerftWorker {
+  PerftShared* shared;
+  Game* game;
+  int* moves; // a line indices buffer per depth
+  long long nodes;
+  unsigned long long* hashes; // leaf hashes (unique count only)
+  long long nhashes;
+  long long hashes_current_max;
+} PerftWorker;
+
+static void perft_addHash(PerftWorker* w, unsigned long long hash) {
+  if(w->nhashes==w->hashes_current_max) {
+    w->hashes_current_max = MAX(HASHES_ALLOC_WINDOW, 2*w->hashes_current_max);
+    w->hashes = realloc(w->hashes, sizeof(unsigned long long)*w->hashes_current_max);
+  }
+  w->hashes[w->nhashes++] = hash;
+}
+
+static long long perft_search(PerftWorker* w, int depth) {
+  int i, index, length;
+  long long leaves = 0;
+  const LegalSet* legal;
+  int* moves;
+  Line line;
+  unsigned long long hash = game_getHash(w->game);
+  ++ w->nodes;
+  if(depth==0) {
+    if(w->shared->unique)
+      perft_addHash(w, hash);
+    return 1;
+  }
+  length = game_computeAllPossibilities(w->game);
+  legal = game_getLegalSet(w->game);
+  if(depth==1) { // bulk count the leaves
+    w->nodes += length;
+    if(w->shared->unique)
+      for(index=legalset_next(legal, 0); index>=0; index=legalset_next(legal, index+1))
+        perft_addHash(w, hash ^ line_getIndexKey(index));
+    return length;
+  }
+  moves = w->moves + depth*MAX_POSSIBILITIES;
+  for(i=0, index=legalset_next(legal, 0); index>=0; index=legalset_next(legal, index+1))
+    moves[i++] = index;
+  for(i=0; i<length; ++i) {
+    line_fromIndex(moves[i], &line);
+    game_consumeLine(w->game, line);
+    leaves += perft_search(w, depth-1);
+    game_undoLine(w->game);
+  }
+  return leaves;
+}
+
+static void* perft_worker(void* arg) {
+  PerftWorker* w = arg;
+  PerftShared* shared = w->shared;
+  int root;
+  for(;;) {
+    pthread_mutex_lock(&shared->lock);
+    root = shared->next++;
+    pthread_mutex_unlock(&shared->lock);
+    if(root>=shared->nroots)
+      break;
+    game_consumeLine(w->game, shared->roots[root]);
+    shared->rootLeaves[root] = perft_search(w, shared->depth-1);
+    game_undoLine(w->game);
+  }
+  return NULL;
+}
+
+static int perft_compareHashes(const void* a, const void* b) {
+  unsigned long long x = *(unsigned long long*)a, y = *(unsigned long long*)b;
+  return x<y ? -1 : (x>y ? 1 : 0);
+}
+
+static long long perft_countUnique(PerftWorker* workers, int nworkers) {
+  long long i, n = 0, unique = 0;
+  unsigned long long* hashes;
+  int t;
+  for(t=0; t<nworkers; ++t)
+    n += workers[t].nhashes;
+  if(n==0)
+    return 0;
+  hashes = malloc(sizeof(unsigned long long)*n);
+  for(t=0, n=0; t<nworkers; ++t) {
+    if(workers[t].nhashes>0)
+      memcpy(hashes+n, workers[t].hashes, sizeof(unsigned long long)*workers[t].nhashes);
+    n += workers[t].nhashes;
+  }
+  qsort(hashes, n, sizeof(unsigned long long), perft_compareHashes);
+  for(i=0; i<n; ++i)
+    if(i==0 || hashes[i]!=hashes[i-1])
+      ++ unique;
+  free(hashes);
+  return unique;
+}
+
+extern PerftResult perft_run(int depth, int threads, int unique, int divide) {
+  PerftResult result;
+  PerftShared shared;
+  PerftWorker* workers;
+  pthread_t* tids;
+  Line* lines;
+  Game* root;
+  int i, length;
+  double start = util_getTime();
+  
+  result.leaves = 0;
+  result.nodes = 1;
+  result.unique = unique ? 0 : -1;
+  depth = MAX(depth, 0);
+  threads = MAX(threads, 1);
+  
+  root = game_init();
+  lines = game_getAllPossibilities(root, &length);
+  if(depth==0) {
+    result.leaves = 1;
+    result.unique = unique ? 1 : -1;
+  }
+  else if(depth==1) {
+    result.leaves = length;
+    result.nodes += length;
+    if(unique)
+      result.unique = length;
+  }
+  else {
+    pthread_mutex_init(&shared.lock, NULL);
+    memcpy(shared.roots, lines, sizeof(Line)*length);
+    shared.nroots = length;
+    shared.next = 0;
+    shared.depth = depth;
+    shared.unique = unique;
+    
+    workers = malloc(sizeof(PerftWorker)*threads);
+    tids = malloc(sizeof(pthread_t)*threads);
+    for(i=0; i<threads; ++i) {
+      workers[i].shared = &shared;
+      workers[i].game = game_init();
+      workers[i].moves = malloc(sizeof(int)*MAX_POSSIBILITIES*(depth+1));
+      workers[i].nodes = 0;
+      workers[i].hashes = NULL;
+      workers[i].nhashes = 0;
+      workers[i].hashes_current_max = 0;
+      pthread_create(&tids[i], NULL, perft_worker, &workers[i]);
+    }
+    for(i=0; i<threads; ++i) {
+      pthread_join(tids[i], NULL);
+      result.nodes += workers[i].nodes;
+    }
+    for(i=0; i<length; ++i) {
+      result.leaves += shared.rootLeaves[i];
+      if(divide)
+        printf("%2d %2d - %2d %2d: %lld\n", lines[i].points[0].x, lines[i].points[0].y,
+               lines[i].points[LINE_LENGTH-1].x, lines[i].points[LINE_LENGTH-1].y, shared.rootLeaves[i]);
+    }
+    if(unique)
+      result.unique = perft_countUnique(workers, threads);
+    
+    for(i=0; i<threads; ++i) {
+      game_close(workers[i].game);
+      free(workers[i].moves);
+      free(workers[i].hashes);
+    }
+    free(workers);
+    free(tids);
+    pthread_mutex_destroy(&shared.lock);
+  }
+  game_close(root);
+  result.seconds = util_getTime() - start;
+  return result;
+}
@@ -0,0 +1,31 @@
+#ifndef _PERFT_H
+#define _PERFT_H
+/**
+ * Perft module
+ * 
+ * Count the positions reachable at a given depth from the start cross,
+ * using the game rules (game_computeAllPossibilities, game_consumeLine and game_undoLine)
+ * as the reference move generator. Root moves are split between threads.
+ */
+
+/**
+ * Perft results
+ */
+typedef struct _PerftResult {
+  long long leaves; // positions at exactly depth moves from the start
+  long long unique; // distinct leaf positions (-1 if not counted)
+  long long nodes; // positions visited
+  double seconds;
+} PerftResult;
+
+/**
+ * Run a perft from the start cross
+ * @param depth: the number of moves to play
+ * @param threads: the number of threads (root moves are shared between them)
+ * @param unique: true to also count distinct leaf positions (by hashing)
+ * @param divide: true to print the leaves count of each root move
+ * @return the perft results
+ */
+extern PerftResult perft_run(int depth, int threads, int unique, int divide);
+
+#endif
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "play.h"
+#include "game.h"
+#include "globals.h"
+#include "export.h"
+#include "points.h"
+#include "highscore.h"
+#include "saver.h"
+#include "ui.h"
+
+static void play_onActionUndo(Game* game);
+static void play_onActionValid(Game* game);
+static int play_moveCursorForAction(Action action, Point* cursor);
+static int play_saveScore(Game* game);
+
+extern void play_onStart(Game* game) {
+  saver_start();
+  game_computeAllPossibilities(game);
+  ui_printMessage_info("Move your cursor with arrows or ZSQD keys");
+  ui_updateGrid(game);
+  ui_refresh();
+}
+
+extern void play_onStop(Game* game) {
+  int rank;
+  char buf[100], buf2[100];
+  saver_stop(); // the last state is written before the save file is removed
+  if(game_getPossibilitiesNumber(game)==0) {
+    rank = play_saveScore(game);
+    if(rank)
+      snprintf(buf2, 100, " You take the %dth place!", rank);
+    else
+      *buf2 = 0;
+    snprintf(buf, 100, "Game over.%s Press <enter> to quit", buf2);
+    ui_printMessage_success(buf);
+    ui_celebrate();
+    ie_removeGame(game);
+    ui_updateGrid(game);
+    ui_printInfos(game);
+    ui_refresh();
+    while(ui_getAction() != Action_VALID);
+  }
+}
+
+static void play_onActionUndo(Game* game) {
+  game_setSelect(game, point_empty());
+  game_undoLine(game);
+  game_setLastPlayEvaluation(game, PE_NONE);
+  game_computeAllPossibilities(game);
+  saver_post(game);
+  ui_printMessage_success("Time machine has done... Going back in time!");
+}
+
+static void play_onActionValid(Game* game) {
+  int possibilitiesCount, diff;
+  int count, i;
+  Line line;
+  Point cursor = game_getCursor(game);
+  Point select = game_getSelect(game);
+  game_setSelect(game, cursor);
+  
+  if(line_isValidLineBetween(select, cursor) && line_getLineBetween(select, cursor, &line)==LINE_LENGTH) {
+    count = game_countOccupiedCases(game, line);
+    if((count==LINE_LENGTH || count==LINE_LENGTH-1) && game_isPlayableLine(game, line)) {
+      ui_printMessage_success("Line played. ");
+      possibilitiesCount = game_getPossibilitiesNumber(game);
+      game_consumeLine(game, line);
+      if(game_getLinesCount(game)) {
+        diff = game_computeAllPossibilities(game) - possibilitiesCount + 1;
+        if(diff<=-2) {
+          game_setLastPlayEvaluation(game, PE_BAD);
+        }
+        else if(diff<=1) {
+          game_setLastPlayEvaluation(game, PE_ORDINARY);
+        }
+        else if(diff<4) {
+          game_setLastPlayEvaluation(game, PE_GREAT);
+        }
+        else if(diff<7) {
+          game_setLastPlayEvaluation(game, PE_IMPRESSIVE);
+        }
+        else {
+          game_setLastPlayEvaluation(game, PE_AWESOME);
+        }
+        if(count==LINE_LENGTH)
+          game_setLastPlayEvaluation(game, MIN(PE_AWESOME, game_getLastPlayEvaluation(game)+3));
+        if(game_getLastPlayEvaluation(game)==PE_AWESOME)
+          for(i=0; i<LINE_LENGTH; ++i)
+            ui_burst(line.points[i], 16);
+      }
+      else {
+        game_setLastPlayEvaluation(game, PE_NONE);
+      }
+      saver_post(game);
+    }
+    else if(point_exists(select)) {
+      ui_printMessage_error("Invalid action. You better stop now!");
+    }
+    game_setSelect(game, point_empty());
+  }
+  else if(point_exists(select)) {
+    ui_printMessage_error("Invalid line. You better stop now!");
+    game_setSelect(game, point_empty());
+  }
+}
+
+extern void play_beforeAction(Game* game) {
+  ui_updateGrid(game);
+  ui_printInfos(game);
+  ui_refresh();
+}
+
+extern int play_onAction(Game* game, Action action) {
+  Point cursor, select;
+  if(action==Action_CANCEL && !point_exists(game_getSelect(game))) {
+    ui_printMessage_info("Quit? Oh really? [y/n]");
+    return TRUE;
+  }
+  else {
+    if(!point_exists(select))
+      ui_printMessage_info("Select the endpoint of the line by pressing <enter> or <space>");
+    else
+      ui_printMessage_info("Select a line startpoint with your cursor by pressing <enter> or <space>");
+    
+    cursor = game_getCursor(game);
+    if(play_moveCursorForAction(action, &cursor))
+      game_setCursor(game, cursor);
+    
+    else if(action==Action_UNDO && game_getLinesCount(game)>0)
+      play_onActionUndo(game);
+    else if(action==Action_TOGGLE_HELP)
+      game_setMode(game, game_getMode(game) == GM_VISUAL ? GM_SOBER : GM_VISUAL); // toggle mode
+    else if(action==Action_VALID)
+      play_onActionValid(game);
+    else if(action==Action_CANCEL)
+      game_setSelect(game, point_empty());
+    return FALSE;
+  }
+}
+
+static int play_moveCursorForAction(Action action, Point* cursor) {
+  if(action==Action_LEFT && cursor->x>0) {
+    cursor->x --;
+    return TRUE;
+  }
+  else if(action==Action_DOWN && cursor->y>0) {
+    cursor->y --;
+    return TRUE;
+  }
+  else if(action==Action_RIGHT && cursor->x<GRID_SIZE-1) {
+    cursor->x ++;
+    return TRUE;
+  }
+  else if(action==Action_UP && cursor->y<GRID_SIZE-1) {
+    cursor->y ++;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+static int play_saveScore(Game* game) {
+  int rank, i;
+  Highscore highscores[HIGHSCORE_MAX];
+  Highscore highscore;
+  highscore.score = game_getScore(game);
+  strncpy(highscore.nickname, game_getNickname(game), NICKNAME_LENGTH);
+  int length = highscore_retrieve(highscores, HIGHSCORE_MAX);
+  highscore_sort(highscores, length);
+  for(rank=0; rank<length && (highscores[rank].score>highscore.score || highscore_equals(&highscore, &highscores[rank])); ++rank);
+  if(rank<length) {
+    if(length<HIGHSCORE_MAX-1)
+      ++ length;
+    for(i=length-1; i>rank; --i)
+      highscores[i] = highscores[i-1];
+    highscores[rank] = highscore;
+  }
+  highscore_store(highscores, MIN(HIGHSCORE_MAX, length));
+  return rank>=HIGHSCORE_MAX ? 0 : rank+1;
+}
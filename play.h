@@ -0,0 +1,34 @@
+#ifndef _PLAY_H
+#define _PLAY_H
+/**
+ * Play module
+ * 
+ * Game events of an interactive game: they drive the user interface,
+ * the save file (written by the saver thread) and the highscores from the game state.
+ */
+
+#include "game.h"
+
+/**
+ * function called on game start
+ */
+extern void play_onStart(Game* game);
+
+/**
+ * function called on game stop (before closing)
+ */
+extern void play_onStop(Game* game);
+
+/**
+ * function called just before waiting ui action
+ */
+extern void play_beforeAction(Game* game);
+
+/**
+ * function called just after getting a ui action
+ * @param action: the action triggered
+ * @return true if quit is requested, false else
+ */
+extern int play_onAction(Game* game, Action action);
+
+#endif
@@ -55,6 +55,74 @@ extern int line_isValidLineBetween(Point from, Point to) {
       && (point_inSameAxis(from, to) || point_inSameDiagonal(from, to));
 }
 
+extern int line_isValid(Line line) {
+  Line l;
+  int i;
+  if(!line_isValidLineBetween(line.points[0], line.points[LINE_LENGTH-1]))
+    return FALSE;
+  line_getLineBetween(line.points[0], line.points[LINE_LENGTH-1], &l);
+  for(i=0; i<LINE_LENGTH; ++i)
+    if(!point_equals(l.points[i], line.points[i]))
+      return FALSE;
+  return TRUE;
+}
+
+extern int line_getIndex(Line line) {
+  int dx, dy, dir;
+  Point start = line.points[0];
+  dx = line.points[LINE_LENGTH-1].x - start.x;
+  dy = line.points[LINE_LENGTH-1].y - start.y;
+  if(dx<0 || (dx==0 && dy<0)) { // index lines from the other extremity
+    start = line.points[LINE_LENGTH-1];
+    dx = -dx;
+    dy = -dy;
+  }
+  if(dy==0) dir = 0;
+  else if(dx==0) dir = 1;
+  else if(dy>0) dir = 2;
+  else dir = 3;
+  return (dir*GRID_SIZE + start.x)*GRID_SIZE + start.y;
+}
+
+extern int line_fromIndex(int index, Line* line) {
+  static const int dirX[4] = {1, 0, 1, 1}, dirY[4] = {0, 1, 1, -1};
+  int dir = index/(GRID_SIZE*GRID_SIZE);
+  Point from = point_new((index/GRID_SIZE)%GRID_SIZE, index%GRID_SIZE);
+  Point to = point_new(from.x + dirX[dir]*(LINE_LENGTH-1), from.y + dirY[dir]*(LINE_LENGTH-1));
+  return line_getLineBetween(from, to, line);
+}
+
+extern Point point_transform(Point p, int symmetry) {
+  Point t = p;
+  if(symmetry & 4) { // transpose
+    t.x = p.y;
+    t.y = p.x;
+  }
+  if(symmetry & 1)
+    t.x = GRID_SIZE-1 - t.x;
+  if(symmetry & 2)
+    t.y = GRID_SIZE-1 - t.y;
+  return t;
+}
+
+extern void line_transform(Line line, int symmetry, Line* result) {
+  int i;
+  for(i=0; i<LINE_LENGTH; ++i)
+    result->points[i] = point_transform(line.points[i], symmetry);
+}
+
+extern unsigned long long line_getKey(Line line) {
+  return line_getIndexKey(line_getIndex(line));
+}
+
+extern unsigned long long line_getIndexKey(int index) {
+  // splitmix64 finalizer of the line index
+  unsigned long long z = (index+1) * 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
 extern int line_containsPoint(Line line, Point point) {
   int i;
   for(i=0; i<LINE_LENGTH; ++i)
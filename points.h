@@ -24,6 +24,16 @@ typedef struct _Line {
   Point points[LINE_LENGTH];
 } Line;
 
+/**
+ * Number of lines which can be drawn on the grid (4 directions from each point)
+ */
+#define LINE_INDEX_COUNT (4*GRID_SIZE*GRID_SIZE)
+
+/**
+ * Number of symmetries of the grid (and of the start cross): rotations and reflections
+ */
+#define SYMMETRY_COUNT 8
+
 /**
  * return the empty Point
  */
@@ -106,6 +116,56 @@ extern int line_getLineBetween(Point from, Point to, Line* line);
  */
 extern int line_isValidLineBetween(Point from, Point to);
 
+/**
+ * Check that a line holds the LINE_LENGTH consecutive points of a grid line
+ * (in either order), as a line read from a file must
+ * @param line: the line to check
+ * @return true if the line is valid
+ */
+extern int line_isValid(Line line);
+
+/**
+ * Get the index of a line among all lines of the grid
+ * Lines are indexed by direction and start point, whatever the order of their points is.
+ * @param line: a line of LINE_LENGTH points
+ * @return the line index in [0, LINE_INDEX_COUNT)
+ */
+extern int line_getIndex(Line line);
+
+/**
+ * Make the line of an index ( @see line_getIndex )
+ * @param index: a line index
+ * @param line: line to make
+ * @return the number of points stored into line
+ */
+extern int line_fromIndex(int index, Line* line);
+
+/**
+ * Get the random key of a line, used to hash sets of lines (Zobrist hashing)
+ * @param line: a line of LINE_LENGTH points
+ * @return a 64 bits key, the same for the same line
+ */
+extern unsigned long long line_getKey(Line line);
+
+/**
+ * Get the random key of a line from its index ( @see line_getKey )
+ */
+extern unsigned long long line_getIndexKey(int index);
+
+/**
+ * Get the image of a point by a symmetry of the grid
+ * @param symmetry: a symmetry in [0, SYMMETRY_COUNT), 0 is the identity
+ */
+extern Point point_transform(Point p, int symmetry);
+
+/**
+ * Get the image of a line by a symmetry of the grid ( @see point_transform )
+ * @param line: line to transform
+ * @param symmetry: a symmetry in [0, SYMMETRY_COUNT)
+ * @param result: the transformed line
+ */
+extern void line_transform(Line line, int symmetry, Line* result);
+
 /**
  * Check if a line has collisions (collinear and containing) into lines
  * @param lines: an array of lines
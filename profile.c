@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+
+#ifndef MORPION_PROFILE
+
+extern int profile_start(const char* filepath) {
+  return 1;
+}
+
+#else
+
+#include <stdatomic.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "globals.h"
+
+static const char* zoneNames[PROFILE_ZONES] = {
+  "game_computeAllPossibilities", "game_isPlayableLine", "game_consumeLine", "game_undoLine",
+  "ie_exportGame", "ui_render"
+};
+
+/**
+ * A timed scope of the trace
+ */
+typedef struct _ProfileEvent {
+  unsigned long long start; // ticks
+  unsigned int duration; // ticks
+  int zone;
+} ProfileEvent;
+
+/**
+ * The tables of a thread, written by this thread only
+ */
+typedef struct _ProfileThread {
+  int id;
+  unsigned long long histograms[PROFILE_ZONES][PROFILE_HISTOGRAM_BUCKETS];
+  unsigned long long ticks[PROFILE_ZONES]; // total
+  long long nevents; // events recorded, the trace keeps the last PROFILE_TRACE_EVENTS
+  ProfileEvent events[PROFILE_TRACE_EVENTS];
+  struct _ProfileThread* next;
+} ProfileThread;
+
+static struct {
+  atomic_int started;
+  char* filepath;
+  _Atomic(ProfileThread*) threads;
+  atomic_int nthreads;
+  unsigned long long startTicks;
+  struct timespec startTime; // to convert ticks
+} profile;
+
+static _Thread_local ProfileThread* profileThread = NULL;
+
+static inline unsigned long long profile_getTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static ProfileThread* profile_getThread() {
+  ProfileThread* thread = calloc(1, sizeof(ProfileThread));
+  thread->id = atomic_fetch_add(&profile.nthreads, 1) + 1;
+  thread->next = atomic_load(&profile.threads);
+  while(!atomic_compare_exchange_weak(&profile.threads, &thread->next, thread));
+  return profileThread = thread;
+}
+
+extern ProfileScope profile_begin(ProfileZone zone) {
+  ProfileScope scope;
+  scope.zone = atomic_load_explicit(&profile.started, memory_order_relaxed) ? (int)zone : -1;
+  scope.start = scope.zone<0 ? 0 : profile_getTicks();
+  return scope;
+}
+
+extern void profile_end(ProfileScope* scope) {
+  ProfileThread* thread;
+  ProfileEvent* event;
+  unsigned long long duration;
+  int bucket;
+  if(scope->zone<0)
+    return;
+  duration = profile_getTicks() - scope->start;
+  thread = profileThread ? profileThread : profile_getThread();
+  bucket = duration ? 63 - __builtin_clzll(duration) : 0;
+  ++ thread->histograms[scope->zone][bucket<PROFILE_HISTOGRAM_BUCKETS ? bucket : PROFILE_HISTOGRAM_BUCKETS-1];
+  thread->ticks[scope->zone] += duration;
+  if(scope->zone==PROFILE_IS_PLAYABLE_LINE) // nested in move generations, too many to trace
+    return;
+  event = &thread->events[thread->nevents++ % PROFILE_TRACE_EVENTS];
+  event->start = scope->start;
+  event->duration = duration>0xFFFFFFFFULL ? 0xFFFFFFFFU : (unsigned int)duration;
+  event->zone = scope->zone;
+}
+
+/**
+ * Write the profile as a Chrome trace: complete events ("X") in us, histograms in otherData
+ */
+static void profile_write(FILE* file, double ticksPerUs) {
+  ProfileThread* thread;
+  ProfileEvent* event;
+  long long i, first;
+  int z, b, separator = FALSE;
+  fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+  for(thread=atomic_load(&profile.threads); thread; thread=thread->next) {
+    first = thread->nevents>PROFILE_TRACE_EVENTS ? thread->nevents - PROFILE_TRACE_EVENTS : 0;
+    for(i=first; i<thread->nevents; ++i, separator=TRUE) {
+      event = &thread->events[i % PROFILE_TRACE_EVENTS];
+      fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+              separator ? ",\n" : "", zoneNames[event->zone], thread->id,
+              (long long)(event->start - profile.startTicks) / ticksPerUs, event->duration / ticksPerUs);
+    }
+  }
+  fprintf(file, "\n], \"otherData\": {\"ticks_per_us\": %.3f, \"histogram_bucket\": \"[2^i, 2^(i+1)) ticks\", "
+          "\"threads\": [", ticksPerUs);
+  for(thread=atomic_load(&profile.threads); thread; thread=thread->next) {
+    fprintf(file, "\n  {\"tid\": %d, \"events\": %lld, \"zones\": {", thread->id, thread->nevents);
+    for(z=0, separator=FALSE; z<PROFILE_ZONES; ++z) {
+      fprintf(file, "%s\n    \"%s\": {\"total_us\": %.3f, \"histogram\": [", separator ? "," : "", zoneNames[z],
+              thread->ticks[z] / ticksPerUs);
+      for(b=0; b<PROFILE_HISTOGRAM_BUCKETS; ++b)
+        fprintf(file, "%s%llu", b ? ", " : "", thread->histograms[z][b]);
+      fprintf(file, "]}");
+      separator = TRUE;
+    }
+    fprintf(file, "}}%s", thread->next ? "," : "");
+  }
+  fprintf(file, "\n]}}\n");
+}
+
+/**
+ * Write the profile file (at exit: the tables are not freed, threads may still be running)
+ */
+static void profile_dump() {
+  struct timespec now;
+  unsigned long long ticks = profile_getTicks();
+  double ns;
+  FILE* file;
+  atomic_store(&profile.started, FALSE);
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  ns = (now.tv_sec - profile.startTime.tv_sec)*1e9 + (now.tv_nsec - profile.startTime.tv_nsec);
+  if((file = fopen(profile.filepath, "w"))!=NULL) {
+    profile_write(file, ns>0 && ticks>profile.startTicks ? (ticks - profile.startTicks) / ns * 1000 : 1000);
+    fclose(file);
+  }
+}
+
+extern int profile_start(const char* filepath) {
+  FILE* file;
+  if(atomic_load(&profile.started) || (file = fopen(filepath, "w"))==NULL)
+    return 1;
+  fclose(file);
+  profile.filepath = malloc(strlen(filepath)+1);
+  strcpy(profile.filepath, filepath);
+  clock_gettime(CLOCK_MONOTONIC, &profile.startTime);
+  profile.startTicks = profile_getTicks();
+  atexit(profile_dump);
+  atomic_store(&profile.started, TRUE);
+  return 0;
+}
+
+#endif
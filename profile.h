@@ -0,0 +1,59 @@
+#ifndef _PROFILE_H
+#define _PROFILE_H
+/**
+ * Profile module
+ *
+ * Scoped timers around the engine hot paths, built only with MORPION_PROFILE defined (GCC or Clang):
+ * PROFILE_SCOPE(zone) at the top of a block times the block until it is left, whatever the return.
+ * Durations are read from the time stamp counter (RDTSC on x86, the monotonic clock elsewhere)
+ * into fixed size per-thread tables: a log2 histogram per zone, and the last PROFILE_TRACE_EVENTS
+ * timed scopes (line checks, about a thousand per move generation, only go to the histograms).
+ * Once profiling is started ( @see profile_start ), the tables are written at exit as a Chrome
+ * trace JSON file (chrome://tracing, Perfetto, speedscope), histograms in "otherData".
+ */
+
+/**
+ * Timed zones
+ */
+typedef enum {
+  PROFILE_COMPUTE_POSSIBILITIES=0,
+  PROFILE_IS_PLAYABLE_LINE,
+  PROFILE_CONSUME_LINE,
+  PROFILE_UNDO_LINE,
+  PROFILE_EXPORT,
+  PROFILE_RENDER,
+  PROFILE_ZONES
+} ProfileZone;
+
+#define PROFILE_TRACE_EVENTS 16384 // per thread, the oldest events are overwritten
+#define PROFILE_HISTOGRAM_BUCKETS 48 // bucket i counts durations in [2^i, 2^(i+1)) ticks
+
+/**
+ * Start profiling: the profile is written into a file at exit
+ * @return 0 if success, 1 if the file can't be written (or if profiling isn't built)
+ */
+extern int profile_start(const char* filepath);
+
+#ifdef MORPION_PROFILE
+
+/**
+ * A running scope
+ */
+typedef struct _ProfileScope {
+  int zone; // -1 if profiling isn't started
+  unsigned long long start; // ticks
+} ProfileScope;
+
+extern ProfileScope profile_begin(ProfileZone zone);
+extern void profile_end(ProfileScope* scope);
+
+#define PROFILE_SCOPE(zone) \
+  ProfileScope profileScope __attribute__((cleanup(profile_end), unused)) = profile_begin(zone)
+
+#else
+
+#define PROFILE_SCOPE(zone)
+
+#endif
+
+#endif
@@ -0,0 +1,159 @@
+#include <stdlib.h>
+
+#include "psys.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL 1
+#endif
+
+struct _ParticleSystem {
+  float *x, *y;
+  float *vx, *vy;
+  float *age;
+  int capacity;
+  int tail; // index of the oldest particle
+  int count;
+  int vectorized;
+  unsigned int seed; // own random state: emitting does not touch rand()
+};
+
+static int psys_index(ParticleSystem* psys, int i) {
+  i += psys->tail;
+  return i < psys->capacity ? i : i - psys->capacity;
+}
+
+static float psys_random(ParticleSystem* psys) {
+  psys->seed ^= psys->seed << 13;
+  psys->seed ^= psys->seed >> 17;
+  psys->seed ^= psys->seed << 5;
+  return (float)(psys->seed >> 8) / (float)(1 << 23) - 1.0f; // [-1, 1)
+}
+
+// integrate particles [from, to) and return how many of them are older than maxAge
+static int psys_integrateScalar(ParticleSystem* psys, int from, int to, float time, float dvx, float dvy, float maxAge) {
+  int i, expired = 0;
+  for(i=from; i<to; ++i) {
+    psys->x[i] += psys->vx[i] * time;
+    psys->y[i] += psys->vy[i] * time;
+    psys->vx[i] += dvx;
+    psys->vy[i] += dvy;
+    psys->age[i] += time;
+    expired += psys->age[i] > maxAge;
+  }
+  return expired;
+}
+
+#ifdef HAVE_AVX2_KERNEL
+__attribute__((target("avx2,popcnt")))
+static int psys_integrateAvx2(ParticleSystem* psys, int from, int to, float time, float dvx, float dvy, float maxAge) {
+  int i, expired = 0;
+  __m256 vx, vy, age;
+  const __m256 t = _mm256_set1_ps(time);
+  const __m256 ax = _mm256_set1_ps(dvx);
+  const __m256 ay = _mm256_set1_ps(dvy);
+  const __m256 limit = _mm256_set1_ps(maxAge);
+  for(i=from; i+8<=to; i+=8) {
+    vx = _mm256_loadu_ps(psys->vx + i);
+    vy = _mm256_loadu_ps(psys->vy + i);
+    _mm256_storeu_ps(psys->x + i, _mm256_add_ps(_mm256_loadu_ps(psys->x + i), _mm256_mul_ps(vx, t)));
+    _mm256_storeu_ps(psys->y + i, _mm256_add_ps(_mm256_loadu_ps(psys->y + i), _mm256_mul_ps(vy, t)));
+    _mm256_storeu_ps(psys->vx + i, _mm256_add_ps(vx, ax));
+    _mm256_storeu_ps(psys->vy + i, _mm256_add_ps(vy, ay));
+    age = _mm256_add_ps(_mm256_loadu_ps(psys->age + i), t);
+    _mm256_storeu_ps(psys->age + i, age);
+    expired += _mm_popcnt_u32(_mm256_movemask_ps(_mm256_cmp_ps(age, limit, _CMP_GT_OQ)));
+  }
+  return expired + psys_integrateScalar(psys, i, to, time, dvx, dvy, maxAge);
+}
+#endif
+
+static int psys_integrate(ParticleSystem* psys, int from, int to, float time, float dvx, float dvy, float maxAge) {
+#ifdef HAVE_AVX2_KERNEL
+  if(psys->vectorized)
+    return psys_integrateAvx2(psys, from, to, time, dvx, dvy, maxAge);
+#endif
+  return psys_integrateScalar(psys, from, to, time, dvx, dvy, maxAge);
+}
+
+extern ParticleSystem* psys_new(int capacity) {
+  ParticleSystem* psys = malloc(sizeof(ParticleSystem));
+  psys->capacity = capacity;
+  psys->x = malloc(sizeof(float)*capacity);
+  psys->y = malloc(sizeof(float)*capacity);
+  psys->vx = malloc(sizeof(float)*capacity);
+  psys->vy = malloc(sizeof(float)*capacity);
+  psys->age = malloc(sizeof(float)*capacity);
+  psys->tail = 0;
+  psys->count = 0;
+  psys->seed = 2463534242u;
+  psys_setVectorized(psys, 1);
+  return psys;
+}
+
+extern void psys_close(ParticleSystem* psys) {
+  free(psys->x);
+  free(psys->y);
+  free(psys->vx);
+  free(psys->vy);
+  free(psys->age);
+  free(psys);
+}
+
+extern int psys_setVectorized(ParticleSystem* psys, int enable) {
+#ifdef HAVE_AVX2_KERNEL
+  psys->vectorized = enable && __builtin_cpu_supports("avx2");
+#else
+  psys->vectorized = 0;
+#endif
+  return psys->vectorized;
+}
+
+extern int psys_size(ParticleSystem* psys) {
+  return psys->count;
+}
+
+extern float psys_x(ParticleSystem* psys, int i) {
+  return psys->x[psys_index(psys, i)];
+}
+
+extern float psys_y(ParticleSystem* psys, int i) {
+  return psys->y[psys_index(psys, i)];
+}
+
+extern float psys_age(ParticleSystem* psys, int i) {
+  return psys->age[psys_index(psys, i)];
+}
+
+extern void psys_emit(ParticleSystem* psys, float x, float y, float maxSpeed) {
+  int i;
+  if(psys->count==psys->capacity) {
+    i = psys->tail;
+    psys->tail = psys_index(psys, 1);
+  }
+  else
+    i = psys_index(psys, psys->count++);
+  psys->x[i] = x;
+  psys->y[i] = y;
+  psys->vx[i] = psys_random(psys) * maxSpeed;
+  psys->vy[i] = psys_random(psys) * maxSpeed;
+  psys->age[i] = 0.0f;
+}
+
+extern void psys_clear(ParticleSystem* psys) {
+  psys->tail = 0;
+  psys->count = 0;
+}
+
+extern void psys_simulate(ParticleSystem* psys, float time, float accelX, float accelY, float maxAge) {
+  int expired, end = psys->tail + psys->count;
+  float dvx = accelX * time, dvy = accelY * time;
+  if(end <= psys->capacity)
+    expired = psys_integrate(psys, psys->tail, end, time, dvx, dvy, maxAge);
+  else {
+    expired = psys_integrate(psys, psys->tail, psys->capacity, time, dvx, dvy, maxAge);
+    expired += psys_integrate(psys, 0, end - psys->capacity, time, dvx, dvy, maxAge);
+  }
+  psys->tail = psys_index(psys, expired);
+  psys->count -= expired;
+}
@@ -0,0 +1,77 @@
+#ifndef _PSYS_H
+#define _PSYS_H
+/**
+ * Particle system module
+ * 
+ * A fixed-capacity ring buffer of particles stored as a structure of arrays.
+ * Storage is allocated once: emitting into a full system overwrites the oldest particle,
+ * and expiring the oldest particles only moves the tail index.
+ * Particles are emitted in order and age at the same rate, so the oldest are always at the tail.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A particle system
+ */
+typedef struct _ParticleSystem ParticleSystem;
+
+/**
+ * Create a particle system
+ * @param capacity: the maximum number of live particles
+ */
+extern ParticleSystem* psys_new(int capacity);
+
+/**
+ * Close a particle system
+ */
+extern void psys_close(ParticleSystem* psys);
+
+/**
+ * Use the AVX2 integrator when the cpu supports it (scalar integrator else)
+ * @param enable: true to prefer the AVX2 integrator
+ * @return true if the AVX2 integrator is used
+ */
+extern int psys_setVectorized(ParticleSystem* psys, int enable);
+
+/**
+ * Get the number of live particles
+ */
+extern int psys_size(ParticleSystem* psys);
+
+/**
+ * Get the position and the age of a particle
+ * @param i: the particle index, from the oldest (0) to the newest (size-1)
+ */
+extern float psys_x(ParticleSystem* psys, int i);
+extern float psys_y(ParticleSystem* psys, int i);
+extern float psys_age(ParticleSystem* psys, int i);
+
+/**
+ * Emit a particle with a random velocity
+ * @param x, y: the start position
+ * @param maxSpeed: the maximum speed on each axis
+ */
+extern void psys_emit(ParticleSystem* psys, float x, float y, float maxSpeed);
+
+/**
+ * Remove all particles
+ */
+extern void psys_clear(ParticleSystem* psys);
+
+/**
+ * Advance all particles by one step under a global acceleration,
+ * then drop the particles older than maxAge
+ * @param time: the step duration
+ * @param accelX, accelY: the acceleration applied to all particles
+ * @param maxAge: the age after which particles are removed
+ */
+extern void psys_simulate(ParticleSystem* psys, float time, float accelX, float accelY, float maxAge);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
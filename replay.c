@@ -0,0 +1,98 @@
+#include <stdlib.h>
+
+#include "replay.h"
+#include "game.h"
+#include "export.h"
+#include "globals.h"
+
+typedef struct _Keyframe {
+  Grid grid;
+  int score;
+} Keyframe;
+
+struct _Replay {
+  Game* game; // the board at the current position
+  
+  Line* lines; // all moves of the replayed game
+  int nlines;
+  int position;
+  
+  Keyframe* keyframes; // keyframes[k] is the board after k*interval moves
+  int interval;
+};
+
+extern Replay* replay_init(char* filepath, int interval) {
+  int i, length;
+  Line* lines;
+  Game* game = game_init();
+  Replay* replay;
+  if(ie_importGame(filepath, game) != 0) {
+    game_close(game);
+    return NULL;
+  }
+  replay = malloc(sizeof(Replay));
+  replay->interval = MAX(interval, 1);
+  lines = game_getLines(game, &length);
+  replay->nlines = length;
+  replay->lines = malloc(sizeof(Line)*MAX(length, 1));
+  for(i=0; i<length; ++i)
+    replay->lines[i] = lines[i];
+  replay->keyframes = malloc(sizeof(Keyframe)*(length/replay->interval + 1));
+  
+  // replay the whole game once to take keyframes
+  replay->game = game_init();
+  game_setNickname(replay->game, game_getNickname(game));
+  game_close(game);
+  for(i=0; i<=length; ++i) {
+    if(i%replay->interval==0) {
+      replay->keyframes[i/replay->interval].grid = *game_getGrid(replay->game);
+      replay->keyframes[i/replay->interval].score = game_getScore(replay->game);
+    }
+    if(i<length)
+      game_consumeLine(replay->game, replay->lines[i]);
+  }
+  replay->position = length;
+  return replay;
+}
+
+extern void replay_close(Replay* replay) {
+  free(game_getNickname(replay->game));
+  game_close(replay->game);
+  free(replay->keyframes);
+  free(replay->lines);
+  free(replay);
+}
+
+extern Game* replay_getGame(Replay* replay) {
+  return replay->game;
+}
+
+extern int replay_getLength(Replay* replay) {
+  return replay->nlines;
+}
+
+extern int replay_getPosition(Replay* replay) {
+  return replay->position;
+}
+
+extern void replay_seek(Replay* replay, int move) {
+  int i, from;
+  Keyframe* keyframe;
+  move = MAX(0, MIN(move, replay->nlines));
+  if(move==replay->position)
+    return;
+  // play forward from the current position when it is closer than the keyframe
+  if(move>replay->position && move-replay->position < move%replay->interval) {
+    from = replay->position;
+  }
+  else {
+    from = move - move%replay->interval;
+    keyframe = &replay->keyframes[from/replay->interval];
+    game_restore(replay->game, replay->lines, from, &keyframe->grid, keyframe->score);
+  }
+  for(i=from; i<move; ++i)
+    game_consumeLine(replay->game, replay->lines[i]);
+  replay->position = move;
+  if(game_mustDisplayPossibilities(replay->game))
+    game_computeAllPossibilities(replay->game);
+}
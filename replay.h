@@ -0,0 +1,56 @@
+#ifndef _REPLAY_H
+#define _REPLAY_H
+/**
+ * Replay module
+ * 
+ * Review a saved game move by move.
+ * A board keyframe is stored every keyframe interval moves,
+ * so seeking any move costs one keyframe restore and less than interval line plays.
+ */
+
+#include "game.h"
+
+#define REPLAY_KEYFRAME_INTERVAL 8
+
+/**
+ * A replay of a saved game
+ */
+typedef struct _Replay Replay;
+
+/**
+ * Load a saved game for replay
+ * @param filepath: the filepath of the saved game
+ * @param interval: the number of moves between two keyframes
+ * @return the replay, or NULL if the game can't be loaded
+ */
+extern Replay* replay_init(char* filepath, int interval);
+
+/**
+ * Close a replay
+ */
+extern void replay_close(Replay* replay);
+
+/**
+ * Get the game displaying the current replay position
+ * @return the game reference (owned by the replay)
+ */
+extern Game* replay_getGame(Replay* replay);
+
+/**
+ * Get the number of moves of the replayed game
+ */
+extern int replay_getLength(Replay* replay);
+
+/**
+ * Get the current replay position
+ * @return the number of moves played on the board
+ */
+extern int replay_getPosition(Replay* replay);
+
+/**
+ * Jump to a move
+ * @param move: the number of moves to have played (clamped into [0, length])
+ */
+extern void replay_seek(Replay* replay, int move);
+
+#endif
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "rollout.h"
+#include "game.h"
+#include "globals.h"
+#include "points.h"
+#include "telemetry.h"
+#include "utils.h"
+
+static const char* typeNames[] = { "uniform", "mobility", "central", "learned" };
+
+extern int rollout_getType(const char* name) {
+  int i;
+  for(i=0; i<(int)(sizeof(typeNames)/sizeof(typeNames[0])); ++i)
+    if(strcmp(name, typeNames[i])==0)
+      return i;
+  return -1;
+}
+
+extern const char* rollout_getTypeName(RolloutType type) {
+  return typeNames[type];
+}
+
+extern void rollout_init(RolloutPolicy* policy, RolloutType type) {
+  policy->type = type;
+  memset(policy->weights, 0, sizeof(policy->weights));
+}
+
+extern int rollout_loadWeights(const char* filepath, RolloutPolicy* policy) {
+  FILE* file = fopen(filepath, "r");
+  float weight;
+  int index;
+  if(file==NULL)
+    return 1;
+  rollout_init(policy, ROLLOUT_LEARNED);
+  while(fscanf(file, "%d %f", &index, &weight)==2)
+    if(index>=0 && index<LINE_INDEX_COUNT)
+      policy->weights[index] = weight;
+  fclose(file);
+  return 0;
+}
+
+extern int rollout_saveWeights(const char* filepath, const float* weights) {
+  FILE* file = fopen(filepath, "w");
+  int i;
+  if(file==NULL)
+    return 1;
+  for(i=0; i<LINE_INDEX_COUNT; ++i)
+    if(weights[i]!=0)
+      fprintf(file, "%d %g\n", i, weights[i]);
+  return fclose(file)!=0;
+}
+
+static inline int rollout_isOccupied(Grid* grid, int x, int y) {
+  return x>=0 && x<GRID_SIZE && y>=0 && y<GRID_SIZE && grid->grid[x][y]!=CASE_EMPTY;
+}
+
+/**
+ * Get the point a line adds to the grid (its middle if it adds none)
+ */
+static inline Point rollout_getNewPoint(Grid* grid, Line line) {
+  int i;
+  for(i=0; i<LINE_LENGTH; ++i)
+    if(grid->grid[line.points[i].x][line.points[i].y]==CASE_EMPTY)
+      return line.points[i];
+  return line.points[LINE_LENGTH/2];
+}
+
+/**
+ * Get the center and compactness bonus of a line
+ */
+static inline int rollout_getCentrality(Grid* grid, Line line) {
+  Point p = rollout_getNewPoint(grid, line);
+  int dx, dy, neighbours = 0;
+  for(dx=-1; dx<=1; ++dx)
+    for(dy=-1; dy<=1; ++dy)
+      if((dx || dy) && rollout_isOccupied(grid, p.x+dx, p.y+dy))
+        ++ neighbours;
+  dx = abs(2*p.x - (GRID_SIZE-1)) / 2;
+  dy = abs(2*p.y - (GRID_SIZE-1)) / 2;
+  return MAX(ROLLOUT_CENTER_RADIUS - MAX(dx, dy), 0) + neighbours;
+}
+
+static inline int rollout_drawWeighted(int* weights, int n, int sum, unsigned long long* random) {
+  int i, r = util_random(random) % sum;
+  for(i=0; i<n-1 && (r -= weights[i])>=0; ++i);
+  return i;
+}
+
+/**
+ * Draw a possible line uniformly from the legal set, without making the lines
+ * @param n: the number of possibilities
+ * @return the line index
+ */
+static inline int rollout_drawUniform(Game* game, int n, unsigned long long* random) {
+  return legalset_select(game_getLegalSet(game), util_random(random) % n);
+}
+
+/**
+ * @param scratch: a game the lines are tried on
+ */
+static inline int rollout_chooseMobility(Game* game, Game* scratch, Line* lines, int n, unsigned long long* random) {
+  int weights[MAX_POSSIBILITIES];
+  int i, gain, sum = 0;
+  for(i=0; i<n; ++i) {
+    game_copy(scratch, game);
+    game_consumeLine(scratch, lines[i]);
+    gain = MAX(game_getPossibilitiesNumber(scratch) - n + 1, 0);
+    sum += weights[i] = 1 + gain*gain;
+  }
+  return rollout_drawWeighted(weights, n, sum, random);
+}
+
+static inline int rollout_chooseCentral(Game* game, Line* lines, int n, unsigned long long* random) {
+  Grid* grid = game_getGrid(game);
+  int weights[MAX_POSSIBILITIES];
+  int i, sum = 0;
+  for(i=0; i<n; ++i)
+    sum += weights[i] = 1 + rollout_getCentrality(grid, lines[i]);
+  return rollout_drawWeighted(weights, n, sum, random);
+}
+
+static inline int rollout_chooseLearned(RolloutPolicy* policy, Line* lines, int n, unsigned long long* random) {
+  float probabilities[MAX_POSSIBILITIES];
+  double sum = 0, r;
+  int i;
+  for(i=0; i<n; ++i)
+    sum += probabilities[i] = expf(policy->weights[line_getIndex(lines[i])]);
+  r = (util_random(random) >> 11) * (1.0/9007199254740992.0) * sum;
+  for(i=0; i<n-1 && (r -= probabilities[i])>=0; ++i);
+  return i;
+}
+
+extern int rollout_choose(Game* game, RolloutPolicy* policy, unsigned long long* random, Line* line) {
+  Game* scratch;
+  Line* lines;
+  int i, n;
+  if(policy->type==ROLLOUT_UNIFORM) {
+    if((n = game_getPossibilitiesNumber(game))==0)
+      return 1;
+    line_fromIndex(rollout_drawUniform(game, n, random), line);
+    return 0;
+  }
+  lines = game_getAllPossibilities(game, &n);
+  if(n==0)
+    return 1;
+  switch(policy->type) {
+    case ROLLOUT_MOBILITY:
+      scratch = game_init();
+      i = rollout_chooseMobility(game, scratch, lines, n, random);
+      game_close(scratch);
+      break;
+    case ROLLOUT_CENTRAL:
+      i = rollout_chooseCentral(game, lines, n, random);
+      break;
+    default:
+      i = rollout_chooseLearned(policy, lines, n, random);
+  }
+  *line = lines[i];
+  return 0;
+}
+
+// one game loop per policy, so that the choice is inlined into it
+
+#define ROLLOUT_LOOP(choice) \
+  while((start = telemetry_getTime(), lines = game_getAllPossibilities(game, &n), \
+         telemetry_countTime(TELEMETRY_MOVEGEN_NS, start), n>0)) { \
+    telemetry_count(TELEMETRY_MOVES, n); \
+    line = lines[choice]; \
+    if(sequence) \
+      sequence[*length] = line_getIndex(line); \
+    ++ *length; \
+    game_consumeLine(game, line); \
+  }
+
+extern int rollout_play(Game* game, RolloutPolicy* policy, unsigned long long* random, int* sequence, int* length) {
+  Game* scratch;
+  Line line, *lines;
+  long long start;
+  int n, index;
+  *length = 0;
+  switch(policy->type) {
+    case ROLLOUT_MOBILITY:
+      scratch = game_init();
+      ROLLOUT_LOOP(rollout_chooseMobility(game, scratch, lines, n, random));
+      game_close(scratch);
+      break;
+    case ROLLOUT_CENTRAL:
+      ROLLOUT_LOOP(rollout_chooseCentral(game, lines, n, random));
+      break;
+    case ROLLOUT_LEARNED:
+      ROLLOUT_LOOP(rollout_chooseLearned(policy, lines, n, random));
+      break;
+    default: // uniform: the lines are never made, moves are drawn from the legal set
+      while((start = telemetry_getTime(), n = game_getPossibilitiesNumber(game),
+             telemetry_countTime(TELEMETRY_MOVEGEN_NS, start), n>0)) {
+        telemetry_count(TELEMETRY_MOVES, n);
+        index = rollout_drawUniform(game, n, random);
+        if(sequence)
+          sequence[*length] = index;
+        ++ *length;
+        line_fromIndex(index, &line);
+        game_consumeLine(game, line);
+      }
+  }
+  return game_getScore(game);
+}
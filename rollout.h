@@ -0,0 +1,84 @@
+#ifndef _ROLLOUT_H
+#define _ROLLOUT_H
+/**
+ * Rollout module
+ *
+ * Policies ending a game with random moves (rollouts), from the fastest to the most informed:
+ *  - uniform: every possible line has the same probability.
+ *  - mobility: each line is tried, a line whose play increases the number of possible lines by
+ *    gain (the play evaluation signal) weighs 1 + gain^2. The most informed, and the slowest policy.
+ *  - central: lines are favored by the closeness of their new point to the grid center
+ *    and by the number of occupied neighbours of this point.
+ *  - learned: lines are drawn with a probability proportional to exp(weight of their line),
+ *    weights are loaded from a file ( @see rollout_loadWeights ), e.g. a policy saved by NRPA.
+ * The policy is dispatched once per rollout: each one has its own game loop.
+ */
+
+#include "game.h"
+#include "points.h"
+
+#define ROLLOUT_CENTER_RADIUS 9 // distance to the center beyond which a line gets no center bonus
+
+/**
+ * Rollout policy types
+ */
+typedef enum {
+  ROLLOUT_UNIFORM=0,
+  ROLLOUT_MOBILITY,
+  ROLLOUT_CENTRAL,
+  ROLLOUT_LEARNED
+} RolloutType;
+
+/**
+ * A rollout policy
+ */
+typedef struct _RolloutPolicy {
+  RolloutType type;
+  float weights[LINE_INDEX_COUNT]; // by line index ( @see line_getIndex ), learned policies only
+} RolloutPolicy;
+
+/**
+ * Get a policy type from its name ("uniform", "mobility", "central" or "learned")
+ * @return the type, or -1 if the name is unknown
+ */
+extern int rollout_getType(const char* name);
+
+/**
+ * Get the name of a policy type
+ */
+extern const char* rollout_getTypeName(RolloutType type);
+
+/**
+ * Init a policy of a type ( @see rollout_loadWeights for learned policies, initialized uniform)
+ */
+extern void rollout_init(RolloutPolicy* policy, RolloutType type);
+
+/**
+ * Load a learned policy: a text file of "{line index} {weight}" lines, missing lines weigh 0
+ * @return 0 if success, 1 if the file can't be read
+ */
+extern int rollout_loadWeights(const char* filepath, RolloutPolicy* policy);
+
+/**
+ * Save policy weights ( @see rollout_loadWeights ), only non-zero weights are written
+ * @return 0 if success, 1 if the file can't be written
+ */
+extern int rollout_saveWeights(const char* filepath, const float* weights);
+
+/**
+ * Draw a possible line of a game
+ * @param random: the random state ( @see util_random )
+ * @param line: will be setted by the line drawn
+ * @return 0 if a line was drawn, 1 if the game is over
+ */
+extern int rollout_choose(Game* game, RolloutPolicy* policy, unsigned long long* random, Line* line);
+
+/**
+ * End a game with lines drawn from a policy
+ * @param random: the random state ( @see util_random )
+ * @param sequence, length: will be setted by the played line indices (sequence can be NULL)
+ * @return the final score
+ */
+extern int rollout_play(Game* game, RolloutPolicy* policy, unsigned long long* random, int* sequence, int* length);
+
+#endif
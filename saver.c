@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "saver.h"
+#include "export.h"
+#include "globals.h"
+#include "utils.h"
+
+/**
+ * The state waiting to be written
+ */
+typedef struct _SaverSlot {
+  Line lines[MAX_POSSIBILITIES];
+  int nlines;
+  int score;
+  char filepath[FILENAME_BUFFER_SIZE];
+  double postedAt; // time of the oldest post merged into the slot
+  int full;
+} SaverSlot;
+
+static pthread_mutex_t saverLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t saverPosted = PTHREAD_COND_INITIALIZER; // the slot is filled, or stop is requested
+static pthread_cond_t saverDone = PTHREAD_COND_INITIALIZER; // a write ended
+static pthread_t saverThread;
+static SaverSlot saverSlot;
+static SaverSlot saverWriting; // the state being written, owned by the thread
+static int saverRunning = FALSE;
+static int saverStopping = FALSE;
+static int saverBusy = FALSE; // a write is in progress
+static double saverBusySince; // time of the post of the state being written
+static SaverStats saverStats;
+
+static void* saver_run(void* arg) {
+  double latency;
+  int failed;
+  pthread_mutex_lock(&saverLock);
+  for(;;) {
+    while(!saverSlot.full && !saverStopping)
+      pthread_cond_wait(&saverPosted, &saverLock);
+    if(!saverSlot.full) // stopping, nothing left to write
+      break;
+    // take the slot: later posts fill it again while this state is written
+    memcpy(saverWriting.lines, saverSlot.lines, sizeof(Line)*saverSlot.nlines);
+    saverWriting.nlines = saverSlot.nlines;
+    saverWriting.score = saverSlot.score;
+    strcpy(saverWriting.filepath, saverSlot.filepath);
+    saverBusySince = saverSlot.postedAt;
+    saverSlot.full = FALSE;
+    saverBusy = TRUE;
+    pthread_mutex_unlock(&saverLock);
+
+    failed = ie_exportLines(saverWriting.filepath, saverWriting.lines, saverWriting.nlines, saverWriting.score)!=0;
+
+    pthread_mutex_lock(&saverLock);
+    latency = util_getTime() - saverBusySince;
+    saverBusy = FALSE;
+    ++ saverStats.written;
+    saverStats.failed += failed;
+    saverStats.lastLatency = latency;
+    saverStats.maxLatency = MAX(saverStats.maxLatency, latency);
+    pthread_cond_broadcast(&saverDone);
+  }
+  pthread_mutex_unlock(&saverLock);
+  return NULL;
+}
+
+extern int saver_start() {
+  if(saverRunning)
+    return 0;
+  memset(&saverStats, 0, sizeof(SaverStats));
+  saverSlot.full = FALSE;
+  saverStopping = FALSE;
+  if(pthread_create(&saverThread, NULL, saver_run, NULL)!=0)
+    return 1;
+  saverRunning = TRUE;
+  return 0;
+}
+
+extern void saver_post(Game* game) {
+  int nlines;
+  Line* lines = game_getLines(game, &nlines);
+  if(!saverRunning) {
+    ++ saverStats.posted;
+    if(ie_exportGame(game)==0)
+      ++ saverStats.written;
+    else
+      ++ saverStats.failed;
+    return;
+  }
+  pthread_mutex_lock(&saverLock);
+  ++ saverStats.posted;
+  if(saverSlot.full)
+    ++ saverStats.superseded;
+  else
+    saverSlot.postedAt = util_getTime();
+  memcpy(saverSlot.lines, lines, sizeof(Line)*nlines);
+  saverSlot.nlines = nlines;
+  saverSlot.score = game_getScore(game);
+  snprintf(saverSlot.filepath, FILENAME_BUFFER_SIZE, "%s", game_getFilepath(game) ? game_getFilepath(game) : "");
+  saverSlot.full = TRUE;
+  pthread_cond_signal(&saverPosted);
+  pthread_mutex_unlock(&saverLock);
+}
+
+extern void saver_flush() {
+  if(!saverRunning)
+    return;
+  pthread_mutex_lock(&saverLock);
+  while(saverSlot.full || saverBusy)
+    pthread_cond_wait(&saverDone, &saverLock);
+  pthread_mutex_unlock(&saverLock);
+}
+
+extern void saver_stop() {
+  if(!saverRunning)
+    return;
+  // the thread writes the state left in the slot before it stops
+  pthread_mutex_lock(&saverLock);
+  saverStopping = TRUE;
+  pthread_cond_signal(&saverPosted);
+  pthread_mutex_unlock(&saverLock);
+  pthread_join(saverThread, NULL);
+  saverRunning = FALSE;
+}
+
+extern int saver_isRunning() {
+  return saverRunning;
+}
+
+extern void saver_getStats(SaverStats* stats) {
+  double now = util_getTime();
+  pthread_mutex_lock(&saverLock);
+  *stats = saverStats;
+  // the oldest state not written yet is the one being written, else the one in the slot
+  stats->pending = saverBusy ? now - saverBusySince : (saverSlot.full ? now - saverSlot.postedAt : 0);
+  pthread_mutex_unlock(&saverLock);
+}
@@ -0,0 +1,60 @@
+#ifndef _SAVER_H
+#define _SAVER_H
+/**
+ * Saver module
+ *
+ * Saves the interactive game from a background thread, so a slow file system doesn't delay the
+ * next frame. Each play or undo posts the lines of the game into a single slot: a state posted
+ * while the previous one is still waiting replaces it (the latest state wins), so the save file
+ * is at most one write behind the game.
+ * Without the thread (not started, or it couldn't be created), a post saves the game at once.
+ */
+
+#include "game.h"
+
+/**
+ * Saver statistics
+ */
+typedef struct _SaverStats {
+  long posted; // states posted
+  long written; // states written
+  long superseded; // states replaced by a later one before being written
+  long failed; // writes which failed
+  double pending; // seconds the oldest state not written yet has waited, 0 if none
+  double lastLatency; // seconds from the post of the last state written to the end of its write
+  double maxLatency;
+} SaverStats;
+
+/**
+ * Start the saver thread
+ * @return 0 if success, 1 if the thread can't be created (posts are then saved at once)
+ */
+extern int saver_start();
+
+/**
+ * Post the state of a game to save into its file ( @see game_getFilepath )
+ */
+extern void saver_post(Game* game);
+
+/**
+ * Wait until the last state posted is written
+ */
+extern void saver_flush();
+
+/**
+ * Flush the last state posted and stop the saver thread
+ */
+extern void saver_stop();
+
+/**
+ * @return TRUE if the saver thread is running
+ */
+extern int saver_isRunning();
+
+/**
+ * Get the saver statistics
+ * @param stats: will be setted by the statistics
+ */
+extern void saver_getStats(SaverStats* stats);
+
+#endif
@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "scheduler.h"
+#include "globals.h"
+#include "utils.h"
+
+#define SCHED_SLEEP_NS 1000000 // an idle thread looks for tasks at least every ms
+#define SCHED_SPINS 16 // failed rounds before an idle thread sleeps
+
+/**
+ * A Chase-Lev deque: the owner pushes and takes at the bottom, thieves steal at the top
+ */
+typedef struct _SchedDeque {
+  atomic_llong top;
+  atomic_llong bottom;
+  _Atomic(SchedTask*) tasks[SCHED_DEQUE_SIZE];
+} SchedDeque;
+
+typedef struct _SchedThread {
+  Scheduler* scheduler;
+  int index;
+  pthread_t thread;
+  unsigned long long random; // victims order
+  atomic_llong tasks, steals, failedSteals, idleNs; // written by the thread only
+  SchedDeque deque;
+} SchedThread;
+
+struct _Scheduler {
+  int nthreads;
+  SchedThread* threads;
+  void (*start)(void);
+  void (*stop)(void);
+  atomic_int cancelled;
+  atomic_int stopping;
+  pthread_mutex_t lock; // root queue and sleeps
+  pthread_cond_t wake; // a task was spawned or a group is done
+  atomic_int sleepers;
+  SchedTask* rootFirst; // root queue
+  SchedTask* rootLast;
+  atomic_int roots;
+};
+
+static _Thread_local SchedThread* schedThread = NULL;
+
+/// Deque (Le, Pop, Cohen, Zappa Nardelli: Correct and efficient work-stealing for weak memory models)
+
+/**
+ * Push a task (owner only)
+ * @return 0 if success, 1 if the deque is full
+ */
+static int sched_push(SchedDeque* deque, SchedTask* task) {
+  long long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+  long long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+  if(bottom-top>=SCHED_DEQUE_SIZE)
+    return 1;
+  atomic_store_explicit(&deque->tasks[bottom & (SCHED_DEQUE_SIZE-1)], task, memory_order_relaxed);
+  atomic_store_explicit(&deque->bottom, bottom+1, memory_order_release);
+  return 0;
+}
+
+/**
+ * Take the last pushed task (owner only)
+ * @return the task, NULL if the deque is empty
+ */
+static SchedTask* sched_take(SchedDeque* deque) {
+  long long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+  long long top;
+  SchedTask* task = NULL;
+  atomic_store_explicit(&deque->bottom, bottom, memory_order_seq_cst);
+  top = atomic_load_explicit(&deque->top, memory_order_seq_cst);
+  if(top<=bottom) {
+    task = atomic_load_explicit(&deque->tasks[bottom & (SCHED_DEQUE_SIZE-1)], memory_order_relaxed);
+    if(top<bottom)
+      return task;
+    // the last task: thieves may take it too
+    if(!atomic_compare_exchange_strong_explicit(&deque->top, &top, top+1, memory_order_seq_cst, memory_order_relaxed))
+      task = NULL;
+  }
+  atomic_store_explicit(&deque->bottom, bottom+1, memory_order_relaxed);
+  return task;
+}
+
+/**
+ * Steal the first pushed task (any thread)
+ * @return the task, NULL if the deque is empty or if another thread took it first
+ */
+static SchedTask* sched_steal(SchedDeque* deque) {
+  long long top = atomic_load_explicit(&deque->top, memory_order_seq_cst);
+  long long bottom = atomic_load_explicit(&deque->bottom, memory_order_seq_cst);
+  SchedTask* task;
+  if(top>=bottom)
+    return NULL;
+  task = atomic_load_explicit(&deque->tasks[top & (SCHED_DEQUE_SIZE-1)], memory_order_relaxed);
+  if(!atomic_compare_exchange_strong_explicit(&deque->top, &top, top+1, memory_order_seq_cst, memory_order_relaxed))
+    return NULL;
+  return task;
+}
+
+/// Threads
+
+static inline void sched_add(atomic_llong* counter, long long n) {
+  atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+static void sched_execute(SchedThread* thread, SchedTask* task) {
+  Scheduler* scheduler = thread->scheduler;
+  SchedGroup* group = task->group;
+  task->run(task);
+  sched_add(&thread->tasks, 1);
+  // the group can be freed by its waiter as soon as it is done
+  if(atomic_fetch_sub(&group->pending, 1)==1 && atomic_load(&scheduler->sleepers)>0) {
+    pthread_mutex_lock(&scheduler->lock);
+    pthread_cond_broadcast(&scheduler->wake);
+    pthread_mutex_unlock(&scheduler->lock);
+  }
+}
+
+/**
+ * Find a task: the last one of the thread, else one stolen from another thread, else a root task
+ * @param root: TRUE to take root tasks
+ * @return the task, NULL if none was found
+ */
+static SchedTask* sched_find(SchedThread* thread, int root) {
+  Scheduler* scheduler = thread->scheduler;
+  SchedTask* task;
+  int i, victim, start;
+  if((task = sched_take(&thread->deque))!=NULL)
+    return task;
+  start = util_random(&thread->random) % scheduler->nthreads;
+  for(i=0; i<scheduler->nthreads; ++i) {
+    victim = (start+i) % scheduler->nthreads;
+    if(victim!=thread->index && (task = sched_steal(&scheduler->threads[victim].deque))!=NULL) {
+      sched_add(&thread->steals, 1);
+      return task;
+    }
+  }
+  if(scheduler->nthreads>1)
+    sched_add(&thread->failedSteals, 1);
+  if(!root || atomic_load(&scheduler->roots)==0)
+    return NULL;
+  pthread_mutex_lock(&scheduler->lock);
+  if((task = scheduler->rootFirst)!=NULL) {
+    scheduler->rootFirst = task->next;
+    if(scheduler->rootFirst==NULL)
+      scheduler->rootLast = NULL;
+    atomic_fetch_sub(&scheduler->roots, 1);
+  }
+  pthread_mutex_unlock(&scheduler->lock);
+  return task;
+}
+
+/**
+ * Sleep until a task is spawned, a group is done, or for at most SCHED_SLEEP_NS
+ * @param pending: the tasks of the group waited for, no sleep if 0 (NULL: no sleep if a root task is queued)
+ */
+static void sched_sleep(Scheduler* scheduler, atomic_int* pending) {
+  struct timespec deadline;
+  long long ns;
+  pthread_mutex_lock(&scheduler->lock);
+  atomic_fetch_add(&scheduler->sleepers, 1);
+  if(!atomic_load(&scheduler->stopping) && (pending ? atomic_load(pending)>0 : atomic_load(&scheduler->roots)==0)) {
+    clock_gettime(CLOCK_REALTIME, &deadline); // the clock of the condition
+    ns = deadline.tv_nsec + SCHED_SLEEP_NS;
+    deadline.tv_sec += ns/1000000000LL;
+    deadline.tv_nsec = ns%1000000000LL;
+    pthread_cond_timedwait(&scheduler->wake, &scheduler->lock, &deadline);
+  }
+  atomic_fetch_sub(&scheduler->sleepers, 1);
+  pthread_mutex_unlock(&scheduler->lock);
+}
+
+/**
+ * Look for tasks to run until a group is done (or until the scheduler stops if group is NULL)
+ */
+static void sched_loop(SchedThread* thread, SchedGroup* group) {
+  Scheduler* scheduler = thread->scheduler;
+  SchedTask* task;
+  double idle = 0;
+  int spins = 0;
+  while(group ? atomic_load(&group->pending)>0 : !atomic_load(&scheduler->stopping)) {
+    if((task = sched_find(thread, group==NULL))!=NULL) {
+      if(idle>0)
+        sched_add(&thread->idleNs, (long long)((util_getTime() - idle)*1e9));
+      idle = 0;
+      spins = 0;
+      sched_execute(thread, task);
+      continue;
+    }
+    if(idle==0)
+      idle = util_getTime();
+    if(++spins<SCHED_SPINS)
+      sched_yield();
+    else
+      sched_sleep(scheduler, group ? &group->pending : NULL);
+  }
+  if(idle>0)
+    sched_add(&thread->idleNs, (long long)((util_getTime() - idle)*1e9));
+}
+
+static void* sched_thread(void* arg) {
+  SchedThread* thread = arg;
+  schedThread = thread;
+  if(thread->scheduler->start)
+    thread->scheduler->start();
+  sched_loop(thread, NULL);
+  if(thread->scheduler->stop)
+    thread->scheduler->stop();
+  schedThread = NULL;
+  return NULL;
+}
+
+/// Scheduler
+
+extern Scheduler* sched_new(int threads, void (*start)(void), void (*stop)(void)) {
+  Scheduler* scheduler = malloc(sizeof(Scheduler));
+  SchedThread* thread;
+  int i;
+  scheduler->nthreads = MIN(MAX(threads, 1), SCHED_MAX_THREADS);
+  scheduler->threads = calloc(scheduler->nthreads, sizeof(SchedThread));
+  scheduler->start = start;
+  scheduler->stop = stop;
+  atomic_init(&scheduler->cancelled, FALSE);
+  atomic_init(&scheduler->stopping, FALSE);
+  atomic_init(&scheduler->sleepers, 0);
+  atomic_init(&scheduler->roots, 0);
+  scheduler->rootFirst = scheduler->rootLast = NULL;
+  pthread_mutex_init(&scheduler->lock, NULL);
+  pthread_cond_init(&scheduler->wake, NULL);
+  for(i=0; i<scheduler->nthreads; ++i) {
+    thread = &scheduler->threads[i];
+    thread->scheduler = scheduler;
+    thread->index = i;
+    thread->random = i+1;
+  }
+  for(i=0; i<scheduler->nthreads; ++i)
+    pthread_create(&scheduler->threads[i].thread, NULL, sched_thread, &scheduler->threads[i]);
+  return scheduler;
+}
+
+extern void sched_close(Scheduler* scheduler) {
+  int i;
+  pthread_mutex_lock(&scheduler->lock);
+  atomic_store(&scheduler->stopping, TRUE);
+  pthread_cond_broadcast(&scheduler->wake);
+  pthread_mutex_unlock(&scheduler->lock);
+  for(i=0; i<scheduler->nthreads; ++i)
+    pthread_join(scheduler->threads[i].thread, NULL);
+  pthread_cond_destroy(&scheduler->wake);
+  pthread_mutex_destroy(&scheduler->lock);
+  free(scheduler->threads);
+  free(scheduler);
+}
+
+extern int sched_getThreads(Scheduler* scheduler) {
+  return scheduler->nthreads;
+}
+
+extern int sched_getThread(Scheduler* scheduler) {
+  return schedThread && schedThread->scheduler==scheduler ? schedThread->index : -1;
+}
+
+extern void sched_initGroup(SchedGroup* group) {
+  atomic_init(&group->pending, 0);
+}
+
+extern void sched_spawn(Scheduler* scheduler, SchedTask* task, SchedGroup* group) {
+  SchedThread* thread = schedThread;
+  task->group = group;
+  task->next = NULL;
+  atomic_fetch_add(&group->pending, 1);
+  if(thread && thread->scheduler==scheduler) {
+    if(sched_push(&thread->deque, task)!=0) { // full
+      sched_execute(thread, task);
+      return;
+    }
+    if(atomic_load(&scheduler->sleepers)==0)
+      return;
+    pthread_mutex_lock(&scheduler->lock);
+  }
+  else {
+    pthread_mutex_lock(&scheduler->lock);
+    if(scheduler->rootLast)
+      scheduler->rootLast->next = task;
+    else
+      scheduler->rootFirst = task;
+    scheduler->rootLast = task;
+    atomic_fetch_add(&scheduler->roots, 1);
+  }
+  pthread_cond_signal(&scheduler->wake);
+  pthread_mutex_unlock(&scheduler->lock);
+}
+
+extern void sched_wait(Scheduler* scheduler, SchedGroup* group) {
+  SchedThread* thread = schedThread;
+  if(thread && thread->scheduler==scheduler) {
+    sched_loop(thread, group);
+    return;
+  }
+  while(atomic_load(&group->pending)>0)
+    sched_sleep(scheduler, &group->pending);
+}
+
+extern void sched_cancel(Scheduler* scheduler) {
+  atomic_store(&scheduler->cancelled, TRUE);
+}
+
+extern int sched_isCancelled(Scheduler* scheduler) {
+  return atomic_load_explicit(&scheduler->cancelled, memory_order_relaxed);
+}
+
+extern void sched_getStats(Scheduler* scheduler, int thread, SchedStats* stats) {
+  SchedThread* t = &scheduler->threads[thread];
+  stats->tasks = atomic_load(&t->tasks);
+  stats->steals = atomic_load(&t->steals);
+  stats->failedSteals = atomic_load(&t->failedSteals);
+  stats->idleSeconds = atomic_load(&t->idleNs) / 1e9;
+}
@@ -0,0 +1,111 @@
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+/**
+ * Scheduler module
+ *
+ * A work-stealing pool of threads running fork-join tasks.
+ * Each thread owns a Chase-Lev deque: it pushes and takes its tasks at the bottom, idle threads
+ * steal from the top of the others. A task spawns children into a group and waits for the group:
+ * while waiting, its thread runs its own tasks and steals, so a thread never blocks on a join.
+ * Tasks spawned from outside of the pool (root tasks) go to a shared queue, only taken by idle
+ * threads (a waiting thread doesn't start a root task).
+ * Tasks are owned by the caller: the scheduler doesn't allocate per task.
+ */
+
+#include <stdatomic.h>
+
+#define SCHED_MAX_THREADS 64
+#define SCHED_DEQUE_SIZE 4096 // tasks per thread, a task spawned into a full deque is run at once
+
+/**
+ * A scheduler
+ */
+typedef struct _Scheduler Scheduler;
+
+/**
+ * A group of tasks, waited for together ( @see sched_wait )
+ */
+typedef struct _SchedGroup {
+  atomic_int pending; // tasks spawned and not done
+} SchedGroup;
+
+/**
+ * A task: to be embedded at the start of the caller task structure
+ */
+typedef struct _SchedTask {
+  void (*run)(struct _SchedTask* task);
+  SchedGroup* group;
+  struct _SchedTask* next; // in the root queue
+} SchedTask;
+
+/**
+ * Statistics of a thread
+ */
+typedef struct _SchedStats {
+  long long tasks; // tasks run
+  long long steals; // tasks stolen from other threads
+  long long failedSteals; // steal attempts finding no task
+  double idleSeconds; // time spent looking for a task
+} SchedStats;
+
+/**
+ * Create a scheduler and start its threads
+ * @param threads: the number of threads, in [1, SCHED_MAX_THREADS]
+ * @param start, stop: called by each thread when it starts and stops (can be NULL)
+ * @return the scheduler
+ */
+extern Scheduler* sched_new(int threads, void (*start)(void), void (*stop)(void));
+
+/**
+ * Stop the threads of a scheduler (once its tasks are done) and free it
+ */
+extern void sched_close(Scheduler* scheduler);
+
+/**
+ * Get the number of threads of a scheduler
+ */
+extern int sched_getThreads(Scheduler* scheduler);
+
+/**
+ * Get the index of the calling thread in a scheduler
+ * @return the index in [0, threads), -1 if the thread isn't one of the scheduler
+ */
+extern int sched_getThread(Scheduler* scheduler);
+
+/**
+ * Initialize an empty group
+ */
+extern void sched_initGroup(SchedGroup* group);
+
+/**
+ * Spawn a task: it will be run by a thread of the scheduler
+ * @param task: the task, with its run function set, valid until it is done
+ * @param group: the group the task is waited with
+ */
+extern void sched_spawn(Scheduler* scheduler, SchedTask* task, SchedGroup* group);
+
+/**
+ * Wait until the tasks of a group are done
+ * From a thread of the scheduler, other tasks are run in the meantime.
+ */
+extern void sched_wait(Scheduler* scheduler, SchedGroup* group);
+
+/**
+ * Cancel the tasks of a scheduler: tasks still run, and are expected to check sched_isCancelled
+ * to return at once
+ */
+extern void sched_cancel(Scheduler* scheduler);
+
+/**
+ * @return TRUE if the scheduler was cancelled
+ */
+extern int sched_isCancelled(Scheduler* scheduler);
+
+/**
+ * Get the statistics of a thread of a scheduler
+ * @param thread: in [0, threads)
+ * @param stats: will be setted by the statistics
+ */
+extern void sched_getStats(Scheduler* scheduler, int thread, SchedStats* stats);
+
+#endif
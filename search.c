@@ -0,0 +1,894 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "search.h"
+#include "arena.h"
+#include "book.h"
+#include "game.h"
+#include "points.h"
+#include "rollout.h"
+#include "scheduler.h"
+#include "telemetry.h"
+#include "tree.h"
+#include "utils.h"
+
+#define SEARCH_ARENA_BLOCK (256*1024)
+#define SEARCH_MAX_LINES LINE_INDEX_COUNT // a line can't be played twice
+
+static const char* algorithmNames[] = { "nmcs", "nrpa", "beam", "mcts" };
+
+static RolloutPolicy uniformRollout; // zero initialized: ROLLOUT_UNIFORM
+static RolloutPolicy* searchRollout = &uniformRollout;
+static Book* searchBook = NULL;
+static unsigned int searchBookSkip = 0;
+static int searchTreeCapacity = TREE_CAPACITY_DEFAULT;
+
+/**
+ * Work shared by all search threads: iterations are taken one by one
+ * The searches of a batch share the threads of one scheduler, each has its own workers.
+ */
+typedef struct _SearchShared {
+  pthread_mutex_t lock;
+  Scheduler* scheduler;
+  struct _SearchWorker* workers; // by scheduler thread
+  Game* root;
+  SearchAlgorithm algorithm;
+  int level;
+  SearchPolicy* policy; // start policy (NRPA), NULL for uniform
+  int iterations; // 0 for no limit
+  int next; // next iteration to run
+  int completed;
+  double deadline; // 0 for no limit
+  atomic_int stopped; // the deadline is reached
+  unsigned long long seed;
+  int bestScore;
+  int bestIteration;
+  int* bestSequence; // line indices played from the root
+  int bestLength;
+  SearchPolicy* bestPolicy; // policy of the best iteration (NRPA)
+  Tree* tree; // MCTS
+} SearchShared;
+
+/**
+ * The state of a scheduler thread
+ * Tasks run inside a waiting task end before it goes on: arena memory and games are taken and
+ * given back in stack order.
+ */
+typedef struct _SearchWorker {
+  SearchShared* shared;
+  Arena* arena; // move lists, sequences and policies of the running tasks
+  Game** games; // a stack of games, created on demand
+  int ngames;
+  int top; // games in use
+  unsigned long long random; // random state of the running task
+  long long playouts;
+} SearchWorker;
+
+/**
+ * A task running the iterations of a search
+ */
+typedef struct _SearchLoop {
+  SchedTask task;
+  SearchShared* shared;
+} SearchLoop;
+
+/**
+ * The best child of an NMCS step, updated by the child tasks
+ */
+typedef struct _SearchStep {
+  pthread_mutex_t lock;
+  int bestScore;
+  int bestChild; // the first child in line index order among the best ones
+  int* sequence; // of the best child, after its move
+  int length;
+} SearchStep;
+
+/**
+ * An MCTS iteration: the descent of the tree, then the random game of a task
+ */
+typedef struct _SearchDescent {
+  SchedTask task;
+  SearchShared* shared;
+  Game* game; // the leaf position, then the final one
+  int* path; // nodes from the root
+  int depth;
+  int* sequence; // lines played from the root
+  int length;
+  int score;
+  unsigned long long random;
+} SearchDescent;
+
+/**
+ * A task evaluating a move of an NMCS step by a search of the level below
+ */
+typedef struct _SearchChild {
+  SchedTask task;
+  SearchShared* shared;
+  SearchStep* step;
+  Game* parent; // not changed until the step is done
+  int level;
+  int child;
+  int move;
+  unsigned long long random;
+} SearchChild;
+
+/**
+ * A child position of a beam, evaluated by a random game
+ */
+typedef struct _SearchCandidate {
+  int parent; // in the beam
+  int move; // line index
+  int score;
+  unsigned long long hash;
+} SearchCandidate;
+
+extern int search_getAlgorithm(const char* name) {
+  int i;
+  for(i=0; i<(int)(sizeof(algorithmNames)/sizeof(algorithmNames[0])); ++i)
+    if(strcmp(name, algorithmNames[i])==0)
+      return i;
+  return -1;
+}
+
+extern const char* search_getAlgorithmName(SearchAlgorithm algorithm) {
+  return algorithmNames[algorithm];
+}
+
+extern void search_setRollout(RolloutPolicy* policy) {
+  searchRollout = policy ? policy : &uniformRollout;
+}
+
+extern void search_setBook(Book* book, unsigned int skipVisits) {
+  searchBook = book;
+  searchBookSkip = skipVisits;
+}
+
+extern void search_setTreeCapacity(int capacity) {
+  searchTreeCapacity = capacity>0 ? capacity : TREE_CAPACITY_DEFAULT;
+}
+
+static int search_isStopped(SearchWorker* w) {
+  SearchShared* shared = w->shared;
+  if(shared->deadline>0 && util_getTime()>=shared->deadline)
+    atomic_store(&shared->stopped, TRUE); // the pending tasks of the search return at once
+  return atomic_load(&shared->stopped);
+}
+
+/**
+ * Get the worker of the calling scheduler thread
+ */
+static SearchWorker* search_getWorker(SearchShared* shared) {
+  return &shared->workers[sched_getThread(shared->scheduler)];
+}
+
+/**
+ * Take a game from the stack of a worker
+ */
+static Game* search_pushGame(SearchWorker* w) {
+  if(w->top==w->ngames) {
+    w->games = realloc(w->games, sizeof(Game*)*(w->ngames+1));
+    w->games[w->ngames++] = game_init();
+  }
+  return w->games[w->top++];
+}
+
+/**
+ * Give back the last games taken from the stack of a worker
+ */
+static void search_popGames(SearchWorker* w, int n) {
+  w->top -= n;
+}
+
+/**
+ * Get the line indices played in a game since the root
+ * @return the number of lines
+ */
+static int search_getSequence(SearchWorker* w, Game* game, int* sequence) {
+  int i, length;
+  Line* lines = game_getLines(game, &length);
+  int start = game_getLinesCount(w->shared->root);
+  for(i=start; i<length; ++i)
+    sequence[i-start] = line_getIndex(lines[i]);
+  return length-start;
+}
+
+/**
+ * End a game with moves drawn from the rollout policy
+ * @param sequence, length: will be setted by the played lines
+ * @return the final score
+ */
+static int search_playout(SearchWorker* w, Game* game, int* sequence, int* length) {
+  int score = rollout_play(game, searchRollout, &w->random, sequence, length);
+  ++ w->playouts;
+  telemetry_count(TELEMETRY_PLAYOUTS, 1);
+  telemetry_score(score);
+  return score;
+}
+
+static int search_nested(SearchWorker* w, int level, Game* start, int* sequence, int* length);
+
+/**
+ * Evaluate a move of an NMCS step: play it and search the position at the level below
+ */
+static void search_runChild(SchedTask* task) {
+  SearchChild* c = (SearchChild*)task;
+  SearchWorker* w = search_getWorker(c->shared);
+  SearchStep* step = c->step;
+  ArenaMark mark;
+  unsigned long long random;
+  int* sequence;
+  int score, length;
+  Game* game;
+  Line line;
+  if(search_isStopped(w))
+    return;
+  mark = arena_getMark(w->arena);
+  sequence = arena_alloc(w->arena, sizeof(int)*SEARCH_MAX_LINES);
+  random = w->random; // of a task waiting on this thread
+  w->random = c->random;
+  game = search_pushGame(w);
+  game_copy(game, c->parent);
+  line_fromIndex(c->move, &line);
+  game_consumeLine(game, line);
+  telemetry_count(TELEMETRY_NODES, 1);
+  if(c->level==0)
+    score = search_playout(w, game, sequence, &length);
+  else
+    score = search_nested(w, c->level, game, sequence, &length);
+  search_popGames(w, 1);
+  w->random = random;
+  pthread_mutex_lock(&step->lock);
+  if(score>step->bestScore || (score==step->bestScore && c->child<step->bestChild)) {
+    step->bestScore = score;
+    step->bestChild = c->child;
+    step->length = length;
+    memcpy(step->sequence, sequence, sizeof(int)*length);
+  }
+  pthread_mutex_unlock(&step->lock);
+  arena_rewind(w->arena, mark);
+}
+
+/**
+ * Nested search of a position: the moves of each step are evaluated by child tasks
+ * The results don't depend on the order the tasks run in: each child has its own random stream,
+ * and ties go to the first move in line index order.
+ * @param start: the position, not changed
+ * @param sequence, length: will be setted by the best sequence found
+ * @return the best score found
+ */
+static int search_nested(SearchWorker* w, int level, Game* start, int* sequence, int* length) {
+  Scheduler* scheduler = w->shared->scheduler;
+  Game* game = search_pushGame(w);
+  ArenaMark mark = arena_getMark(w->arena);
+  SearchChild* children = arena_alloc(w->arena, sizeof(SearchChild)*MAX_POSSIBILITIES);
+  SearchStep step;
+  SchedGroup group;
+  const LegalSet* legal;
+  unsigned long long random;
+  int i, n, index, bestScore = -1, played = 0;
+  Line line;
+  step.sequence = arena_alloc(w->arena, sizeof(int)*SEARCH_MAX_LINES);
+  pthread_mutex_init(&step.lock, NULL);
+  game_copy(game, start);
+  *length = 0;
+  while(!search_isStopped(w) && (n = game_getPossibilitiesNumber(game))>0) {
+    legal = game_getLegalSet(game);
+    step.bestScore = -1;
+    step.bestChild = n;
+    step.length = 0;
+    random = util_random(&w->random);
+    sched_initGroup(&group);
+    for(i=0, index=legalset_next(legal, 0); index>=0; index=legalset_next(legal, index+1), ++i) {
+      children[i].task.run = search_runChild;
+      children[i].shared = w->shared;
+      children[i].step = &step;
+      children[i].parent = game;
+      children[i].level = level-1;
+      children[i].child = i;
+      children[i].move = index;
+      children[i].random = util_randomStream(random, i);
+      sched_spawn(scheduler, &children[i].task, &group);
+    }
+    sched_wait(scheduler, &group);
+    if(step.bestScore>bestScore) {
+      bestScore = step.bestScore;
+      sequence[played] = children[step.bestChild].move;
+      memcpy(sequence+played+1, step.sequence, sizeof(int)*step.length);
+      *length = played+1+step.length;
+    }
+    if(played>=*length) // stopped before a move was evaluated
+      break;
+    // follow the best sequence found
+    line_fromIndex(sequence[played++], &line);
+    game_consumeLine(game, line);
+  }
+  bestScore = bestScore<0 ? game_getScore(game) : bestScore;
+  pthread_mutex_destroy(&step.lock);
+  arena_rewind(w->arena, mark);
+  search_popGames(w, 1);
+  return bestScore;
+}
+
+static double search_randomUnit(SearchWorker* w) {
+  return (util_random(&w->random) >> 11) * (1.0/9007199254740992.0);
+}
+
+/**
+ * Play a game from the root with moves drawn from a policy
+ * @param sequence, length: will be setted by the played lines
+ * @return the final score
+ */
+static int search_policyPlayout(SearchWorker* w, SearchPolicy* policy, int* sequence, int* length) {
+  Game* game = search_pushGame(w);
+  ArenaMark mark = arena_getMark(w->arena);
+  float* probabilities = arena_alloc(w->arena, sizeof(float)*MAX_POSSIBILITIES);
+  int* moves = arena_alloc(w->arena, sizeof(int)*MAX_POSSIBILITIES);
+  const LegalSet* legal;
+  double sum, r;
+  long long start;
+  Line line;
+  int i, n;
+  game_copy(game, w->shared->root);
+  *length = 0;
+  while((start = telemetry_getTime(), n = game_getPossibilitiesNumber(game),
+         telemetry_countTime(TELEMETRY_MOVEGEN_NS, start), n>0)) {
+    telemetry_count(TELEMETRY_MOVES, n);
+    legal = game_getLegalSet(game);
+    for(i=0, sum=0, moves[0]=legalset_next(legal, 0); i<n; ++i) {
+      if(i>0)
+        moves[i] = legalset_next(legal, moves[i-1]+1);
+      sum += probabilities[i] = expf(policy->weights[moves[i]]);
+    }
+    r = search_randomUnit(w)*sum;
+    for(i=0; i<n-1 && (r -= probabilities[i])>=0; ++i);
+    sequence[(*length)++] = moves[i];
+    line_fromIndex(moves[i], &line);
+    game_consumeLine(game, line);
+  }
+  arena_rewind(w->arena, mark);
+  search_popGames(w, 1);
+  ++ w->playouts;
+  telemetry_count(TELEMETRY_PLAYOUTS, 1);
+  telemetry_score(game_getScore(game));
+  return game_getScore(game);
+}
+
+/**
+ * Reinforce a sequence played from the root in a policy
+ */
+static void search_adapt(SearchWorker* w, SearchPolicy* policy, int* sequence, int length) {
+  Game* game = search_pushGame(w);
+  ArenaMark mark = arena_getMark(w->arena);
+  SearchPolicy* old = arena_alloc(w->arena, sizeof(SearchPolicy));
+  float* probabilities = arena_alloc(w->arena, sizeof(float)*MAX_POSSIBILITIES);
+  int* moves = arena_alloc(w->arena, sizeof(int)*MAX_POSSIBILITIES);
+  const LegalSet* legal;
+  double sum;
+  Line line;
+  int i, j, n;
+  *old = *policy;
+  game_copy(game, w->shared->root);
+  for(i=0; i<length; ++i) {
+    n = game_getPossibilitiesNumber(game);
+    legal = game_getLegalSet(game);
+    for(j=0, sum=0, moves[0]=legalset_next(legal, 0); j<n; ++j) {
+      if(j>0)
+        moves[j] = legalset_next(legal, moves[j-1]+1);
+      sum += probabilities[j] = expf(old->weights[moves[j]]);
+    }
+    for(j=0; j<n; ++j)
+      policy->weights[moves[j]] -= SEARCH_NRPA_ALPHA * probabilities[j] / sum;
+    policy->weights[sequence[i]] += SEARCH_NRPA_ALPHA;
+    line_fromIndex(sequence[i], &line);
+    game_consumeLine(game, line);
+  }
+  arena_rewind(w->arena, mark);
+  search_popGames(w, 1);
+}
+
+/**
+ * Nested rollout policy adaptation from the root
+ * @param policy: the policy of the level, adapted
+ * @param sequence, length: will be setted by the best sequence found
+ * @return the best score found
+ */
+static int search_nrpa(SearchWorker* w, int level, SearchPolicy* policy, int* sequence, int* length) {
+  ArenaMark mark;
+  SearchPolicy* childPolicy;
+  int* childSequence;
+  int i, score, childLength, bestScore = -1;
+  if(level==0)
+    return search_policyPlayout(w, policy, sequence, length);
+  mark = arena_getMark(w->arena);
+  childPolicy = arena_alloc(w->arena, sizeof(SearchPolicy));
+  childSequence = arena_alloc(w->arena, sizeof(int)*SEARCH_MAX_LINES);
+  *length = 0;
+  for(i=0; i<SEARCH_NRPA_ITERATIONS && !search_isStopped(w); ++i) {
+    if(level>1) // a playout doesn't change its policy
+      *childPolicy = *policy;
+    score = search_nrpa(w, level-1, level>1 ? childPolicy : policy, childSequence, &childLength);
+    if(score>=bestScore) {
+      bestScore = score;
+      memcpy(sequence, childSequence, sizeof(int)*childLength);
+      *length = childLength;
+    }
+    search_adapt(w, policy, sequence, *length);
+  }
+  arena_rewind(w->arena, mark);
+  return bestScore<0 ? game_getScore(w->shared->root) : bestScore;
+}
+
+static int search_compareCandidates(const void* a, const void* b) {
+  const SearchCandidate *x = a, *y = b;
+  if(x->score!=y->score)
+    return y->score - x->score;
+  return x->hash<y->hash ? -1 : (x->hash>y->hash ? 1 : 0);
+}
+
+/**
+ * Beam search from the root (two beams of width games, and a game for the playouts)
+ * @param sequence, length: will be setted by the best sequence found
+ * @return the best score found
+ */
+static int search_beam(SearchWorker* w, int width, int* sequence, int* length) {
+  ArenaMark mark = arena_getMark(w->arena);
+  Game **beam = arena_alloc(w->arena, sizeof(Game*)*2*width), **next = beam+width, **swap;
+  Game* game;
+  SearchCandidate* candidates = arena_alloc(w->arena, sizeof(SearchCandidate)*width*MAX_POSSIBILITIES);
+  int* playout = arena_alloc(w->arena, sizeof(int)*SEARCH_MAX_LINES);
+  int b, i, j, n, k, score, playoutLength, ncandidates, nbeam = 1, bestScore = -1;
+  unsigned long long hash;
+  Line line, *lines;
+  for(i=0; i<2*width; ++i)
+    beam[i] = search_pushGame(w);
+  game = search_pushGame(w);
+  game_copy(beam[0], w->shared->root);
+  *length = 0;
+  while(nbeam>0 && !search_isStopped(w)) {
+    ncandidates = 0;
+    for(b=0; b<nbeam && !search_isStopped(w); ++b) {
+      lines = game_getAllPossibilities(beam[b], &n);
+      hash = game_getHash(beam[b]);
+      for(i=0; i<n && !search_isStopped(w); ++i) {
+        game_copy(game, beam[b]);
+        game_consumeLine(game, lines[i]);
+        telemetry_count(TELEMETRY_NODES, 1);
+        score = search_playout(w, game, playout, &playoutLength);
+        if(score>bestScore) {
+          bestScore = score;
+          *length = search_getSequence(w, beam[b], sequence);
+          sequence[(*length)++] = line_getIndex(lines[i]);
+          memcpy(sequence+*length, playout, sizeof(int)*playoutLength);
+          *length += playoutLength;
+        }
+        candidates[ncandidates].parent = b;
+        candidates[ncandidates].move = line_getIndex(lines[i]);
+        candidates[ncandidates].score = score;
+        candidates[ncandidates].hash = hash ^ line_getKey(lines[i]);
+        ++ ncandidates;
+      }
+    }
+    // keep the best distinct positions
+    qsort(candidates, ncandidates, sizeof(SearchCandidate), search_compareCandidates);
+    for(i=0, k=0; i<ncandidates && k<width; ++i) {
+      for(j=0; j<k && candidates[j].hash!=candidates[i].hash; ++j);
+      if(j<k) { // a transposition of a kept position
+        telemetry_count(TELEMETRY_HITS, 1);
+        continue;
+      }
+      candidates[k++] = candidates[i];
+    }
+    for(i=0; i<k; ++i) {
+      line_fromIndex(candidates[i].move, &line);
+      game_copy(next[i], beam[candidates[i].parent]);
+      game_consumeLine(next[i], line);
+    }
+    swap = beam;
+    beam = next;
+    next = swap;
+    nbeam = k;
+  }
+  search_popGames(w, 2*width+1);
+  arena_rewind(w->arena, mark);
+  return bestScore<0 ? game_getScore(w->shared->root) : bestScore;
+}
+
+/**
+ * Select the child of a node with the best upper confidence bound (unvisited children first)
+ * @return the index of the child
+ */
+static int search_selectChild(TreeNode* nodes, TreeNode* node, int children, double bestScore) {
+  double value, bestValue = -1, logVisits = log(MAX(node->visits, 1));
+  int i, visits, selected = children;
+  for(i=children; i<children+node->nchildren; ++i) {
+    visits = nodes[i].visits;
+    if(visits==0)
+      return i;
+    value = ((1-SEARCH_MCTS_MAX_WEIGHT) * nodes[i].total / visits + SEARCH_MCTS_MAX_WEIGHT * nodes[i].best)
+            / bestScore + SEARCH_MCTS_EXPLORATION * sqrt(logVisits / visits);
+    if(value>bestValue) {
+      bestValue = value;
+      selected = i;
+    }
+  }
+  return selected;
+}
+
+/**
+ * Expand a leaf: a child per possible line of the game, in line index order
+ * @return 0 if expanded, 1 if the tree is full
+ */
+static int search_expand(Tree* tree, int node, Game* game) {
+  TreeNode* nodes = tree_getNodes(tree);
+  const LegalSet* legal;
+  int i, index, children = 0;
+  int n = game_getPossibilitiesNumber(game);
+  if(n>0 && (children = tree_alloc(tree, n))<0)
+    return 1;
+  legal = game_getLegalSet(game);
+  for(i=0, index=legalset_next(legal, 0); index>=0; index=legalset_next(legal, index+1), ++i) {
+    nodes[children+i].visits = 0;
+    nodes[children+i].best = -1;
+    nodes[children+i].total = 0;
+    nodes[children+i].children = TREE_UNEXPANDED;
+    nodes[children+i].nchildren = 0;
+    nodes[children+i].move = index;
+  }
+  nodes[node].nchildren = n;
+  nodes[node].children = n>0 ? children : 0;
+  telemetry_count(TELEMETRY_NODES, n);
+  return 0;
+}
+
+/**
+ * Back a final score up a path, removing its virtual losses
+ */
+static void search_backup(TreeNode* nodes, int* path, int depth, int score, int visits) {
+  int i;
+  for(i=0; i<=depth; ++i) {
+    nodes[path[i]].visits += visits - SEARCH_MCTS_VIRTUAL_LOSS;
+    if(score<0)
+      continue;
+    nodes[path[i]].total += score;
+    nodes[path[i]].best = MAX(nodes[path[i]].best, score);
+  }
+}
+
+/**
+ * Descend the tree from the root, expanding the leaf reached if it was visited
+ * A virtual loss is added to the path until the iteration is backed up.
+ * @return 0 if done, 1 if the tree is full ( @see tree_collect )
+ */
+static int search_descend(SearchShared* shared, SearchDescent* d) {
+  Tree* tree = shared->tree;
+  TreeNode* nodes = tree_getNodes(tree);
+  Line line;
+  int node, children;
+  game_copy(d->game, shared->root);
+  node = d->path[0] = TREE_ROOT;
+  d->depth = 0;
+  d->length = 0;
+  nodes[node].visits += SEARCH_MCTS_VIRTUAL_LOSS;
+  for(;;) {
+    children = nodes[node].children;
+    if(children==TREE_UNEXPANDED && (node==TREE_ROOT || nodes[node].visits>SEARCH_MCTS_VIRTUAL_LOSS)) {
+      if(search_expand(tree, node, d->game)) {
+        search_backup(nodes, d->path, d->depth, -1, 0);
+        return 1;
+      }
+      children = nodes[node].children;
+    }
+    if(children<0 || nodes[node].nchildren==0) // a leaf, or a game over
+      return 0;
+    node = d->path[++d->depth] = search_selectChild(nodes, &nodes[node], children, MAX(nodes[TREE_ROOT].best, 1));
+    nodes[node].visits += SEARCH_MCTS_VIRTUAL_LOSS;
+    d->sequence[d->length++] = nodes[node].move;
+    line_fromIndex(nodes[node].move, &line);
+    game_consumeLine(d->game, line);
+  }
+}
+
+/**
+ * End the game of an MCTS iteration with a random game (a task)
+ */
+static void search_runDescent(SchedTask* task) {
+  SearchDescent* d = (SearchDescent*)task;
+  SearchWorker* w = search_getWorker(d->shared);
+  unsigned long long random = w->random; // of a task waiting on this thread
+  int length;
+  w->random = d->random;
+  d->score = search_playout(w, d->game, d->sequence+d->length, &length);
+  d->length += length;
+  w->random = random;
+}
+
+/**
+ * Record the opening of a game played from the root in the book
+ */
+static void search_record(SearchWorker* w, int* sequence, int length, int score) {
+  ArenaMark mark = arena_getMark(w->arena);
+  Line* lines = arena_alloc(w->arena, sizeof(Line)*BOOK_MAX_DEPTH);
+  Line* rootLines;
+  int i, n;
+  rootLines = game_getLines(w->shared->root, &n);
+  n = MIN(n, BOOK_MAX_DEPTH);
+  memcpy(lines, rootLines, sizeof(Line)*n);
+  for(i=0; i<length && n<BOOK_MAX_DEPTH; ++i)
+    line_fromIndex(sequence[i], &lines[n++]);
+  book_recordGame(searchBook, lines, n, score);
+  arena_rewind(w->arena, mark);
+}
+
+/**
+ * Merge the result of an iteration: the best score wins, then the first iteration, so the
+ * result doesn't depend on the order the iterations end in
+ * @param policy: the policy of the iteration (NRPA), else NULL
+ */
+static void search_submit(SearchWorker* w, int iteration, int score, int* sequence, int length, SearchPolicy* policy) {
+  SearchShared* shared = w->shared;
+  if(searchBook)
+    search_record(w, sequence, length, score);
+  telemetry_score(score);
+
+  // an interrupted search still found a legal sequence
+  pthread_mutex_lock(&shared->lock);
+  if(!search_isStopped(w))
+    ++ shared->completed;
+  if(score>shared->bestScore || (score==shared->bestScore && iteration<shared->bestIteration)) {
+    shared->bestScore = score;
+    shared->bestIteration = iteration;
+    shared->bestLength = length;
+    memcpy(shared->bestSequence, sequence, sizeof(int)*length);
+    if(policy)
+      *shared->bestPolicy = *policy;
+  }
+  pthread_mutex_unlock(&shared->lock);
+}
+
+/**
+ * Run MCTS iterations by waves of SEARCH_MCTS_WAVE: the descents are done one after the other,
+ * their random games are played by tasks, and the scores are backed up in iteration order.
+ * Only random games run in parallel, so the tree grows the same way whatever the number of threads.
+ */
+static void search_mcts(SearchWorker* w) {
+  SearchShared* shared = w->shared;
+  Tree* tree = shared->tree;
+  ArenaMark mark;
+  SearchDescent* descents;
+  SchedGroup group;
+  int i, n, first, full;
+  while(!search_isStopped(w)) {
+    pthread_mutex_lock(&shared->lock);
+    first = shared->next;
+    n = shared->iterations>0 ? MIN(SEARCH_MCTS_WAVE, shared->iterations-first) : SEARCH_MCTS_WAVE;
+    pthread_mutex_unlock(&shared->lock);
+    if(n<=0)
+      break;
+    arena_reset(w->arena);
+    mark = arena_getMark(w->arena);
+    descents = arena_alloc(w->arena, sizeof(SearchDescent)*n);
+    full = FALSE;
+    for(i=0; i<n && !full; ++i) {
+      descents[i].task.run = search_runDescent;
+      descents[i].shared = shared;
+      descents[i].game = search_pushGame(w);
+      descents[i].path = arena_alloc(w->arena, sizeof(int)*(SEARCH_MAX_LINES+1));
+      descents[i].sequence = arena_alloc(w->arena, sizeof(int)*SEARCH_MAX_LINES);
+      descents[i].random = util_randomStream(shared->seed, first+i);
+      if(tree==NULL) { // the pool couldn't be allocated: random games only
+        game_copy(descents[i].game, shared->root);
+        descents[i].length = 0;
+      }
+      else if((full = search_descend(shared, &descents[i]))) // make room after the wave
+        search_popGames(w, 1);
+    }
+    n = full ? i-1 : i;
+    pthread_mutex_lock(&shared->lock);
+    shared->next += n;
+    pthread_mutex_unlock(&shared->lock);
+    sched_initGroup(&group);
+    for(i=0; i<n; ++i)
+      sched_spawn(shared->scheduler, &descents[i].task, &group);
+    sched_wait(shared->scheduler, &group);
+    for(i=0; i<n; ++i) {
+      if(tree)
+        search_backup(tree_getNodes(tree), descents[i].path, descents[i].depth, descents[i].score, 1);
+      search_submit(w, first+i, descents[i].score, descents[i].sequence, descents[i].length, NULL);
+    }
+    if(full)
+      tree_collect(tree);
+    search_popGames(w, n);
+    arena_rewind(w->arena, mark);
+  }
+}
+
+static void search_startThread() {
+  telemetry_attach();
+}
+
+static void search_stopThread() {
+  telemetry_detach();
+}
+
+/**
+ * Run the iterations of a search until there is none left (a root task)
+ */
+static void search_runLoop(SchedTask* task) {
+  SearchShared* shared = ((SearchLoop*)task)->shared;
+  SearchWorker* w = search_getWorker(shared);
+  SearchPolicy* policy = NULL;
+  Game* game;
+  int iteration, score, length, *sequence;
+  if(shared->algorithm==SEARCH_MCTS) {
+    search_mcts(w);
+    return;
+  }
+  for(;;) {
+    pthread_mutex_lock(&shared->lock);
+    iteration = shared->next++;
+    pthread_mutex_unlock(&shared->lock);
+    if((shared->iterations>0 && iteration>=shared->iterations) || search_isStopped(w))
+      break;
+    arena_reset(w->arena);
+    sequence = arena_alloc(w->arena, sizeof(int)*SEARCH_MAX_LINES);
+    w->random = util_randomStream(shared->seed, iteration);
+    switch(shared->algorithm) {
+      case SEARCH_NRPA:
+        policy = arena_alloc(w->arena, sizeof(SearchPolicy));
+        if(shared->policy)
+          *policy = *shared->policy;
+        else
+          memset(policy, 0, sizeof(SearchPolicy));
+        score = search_nrpa(w, shared->level, policy, sequence, &length);
+        break;
+      case SEARCH_BEAM:
+        score = search_beam(w, shared->level, sequence, &length);
+        break;
+      default:
+        if(shared->level==0) {
+          game = search_pushGame(w);
+          game_copy(game, shared->root);
+          score = search_playout(w, game, sequence, &length);
+          search_popGames(w, 1);
+        }
+        else
+          score = search_nested(w, shared->level, shared->root, sequence, &length);
+    }
+    search_submit(w, iteration, score, sequence, length, policy);
+  }
+}
+
+/**
+ * Prepare a search of a batch: follow the book from its start position, then create its workers
+ * @param iterations: the number of iterations, 0 for no limit
+ */
+static void search_begin(SearchShared* shared, SearchJob* job, SearchAlgorithm algorithm, int level, int threads,
+                         int iterations, double start) {
+  Line line;
+  int i;
+  // follow the book while the openings are well explored
+  job->result.bookLines = 0;
+  while(searchBook && searchBookSkip>0 && book_getBestLine(searchBook, job->game, searchBookSkip, &line, NULL)==0) {
+    game_consumeLine(job->game, line);
+    ++ job->result.bookLines;
+  }
+
+  pthread_mutex_init(&shared->lock, NULL);
+  shared->root = job->game;
+  shared->algorithm = algorithm;
+  shared->level = level;
+  shared->policy = job->policy;
+  shared->iterations = iterations;
+  shared->next = 0;
+  shared->completed = 0;
+  shared->deadline = job->timeLimit>0 ? start + job->timeLimit : 0;
+  atomic_init(&shared->stopped, FALSE);
+  shared->seed = job->seed;
+  shared->bestScore = -1;
+  shared->bestIteration = 0;
+  shared->bestSequence = malloc(sizeof(int)*SEARCH_MAX_LINES);
+  shared->bestLength = 0;
+  shared->bestPolicy = algorithm==SEARCH_NRPA ? malloc(sizeof(SearchPolicy)) : NULL;
+  shared->tree = algorithm==SEARCH_MCTS ? tree_new(searchTreeCapacity) : NULL;
+
+  shared->workers = malloc(sizeof(SearchWorker)*threads);
+  for(i=0; i<threads; ++i) {
+    shared->workers[i].shared = shared;
+    shared->workers[i].arena = arena_new(SEARCH_ARENA_BLOCK);
+    shared->workers[i].games = NULL;
+    shared->workers[i].ngames = 0;
+    shared->workers[i].top = 0;
+    shared->workers[i].random = 0;
+    shared->workers[i].playouts = 0;
+  }
+}
+
+/**
+ * End a search of a batch: play its best game into its start position and set its results
+ */
+static void search_end(SearchShared* shared, SearchJob* job, int threads, double start) {
+  SearchResult* result = &job->result;
+  SearchWorker* workers = shared->workers;
+  Line line;
+  int i, g;
+  result->playouts = 0;
+  result->threads = threads;
+  for(i=0; i<threads; ++i) {
+    sched_getStats(shared->scheduler, i, &result->workers[i]);
+    result->playouts += workers[i].playouts;
+    for(g=0; g<workers[i].ngames; ++g)
+      game_close(workers[i].games[g]);
+    free(workers[i].games);
+    arena_close(workers[i].arena);
+  }
+
+  for(i=0; i<shared->bestLength; ++i) {
+    line_fromIndex(shared->bestSequence[i], &line);
+    game_consumeLine(job->game, line);
+  }
+  if(job->policy && shared->bestPolicy && shared->bestScore>=0)
+    *job->policy = *shared->bestPolicy;
+  result->score = game_getScore(job->game);
+  result->iterations = shared->completed;
+  result->treeNodes = shared->tree ? tree_getSize(shared->tree) : 0;
+  result->treeCollections = shared->tree ? tree_getCollections(shared->tree) : 0;
+  result->seconds = util_getTime() - start;
+
+  free(shared->bestSequence);
+  free(shared->bestPolicy);
+  if(shared->tree)
+    tree_close(shared->tree);
+  free(workers);
+  pthread_mutex_destroy(&shared->lock);
+}
+
+extern void search_runBatch(SearchJob* jobs, int njobs, SearchAlgorithm algorithm, int level, int threads,
+                            int iterations) {
+  Scheduler* scheduler;
+  SearchShared* shares;
+  SearchLoop* loops;
+  SchedGroup group;
+  int i, j, n, nloops = 0;
+  double start = util_getTime();
+
+  level = algorithm==SEARCH_BEAM ? MAX(level, 1) : MAX(level, 0);
+  threads = MIN(MAX(threads, 1), SCHED_MAX_THREADS);
+  scheduler = sched_new(threads, search_startThread, search_stopThread);
+  shares = malloc(sizeof(SearchShared)*njobs);
+  loops = malloc(sizeof(SearchLoop)*njobs*MAX(threads/njobs, 1));
+  sched_initGroup(&group);
+  for(j=0; j<njobs; ++j) {
+    n = iterations<=0 && jobs[j].timeLimit<=0 ? 1 : MAX(iterations, 0);
+    search_begin(&shares[j], &jobs[j], algorithm, level, threads, n, start);
+    shares[j].scheduler = scheduler;
+    // each search has its share of the threads,
+    // threads without an iteration steal the tasks of the nested searches
+    n = algorithm==SEARCH_MCTS ? 1 : (n>0 ? MIN(MAX(threads/njobs, 1), n) : MAX(threads/njobs, 1));
+    for(i=0; i<n; ++i, ++nloops) {
+      loops[nloops].task.run = search_runLoop;
+      loops[nloops].shared = &shares[j];
+      sched_spawn(scheduler, &loops[nloops].task, &group);
+    }
+  }
+  sched_wait(scheduler, &group);
+
+  for(j=0; j<njobs; ++j)
+    search_end(&shares[j], &jobs[j], threads, start);
+  sched_close(scheduler);
+  free(shares);
+  free(loops);
+}
+
+extern SearchResult search_run(Game* game, SearchAlgorithm algorithm, int level, SearchPolicy* policy,
+                               int threads, int iterations, double timeLimit, unsigned long long seed) {
+  SearchJob job;
+  job.game = game;
+  job.policy = policy;
+  job.timeLimit = timeLimit;
+  job.seed = seed;
+  search_runBatch(&job, 1, algorithm, level, threads, iterations);
+  return job.result;
+}
@@ -0,0 +1,150 @@
+#ifndef _SEARCH_H
+#define _SEARCH_H
+/**
+ * Search module
+ *
+ * Single-player searches for high score games:
+ *  - NMCS (nested Monte Carlo search): at level 0 a game is ended by random moves,
+ *    at level n each possible move is evaluated by a level n-1 search and the best sequence found
+ *    so far is followed one move at a time.
+ *  - NRPA (nested rollout policy adaptation): at level 0 a game is ended by moves drawn from a policy,
+ *    at level n the best sequence of SEARCH_NRPA_ITERATIONS level n-1 searches is reinforced in the policy.
+ *  - beam search: the best positions of each depth (evaluated by a random game) are expanded,
+ *    the level is the number of positions kept.
+ *  - MCTS (UCT): one tree of positions ( @see tree.h ). An iteration descends the tree to a leaf
+ *    by the best child bound, expands it once it was visited, ends the game with a random game,
+ *    and backs its score up the path (mean and max). Iterations run by waves of SEARCH_MCTS_WAVE:
+ *    descents add a virtual loss to their path so that the wave spreads over other children, and
+ *    the random games of the wave run in parallel. The level is unused.
+ * A search iteration is a whole search from the start position (one descent and random game for
+ * MCTS). Iterations are shared between threads; each thread has its own games and its own arena (move lists, sequences, policies),
+ * reset at each iteration, so the search doesn't allocate per node.
+ * Threads are those of a work-stealing scheduler ( @see scheduler.h ): the moves of each NMCS step
+ * are evaluated by child tasks, so idle threads steal the subtrees of a running nested search
+ * (NRPA and beam iterations stay on one thread). The time limit stops the pending tasks of its search.
+ * Several searches can run together on the threads of one scheduler ( @see search_runBatch ).
+ * Every iteration and task draws from its own random stream ( @see util_randomStream ) and results
+ * are merged by score then iteration: with an iteration budget, the result doesn't depend on the
+ * number of threads.
+ * With an opening book ( @see search_setBook ), each iteration records its game in the book and
+ * the search can first follow the book through well explored openings.
+ */
+
+#include "book.h"
+#include "game.h"
+#include "points.h"
+#include "rollout.h"
+#include "scheduler.h"
+#include "tree.h"
+
+#define SEARCH_NRPA_ITERATIONS 100
+#define SEARCH_NRPA_ALPHA 1.0f
+#define SEARCH_MCTS_EXPLORATION 0.25 // UCT exploration constant, scores are divided by the best score
+#define SEARCH_MCTS_MAX_WEIGHT 0.5 // share of the best score (max backup) in a node value, the mean makes the rest
+#define SEARCH_MCTS_VIRTUAL_LOSS 3 // visits added to the path of a running game
+#define SEARCH_MCTS_WAVE 32 // iterations descending the tree before their random games run in parallel
+
+/**
+ * Search algorithms
+ */
+typedef enum {
+  SEARCH_NMCS=0,
+  SEARCH_NRPA,
+  SEARCH_BEAM,
+  SEARCH_MCTS
+} SearchAlgorithm;
+
+/**
+ * A rollout policy: moves are drawn with a probability proportional to exp(weight of their line)
+ */
+typedef struct _SearchPolicy {
+  float weights[LINE_INDEX_COUNT]; // by line index ( @see line_getIndex )
+} SearchPolicy;
+
+/**
+ * Search results
+ */
+typedef struct _SearchResult {
+  int score; // best final score found
+  int iterations; // searches completed
+  long long playouts; // random games played
+  int bookLines; // lines played from the opening book before the search
+  int treeNodes; // nodes of the MCTS tree at the end of the search
+  int treeCollections; // times the MCTS tree was full
+  int threads;
+  SchedStats workers[SCHED_MAX_THREADS]; // by thread
+  double seconds;
+} SearchResult;
+
+/**
+ * A search of a batch ( @see search_runBatch )
+ */
+typedef struct _SearchJob {
+  Game* game; // the start position, the best game found is played into it
+  SearchPolicy* policy; // the start policy of NRPA, set to the policy of the best iteration (can be NULL)
+  double timeLimit; // seconds, 0 for no limit
+  unsigned long long seed;
+  SearchResult result; // the thread statistics are those of the whole batch
+} SearchJob;
+
+/**
+ * Get an algorithm from its name ("nmcs", "nrpa", "beam" or "mcts")
+ * @return the algorithm, or -1 if the name is unknown
+ */
+extern int search_getAlgorithm(const char* name);
+
+/**
+ * Get the name of an algorithm
+ */
+extern const char* search_getAlgorithmName(SearchAlgorithm algorithm);
+
+/**
+ * Set the rollout policy of the next NMCS and beam searches ( @see rollout.h )
+ * @param policy: the policy (NULL for uniform rollouts), must live until the searches end
+ */
+extern void search_setRollout(RolloutPolicy* policy);
+
+/**
+ * Set the opening book of the next searches
+ * @param book: the book iterations record their game in (NULL for no book)
+ * @param skipVisits: a search first plays the book line leading to the best score while the next position
+ *   has at least skipVisits visits (0 to never follow the book)
+ */
+extern void search_setBook(Book* book, unsigned int skipVisits);
+
+/**
+ * Set the number of nodes of the tree of the next MCTS searches
+ * @param capacity: the nodes of the pool (0 for TREE_CAPACITY_DEFAULT), the least visited
+ *   subtrees are recycled when the pool is full
+ */
+extern void search_setTreeCapacity(int capacity);
+
+/**
+ * Search the best continuation of a game
+ * The search stops when the iterations are done or when the time limit is reached.
+ * @param game: the start position, the best game found is played into it
+ * @param algorithm: the search algorithm
+ * @param level: the nesting level (NMCS, NRPA) or the beam width (beam), unused by MCTS
+ * @param policy: the start policy of NRPA (NULL for a uniform policy), set to the policy of the best
+ *   iteration (NRPA only, can be NULL)
+ * @param threads: the number of threads
+ * @param iterations: the number of searches to run (MCTS: of random games, 0 for no limit)
+ * @param timeLimit: the time limit in seconds (0 for no limit)
+ * @param seed: the random seed (iteration i always uses the same random stream)
+ * @return the search results
+ */
+extern SearchResult search_run(Game* game, SearchAlgorithm algorithm, int level, SearchPolicy* policy,
+                               int threads, int iterations, double timeLimit, unsigned long long seed);
+
+/**
+ * Search the best continuations of several games together, on the threads of one scheduler
+ * Each search has its own time limit and random streams, and a share of the threads: a thread
+ * done with its search steals the tasks of the others.
+ * @param jobs, njobs: the searches, their games, policies, time limits and seeds ( @see search_run )
+ * @param algorithm, level, iterations: of each search ( @see search_run )
+ * @param threads: the number of threads of the batch
+ */
+extern void search_runBatch(SearchJob* jobs, int njobs, SearchAlgorithm algorithm, int level, int threads,
+                            int iterations);
+
+#endif
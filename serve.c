@@ -0,0 +1,568 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "serve.h"
+
+#ifdef _WIN32
+
+extern int serve_run(const char* path, int threads, int level, int budget) {
+  fprintf(stderr, "The solver daemon needs Unix domain sockets, not available on this platform.\n");
+  return 1;
+}
+
+extern int serve_request(const char* path, const char* request, FILE* out) {
+  fprintf(stderr, "The solver daemon needs Unix domain sockets, not available on this platform.\n");
+  return 1;
+}
+
+#else
+
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "game.h"
+#include "globals.h"
+#include "points.h"
+#include "search.h"
+#include "telemetry.h"
+#include "utils.h"
+
+#define SERVE_QUEUE_MAX 256
+#define SERVE_BATCH_MAX 16 // clients taken at once by a worker
+#define SERVE_CACHE_SIZE 1024 // direct-mapped by position hash
+#define SERVE_LATENCY_SAMPLES 1024 // latencies kept for the percentiles
+#define SERVE_READ_TIMEOUT 2 // seconds the clients of a batch have to send their requests
+#define SERVE_LINE_TEXT_MAX 64 // bytes of a line in the save file format
+
+/**
+ * A client connection waiting for a worker, which reads its request
+ */
+typedef struct _ServeRequest {
+  struct _ServeRequest* next;
+  int fd;
+  char* text; // the request read so far
+  int length; // bytes read, -1 if the request is incomplete or too long
+  int complete; // the final "." line was read
+  Game* game; // the position to solve
+  unsigned long long hash;
+  int start; // lines of the position
+  int score; // of the position
+  int budget; // ms
+  double received; // connection time
+} ServeRequest;
+
+/**
+ * A cached continuation
+ * The score gained by a continuation only depends on the position, not on the order
+ * its lines were played in, so it is stored instead of the final score.
+ */
+typedef struct _ServeCacheEntry {
+  unsigned long long hash;
+  int used;
+  int gain;
+  int nmoves;
+  int* moves; // line indices
+} ServeCacheEntry;
+
+typedef struct _Server {
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  pthread_cond_t solved; // a search ended
+  ServeRequest *head, *tail; // connection queue
+  int queued, maxQueued;
+  unsigned long long* searching; // hashes of the positions being searched, a batch per worker at most
+  int nsearching;
+  int level;
+  int budget; // ms, of the requests without one
+  int stopping;
+  long long requests, cacheHits;
+  double latencies[SERVE_LATENCY_SAMPLES]; // last latencies (ms), a ring
+  ServeCacheEntry cache[SERVE_CACHE_SIZE];
+} Server;
+
+static volatile sig_atomic_t serve_stopRequested = 0;
+
+static void serve_onSignal(int sig) {
+  serve_stopRequested = 1;
+}
+
+static void serve_write(int fd, const char* text, int length) {
+  int n;
+  while(length>0 && ((n = write(fd, text, length))>0 || errno==EINTR)) {
+    if(n>0) {
+      text += n;
+      length -= n;
+    }
+  }
+}
+
+static void serve_error(int fd, const char* message) {
+  char buf[100];
+  serve_write(fd, buf, snprintf(buf, 100, "ERR %s\n", message));
+  close(fd);
+}
+
+/**
+ * Read what a client sent, until the final "." line of its request
+ */
+static void serve_readMore(ServeRequest* r) {
+  int n = read(r->fd, r->text+r->length, SERVE_REQUEST_TEXT_MAX-1-r->length);
+  if(n<0 && errno==EINTR)
+    return;
+  if(n<=0) {
+    r->length = -1;
+    return;
+  }
+  r->length += n;
+  r->text[r->length] = 0;
+  if(r->length>=2 && strcmp(r->text+r->length-2, ".\n")==0 && (r->length==2 || r->text[r->length-3]=='\n'))
+    r->complete = TRUE;
+  else if(r->length>=SERVE_REQUEST_TEXT_MAX-1)
+    r->length = -1;
+}
+
+/**
+ * Read the requests of a batch of clients, together
+ * The clients have SERVE_READ_TIMEOUT seconds to send their requests: a slow one only delays its batch.
+ */
+static void serve_readBatch(ServeRequest** requests, int n) {
+  struct pollfd fds[SERVE_BATCH_MAX];
+  ServeRequest* polled[SERVE_BATCH_MAX];
+  double deadline = util_getTime() + SERVE_READ_TIMEOUT;
+  int i, k, timeout;
+  for(i=0; i<n; ++i) {
+    requests[i]->text = malloc(SERVE_REQUEST_TEXT_MAX);
+    requests[i]->length = 0;
+    requests[i]->complete = FALSE;
+  }
+  for(;;) {
+    for(i=0, k=0; i<n; ++i) {
+      if(requests[i]->complete || requests[i]->length<0)
+        continue;
+      fds[k].fd = requests[i]->fd;
+      fds[k].events = POLLIN;
+      fds[k].revents = 0;
+      polled[k++] = requests[i];
+    }
+    if(k==0 || (timeout = (int)((deadline - util_getTime())*1000))<=0)
+      break;
+    if(poll(fds, k, timeout)<0 && errno!=EINTR)
+      break;
+    for(i=0; i<k; ++i)
+      if(fds[i].revents)
+        serve_readMore(polled[i]);
+  }
+}
+
+/**
+ * Play the lines of a position in the save file format, until the final "." line
+ * @return 0 if success, 1 if a line is invalid or illegal
+ */
+static int serve_parseGame(char* text, Game* game) {
+  Line line;
+  Point* p = line.points;
+  char* end;
+  for(; *text && strcmp(text, ".\n")!=0; text = end+1) {
+    end = strchr(text, '\n');
+    *end = 0;
+    if(text[strspn(text, " \t\r")]==0) // blank line
+      continue;
+    if(sscanf(text, "%d %d %d %d %d %d %d %d %d %d", &p[0].x, &p[0].y, &p[1].x, &p[1].y, &p[2].x, &p[2].y,
+              &p[3].x, &p[3].y, &p[4].x, &p[4].y)!=2*LINE_LENGTH
+       || !line_isValid(line) || !game_isPlayableLine(game, line))
+      return 1;
+    game_consumeLine(game, line);
+  }
+  return 0;
+}
+
+static int serve_compareLatencies(const void* a, const void* b) {
+  double x = *(double*)a, y = *(double*)b;
+  return x<y ? -1 : (x>y ? 1 : 0);
+}
+
+static void serve_stats(Server* server, int fd) {
+  double latencies[SERVE_LATENCY_SAMPLES], p50 = 0, p99 = 0;
+  char buf[200];
+  int n;
+  pthread_mutex_lock(&server->lock);
+  n = MIN(server->requests, SERVE_LATENCY_SAMPLES);
+  memcpy(latencies, server->latencies, sizeof(double)*n);
+  snprintf(buf, 200, "OK queue %d max_queue %d requests %lld cache_hits %lld", server->queued, server->maxQueued,
+           server->requests, server->cacheHits);
+  pthread_mutex_unlock(&server->lock);
+  if(n>0) {
+    qsort(latencies, n, sizeof(double), serve_compareLatencies);
+    p50 = latencies[(n*50+99)/100-1]; // nearest rank
+    p99 = latencies[(n*99+99)/100-1];
+  }
+  snprintf(buf+strlen(buf), 200-strlen(buf), " p50_ms %.1f p99_ms %.1f\n", p50, p99);
+  serve_write(fd, buf, strlen(buf));
+  close(fd);
+}
+
+/**
+ * @return TRUE if a worker is searching a position (the server is locked)
+ */
+static int serve_isSearching(Server* server, unsigned long long hash) {
+  int i;
+  for(i=0; i<server->nsearching && server->searching[i]!=hash; ++i);
+  return i<server->nsearching;
+}
+
+static void serve_endSearch(Server* server, unsigned long long hash) {
+  int i;
+  for(i=0; server->searching[i]!=hash; ++i);
+  server->searching[i] = server->searching[--server->nsearching];
+  pthread_cond_broadcast(&server->solved);
+}
+
+/**
+ * Answer a request with a continuation, and record its latency
+ * @param score: the final score
+ * @param moves, nmoves: the continuation (line indices)
+ * @param cached: TRUE if the continuation was taken from the cache
+ */
+static void serve_answer(Server* server, ServeRequest* r, int score, int* moves, int nmoves, int cached) {
+  char* text = malloc(SERVE_LINE_TEXT_MAX*(nmoves+2));
+  Line line;
+  int i, n = sprintf(text, "OK %d %d %d\n", score, nmoves, cached);
+  for(i=0; i<nmoves; ++i) {
+    line_fromIndex(moves[i], &line);
+    n += sprintf(text+n, "%d %d %d %d %d %d %d %d %d %d\n", line.points[0].x, line.points[0].y,
+                 line.points[1].x, line.points[1].y, line.points[2].x, line.points[2].y,
+                 line.points[3].x, line.points[3].y, line.points[4].x, line.points[4].y);
+  }
+  n += sprintf(text+n, ".\n");
+  serve_write(r->fd, text, n);
+  close(r->fd);
+  free(text);
+
+  pthread_mutex_lock(&server->lock);
+  server->latencies[server->requests % SERVE_LATENCY_SAMPLES] = (util_getTime() - r->received)*1000;
+  ++ server->requests;
+  if(cached)
+    ++ server->cacheHits;
+  pthread_mutex_unlock(&server->lock);
+  if(cached)
+    telemetry_count(TELEMETRY_HITS, 1);
+}
+
+/**
+ * Cache the continuation searched for a request, and end its search
+ * @param moves: will be setted by the continuation (line indices, to free)
+ * @return the number of lines of the continuation
+ */
+static int serve_store(Server* server, ServeRequest* r, int** moves) {
+  ServeCacheEntry* entry = &server->cache[r->hash % SERVE_CACHE_SIZE];
+  int i, n, nmoves;
+  Line* lines = game_getLines(r->game, &n);
+  nmoves = n - r->start;
+  *moves = malloc(sizeof(int)*MAX(nmoves, 1));
+  for(i=0; i<nmoves; ++i)
+    (*moves)[i] = line_getIndex(lines[r->start+i]);
+  pthread_mutex_lock(&server->lock);
+  free(entry->moves);
+  entry->used = TRUE;
+  entry->hash = r->hash;
+  entry->gain = game_getScore(r->game) - r->score;
+  entry->nmoves = nmoves;
+  entry->moves = malloc(sizeof(int)*MAX(nmoves, 1));
+  memcpy(entry->moves, *moves, sizeof(int)*nmoves);
+  serve_endSearch(server, r->hash);
+  pthread_mutex_unlock(&server->lock);
+  return nmoves;
+}
+
+/**
+ * Search the continuation of a request alone (or take it from the cache) and answer
+ * A position already being searched is waited for, then taken from the cache.
+ */
+static void serve_solve(Server* server, ServeRequest* r) {
+  ServeCacheEntry* entry = &server->cache[r->hash % SERVE_CACHE_SIZE];
+  int gain, nmoves, cached;
+  int* moves = NULL;
+
+  pthread_mutex_lock(&server->lock);
+  while(!(cached = entry->used && entry->hash==r->hash) && serve_isSearching(server, r->hash))
+    pthread_cond_wait(&server->solved, &server->lock);
+  if(cached) {
+    gain = entry->gain;
+    nmoves = entry->nmoves;
+    moves = malloc(sizeof(int)*MAX(nmoves, 1));
+    memcpy(moves, entry->moves, sizeof(int)*nmoves);
+  }
+  else
+    server->searching[server->nsearching++] = r->hash;
+  pthread_mutex_unlock(&server->lock);
+
+  if(!cached) {
+    search_run(r->game, SEARCH_NMCS, server->level, NULL, 1, 0, r->budget/1000.0, r->hash);
+    nmoves = serve_store(server, r, &moves);
+    gain = game_getScore(r->game) - r->score;
+  }
+  serve_answer(server, r, r->score+gain, moves, nmoves, cached);
+  free(moves);
+}
+
+/**
+ * Solve the requests of a batch
+ * The positions neither cached nor being searched are searched together, one thread each
+ * ( @see search_runBatch ), then the other requests are answered as alone ( @see serve_solve ):
+ * a position asked twice is searched once.
+ */
+static void serve_solveBatch(Server* server, ServeRequest** requests, int n) {
+  SearchJob jobs[SERVE_BATCH_MAX];
+  ServeRequest *searched[SERVE_BATCH_MAX], *others[SERVE_BATCH_MAX];
+  ServeCacheEntry* entry;
+  int i, nmoves, njobs = 0, nothers = 0;
+  int* moves;
+
+  pthread_mutex_lock(&server->lock);
+  for(i=0; i<n; ++i) {
+    entry = &server->cache[requests[i]->hash % SERVE_CACHE_SIZE];
+    if((entry->used && entry->hash==requests[i]->hash) || serve_isSearching(server, requests[i]->hash)) {
+      others[nothers++] = requests[i];
+      continue;
+    }
+    server->searching[server->nsearching++] = requests[i]->hash;
+    jobs[njobs].game = requests[i]->game;
+    jobs[njobs].policy = NULL;
+    jobs[njobs].timeLimit = requests[i]->budget/1000.0;
+    jobs[njobs].seed = requests[i]->hash;
+    searched[njobs++] = requests[i];
+  }
+  pthread_mutex_unlock(&server->lock);
+
+  if(njobs>0)
+    search_runBatch(jobs, njobs, SEARCH_NMCS, server->level, njobs, 0);
+  for(i=0; i<njobs; ++i) {
+    nmoves = serve_store(server, searched[i], &moves);
+    serve_answer(server, searched[i], game_getScore(searched[i]->game), moves, nmoves, FALSE);
+    free(moves);
+  }
+  for(i=0; i<nothers; ++i)
+    serve_solve(server, others[i]);
+}
+
+/**
+ * Parse the request of a client, and answer it if it isn't a position to solve
+ * @return 0 if the request is a position to solve, 1 if it was answered (statistics or an error)
+ */
+static int serve_parseRequest(Server* server, ServeRequest* r) {
+  char* body;
+  int budget = server->budget;
+  if(!r->complete)
+    serve_error(r->fd, "incomplete request");
+  else if(strncmp(r->text, "STATS", 5)==0)
+    serve_stats(server, r->fd);
+  else if(strncmp(r->text, "SOLVE", 5)!=0)
+    serve_error(r->fd, "unknown request");
+  else {
+    body = strchr(r->text, '\n') + 1;
+    body[-1] = 0; // the budget is on the request line only
+    sscanf(r->text+5, "%d", &budget);
+    r->budget = MAX(1, MIN(budget, SERVE_BUDGET_MAX));
+    r->game = game_init();
+    if(serve_parseGame(body, r->game)!=0)
+      serve_error(r->fd, "invalid position");
+    else {
+      r->hash = game_getHash(r->game);
+      r->start = game_getLinesCount(r->game);
+      r->score = game_getScore(r->game);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void* serve_worker(void* arg) {
+  Server* server = arg;
+  ServeRequest *requests[SERVE_BATCH_MAX], *solving[SERVE_BATCH_MAX];
+  int i, n, nsolving;
+  for(;;) {
+    pthread_mutex_lock(&server->lock);
+    while(server->head==NULL && !server->stopping)
+      pthread_cond_wait(&server->ready, &server->lock);
+    if(server->stopping) {
+      pthread_mutex_unlock(&server->lock);
+      break;
+    }
+    // take the waiting clients, up to a batch: their requests are read and solved together
+    for(n=0; n<SERVE_BATCH_MAX && server->head; ++n) {
+      requests[n] = server->head;
+      server->head = server->head->next;
+    }
+    if(server->head==NULL)
+      server->tail = NULL;
+    server->queued -= n;
+    pthread_mutex_unlock(&server->lock);
+
+    telemetry_attach(); // busy while serving a batch
+    serve_readBatch(requests, n);
+    for(i=0, nsolving=0; i<n; ++i)
+      if(serve_parseRequest(server, requests[i])==0)
+        solving[nsolving++] = requests[i];
+    serve_solveBatch(server, solving, nsolving);
+    telemetry_detach();
+    for(i=0; i<n; ++i) {
+      if(requests[i]->game)
+        game_close(requests[i]->game);
+      free(requests[i]->text);
+      free(requests[i]);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Queue a new client for the workers
+ */
+static void serve_accept(Server* server, int fd) {
+  ServeRequest* r;
+  pthread_mutex_lock(&server->lock);
+  if(server->queued>=SERVE_QUEUE_MAX) {
+    pthread_mutex_unlock(&server->lock);
+    serve_error(fd, "queue full");
+    return;
+  }
+  r = malloc(sizeof(ServeRequest));
+  r->next = NULL;
+  r->fd = fd;
+  r->text = NULL;
+  r->game = NULL;
+  r->received = util_getTime();
+  if(server->tail)
+    server->tail->next = r;
+  else
+    server->head = r;
+  server->tail = r;
+  ++ server->queued;
+  server->maxQueued = MAX(server->maxQueued, server->queued);
+  pthread_cond_signal(&server->ready);
+  pthread_mutex_unlock(&server->lock);
+}
+
+static int serve_connect(const char* path) {
+  struct sockaddr_un addr;
+  int fd;
+  if(strlen(path)>=sizeof(addr.sun_path))
+    return -1;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd>=0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr))!=0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+extern int serve_run(const char* path, int threads, int level, int budget) {
+  struct sockaddr_un addr;
+  struct sigaction action;
+  sigset_t signals, mask;
+  Server* server;
+  ServeRequest* r;
+  pthread_t* tids;
+  int i, fd, client;
+
+  if(strlen(path)>=sizeof(addr.sun_path))
+    return 1;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path);
+  if(fd<0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr))!=0 || listen(fd, SOMAXCONN)!=0) {
+    if(fd>=0)
+      close(fd);
+    return 1;
+  }
+
+  // stop on SIGINT / SIGTERM: no SA_RESTART, so accept() is interrupted
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = serve_onSignal;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN); // a client may leave before its answer
+
+  threads = MAX(threads, 1);
+  server = calloc(1, sizeof(Server));
+  pthread_mutex_init(&server->lock, NULL);
+  pthread_cond_init(&server->ready, NULL);
+  pthread_cond_init(&server->solved, NULL);
+  server->searching = malloc(sizeof(unsigned long long)*threads*SERVE_BATCH_MAX);
+  server->level = MAX(level, 0);
+  server->budget = budget;
+  tids = malloc(sizeof(pthread_t)*threads);
+  // the workers (and their search threads) block the stop signals: they interrupt accept()
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, &mask);
+  for(i=0; i<threads; ++i)
+    pthread_create(&tids[i], NULL, serve_worker, server);
+  pthread_sigmask(SIG_SETMASK, &mask, NULL);
+  printf("serving on %s (%d threads, level %d, %d ms budget)\n", path, threads, server->level, budget);
+  fflush(stdout);
+
+  while(!serve_stopRequested) {
+    client = accept(fd, NULL, NULL);
+    if(client>=0)
+      serve_accept(server, client);
+    else if(errno!=EINTR && errno!=ECONNABORTED)
+      break;
+  }
+
+  pthread_mutex_lock(&server->lock);
+  server->stopping = TRUE;
+  pthread_cond_broadcast(&server->ready);
+  pthread_mutex_unlock(&server->lock);
+  for(i=0; i<threads; ++i)
+    pthread_join(tids[i], NULL);
+  while((r = server->head)) {
+    server->head = r->next;
+    serve_error(r->fd, "server stopped");
+    free(r);
+  }
+  for(i=0; i<SERVE_CACHE_SIZE; ++i)
+    free(server->cache[i].moves);
+  free(server->searching);
+  pthread_cond_destroy(&server->solved);
+  pthread_cond_destroy(&server->ready);
+  pthread_mutex_destroy(&server->lock);
+  free(server);
+  free(tids);
+  close(fd);
+  unlink(path);
+  return 0;
+}
+
+extern int serve_request(const char* path, const char* request, FILE* out) {
+  char buf[4096];
+  int n, fd = serve_connect(path), first = TRUE, error = FALSE;
+  if(fd<0)
+    return 1;
+  serve_write(fd, request, strlen(request));
+  while((n = read(fd, buf, sizeof(buf)))>0 || (n<0 && errno==EINTR)) {
+    if(n<=0)
+      continue;
+    if(first)
+      error = strncmp(buf, "OK", MIN(n, 2))!=0;
+    first = FALSE;
+    fwrite(buf, 1, n, out);
+  }
+  close(fd);
+  return (first || error) ? 2 : 0;
+}
+
+#endif
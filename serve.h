@@ -0,0 +1,49 @@
+#ifndef _SERVE_H
+#define _SERVE_H
+/**
+ * Solver daemon module
+ * 
+ * A long-running server answering "best continuation" requests on a Unix domain socket.
+ * Clients are queued and taken in batches (up to 16) by a pool of worker threads,
+ * which read their requests together: the positions of a batch are searched together on one
+ * scheduler ( @see search_runBatch ), each within the time budget of its request, and
+ * continuations are cached by position hash (a position already being searched is waited for
+ * instead of searched again).
+ * 
+ * Protocol (text lines, a request ends with a line holding a single dot):
+ *   SOLVE [{budget ms}]    followed by the position in the save file format
+ *     -> OK {final score} {continuation lines} {cached: 0 or 1}
+ *        followed by the continuation in the save file format and a "." line
+ *   STATS
+ *     -> OK queue {depth} max_queue {depth} requests {n} cache_hits {n} p50_ms {ms} p99_ms {ms}
+ *   an invalid request gets "ERR {message}"
+ * Latencies are measured from the connection to the answer.
+ */
+
+#include <stdio.h>
+
+#define SERVE_SOCKET_DEFAULT "morpion.sock"
+#define SERVE_BUDGET_DEFAULT 1000 // ms
+#define SERVE_BUDGET_MAX 600000 // ms
+#define SERVE_REQUEST_TEXT_MAX 65536 // bytes
+
+/**
+ * Run the server until it receives SIGINT or SIGTERM
+ * @param path: the socket path (replaced if it exists)
+ * @param threads: the number of worker threads
+ * @param level: the search level ( @see search_run )
+ * @param budget: the time budget of requests which don't give one (ms)
+ * @return 0 if success, 1 if the socket can't be created
+ */
+extern int serve_run(const char* path, int threads, int level, int budget);
+
+/**
+ * Send a request to a server and write its answer
+ * @param path: the server socket path
+ * @param request: the request text, with its final "." line
+ * @param out: the stream to write the answer to
+ * @return 0 if the answer is OK, 1 if the server can't be reached, 2 if the answer is an error
+ */
+extern int serve_request(const char* path, const char* request, FILE* out);
+
+#endif
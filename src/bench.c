@@ -0,0 +1,393 @@
+/**
+ * Engine micro-benchmarks
+ *
+ * Runs each benchmark until a minimum time is spent and prints a JSON report
+ * (ns/op and allocations/op, average final score of rollouts) on the standard output.
+ * batch_playout/{lanes} plays uniform rollouts in lockstep: compare its ns/op (one game)
+ * with rollout/uniform, the scalar runner.
+ * Positions are built from seeded random playouts, so runs with the same seed
+ * measure the same work.
+ *
+ * usage: morpion_bench [--seed {seed}] [--time {ms per benchmark}] [--weights {rollout weights file}]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../batch.h"
+#include "../game.h"
+#include "../export.h"
+#include "../rollout.h"
+#include "../ui.h"
+#include "../utils.h"
+
+#define BENCH_SEED 42
+#define BENCH_TIME_MS 500
+#define BENCH_BATCH 16 // games prepared outside of the timed section
+#define BENCH_SAVE_FILE "morpion_bench.sav"
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+/// Allocation counting
+
+static long allocations = 0;
+
+#ifdef MORPION_BENCH_COUNT_ALLOCS
+// the target is linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    allocations++;
+    return __real_malloc(size);
+}
+void *__wrap_calloc(size_t n, size_t size)
+{
+    allocations++;
+    return __real_calloc(n, size);
+}
+void *__wrap_realloc(void *p, size_t size)
+{
+    allocations++;
+    return __real_realloc(p, size);
+}
+#endif
+
+/// Report
+
+typedef struct _Result
+{
+    const char *name;
+    long ops;
+    double seconds;
+    long allocations;
+    double score; // average final score (rollouts), < 0 if not relevant
+} Result;
+
+static int nresults = 0;
+static unsigned long long benchRandom; // random state of the fixture playouts
+static Result results[32];
+
+static void report(const char *name, long ops, double seconds, long allocs)
+{
+    Result *r = &results[nresults++];
+    r->name = name;
+    r->ops = ops;
+    r->seconds = seconds;
+    r->allocations = allocs;
+    r->score = -1;
+}
+
+static void printReport(unsigned seed, int timeMs)
+{
+    int i;
+    printf("{\n  \"seed\": %u,\n  \"time_ms\": %d,\n  \"benchmarks\": [\n", seed, timeMs);
+    for (i = 0; i < nresults; ++i)
+    {
+        printf("    {\"name\": \"%s\", \"ops\": %ld, \"ns_per_op\": %.1f, ", results[i].name, results[i].ops,
+               results[i].seconds * 1e9 / results[i].ops);
+#ifdef MORPION_BENCH_COUNT_ALLOCS
+        printf("\"allocs_per_op\": %.3f", (double)results[i].allocations / results[i].ops);
+#else
+        printf("\"allocs_per_op\": null");
+#endif
+        if (results[i].score >= 0)
+            printf(", \"avg_score\": %.2f", results[i].score);
+        printf("}");
+        printf("%s\n", i < nresults - 1 ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+/// Fixtures
+
+/**
+ * Play a random game until its end
+ * @return the number of lines played
+ */
+static int playout(Game *game)
+{
+    int length;
+    Line *lines;
+    while (game_computeAllPossibilities(game) > 0)
+    {
+        lines = game_getAllPossibilities(game, &length);
+        game_consumeLine(game, lines[util_random(&benchRandom) % length]);
+    }
+    return game_getLinesCount(game);
+}
+
+static Game *replay(Line *lines, int nlines)
+{
+    int i;
+    Game *game = game_init();
+    for (i = 0; i < nlines; ++i)
+        game_consumeLine(game, lines[i]);
+    game_computeAllPossibilities(game);
+    return game;
+}
+
+/// Benchmarks
+
+static void benchComputeAllPossibilities(const char *name, Game *game, double minTime)
+{
+    long ops = 0, allocs = allocations;
+    double start = util_getTime(), elapsed;
+    do
+    {
+        game_computeAllPossibilities(game);
+        ops++;
+    } while ((elapsed = util_getTime() - start) < minTime);
+    report(name, ops, elapsed, allocations - allocs);
+}
+
+static void benchConsumeLine(Line *lines, int nlines, double minTime)
+{
+    Game *games[BENCH_BATCH];
+    long ops = 0, allocs = 0;
+    double elapsed = 0, start;
+    int i, j;
+    do
+    {
+        for (i = 0; i < BENCH_BATCH; ++i)
+            games[i] = game_init();
+        allocs -= allocations;
+        start = util_getTime();
+        for (i = 0; i < BENCH_BATCH; ++i)
+            for (j = 0; j < nlines; ++j)
+                game_consumeLine(games[i], lines[j]);
+        elapsed += util_getTime() - start;
+        allocs += allocations;
+        ops += BENCH_BATCH * nlines;
+        for (i = 0; i < BENCH_BATCH; ++i)
+            game_close(games[i]);
+    } while (elapsed < minTime);
+    report("game_consumeLine", ops, elapsed, allocs);
+}
+
+static void benchUndoLine(Line *lines, int nlines, double minTime)
+{
+    Game *games[BENCH_BATCH];
+    long ops = 0, allocs = 0;
+    double elapsed = 0, start;
+    int i, j;
+    do
+    {
+        for (i = 0; i < BENCH_BATCH; ++i)
+            games[i] = replay(lines, nlines);
+        allocs -= allocations;
+        start = util_getTime();
+        for (i = 0; i < BENCH_BATCH; ++i)
+            for (j = 0; j < nlines; ++j)
+                game_undoLine(games[i]);
+        elapsed += util_getTime() - start;
+        allocs += allocations;
+        ops += BENCH_BATCH * nlines;
+        for (i = 0; i < BENCH_BATCH; ++i)
+            game_close(games[i]);
+    } while (elapsed < minTime);
+    report("game_undoLine", ops, elapsed, allocs);
+}
+
+static void benchClone(Game *game, double minTime)
+{
+    Game *games[BENCH_BATCH];
+    long ops = 0, allocs = allocations;
+    double start = util_getTime(), elapsed;
+    int i;
+    do
+    {
+        for (i = 0; i < BENCH_BATCH; ++i)
+            games[i] = game_clone(game);
+        for (i = 0; i < BENCH_BATCH; ++i)
+            game_close(games[i]);
+        ops += BENCH_BATCH;
+    } while ((elapsed = util_getTime() - start) < minTime);
+    report("game_clone", ops, elapsed, allocations - allocs);
+}
+
+static void benchExport(Game *game, double minTime)
+{
+    long ops = 0, allocs = allocations;
+    double start = util_getTime(), elapsed;
+    game_setFilepath(game, BENCH_SAVE_FILE);
+    do
+    {
+        ie_exportGame(game);
+        ops++;
+    } while ((elapsed = util_getTime() - start) < minTime);
+    report("ie_exportGame", ops, elapsed, allocations - allocs);
+}
+
+static void benchImport(double minTime)
+{
+    Game *game;
+    long ops = 0, allocs = 0;
+    double elapsed = 0, start;
+    do
+    {
+        game = game_init();
+        allocs -= allocations;
+        start = util_getTime();
+        ie_importGame(BENCH_SAVE_FILE, game);
+        elapsed += util_getTime() - start;
+        allocs += allocations;
+        ops++;
+        free(game_getNickname(game));
+        game_close(game);
+    } while (elapsed < minTime);
+    report("ie_importGame", ops, elapsed, allocs);
+}
+
+static void benchPlayout(double minTime)
+{
+    Game *game;
+    long ops = 0, allocs = allocations;
+    double start = util_getTime(), elapsed;
+    do
+    {
+        game = game_init();
+        playout(game);
+        game_close(game);
+        ops++;
+    } while ((elapsed = util_getTime() - start) < minTime);
+    report("random_playout", ops, elapsed, allocations - allocs);
+}
+
+static void benchRollout(const char *name, RolloutPolicy *policy, unsigned long long seed, double minTime)
+{
+    Game *game;
+    long ops = 0, score = 0, allocs = allocations;
+    double start = util_getTime(), elapsed;
+    int length;
+    do
+    {
+        game = game_init();
+        score += rollout_play(game, policy, &seed, NULL, &length);
+        game_close(game);
+        ops++;
+    } while ((elapsed = util_getTime() - start) < minTime);
+    report(name, ops, elapsed, allocations - allocs);
+    results[nresults - 1].score = (double)score / ops;
+}
+
+/**
+ * Random games played in lockstep by batches of lanes games, to compare with rollout/uniform
+ * One op is one game.
+ */
+static void benchBatchPlayout(const char *name, int lanes, unsigned long long seed, double minTime)
+{
+    Game *games[BATCH_LANES];
+    unsigned long long random[BATCH_LANES];
+    int scores[BATCH_LANES];
+    long ops = 0, score = 0, allocs = allocations;
+    double start = util_getTime(), elapsed;
+    int i;
+    for (i = 0; i < lanes; ++i)
+        games[i] = game_init();
+    do
+    {
+        for (i = 0; i < lanes; ++i)
+            random[i] = util_random(&seed);
+        batch_playout(games, lanes, random, scores, NULL, NULL);
+        for (i = 0; i < lanes; ++i)
+            score += scores[i];
+        ops += lanes;
+    } while ((elapsed = util_getTime() - start) < minTime);
+    report(name, ops, elapsed, allocations - allocs);
+    results[nresults - 1].score = (double)score / ops;
+    for (i = 0; i < lanes; ++i)
+        game_close(games[i]);
+}
+
+static void benchUpdateGrid(Game *game, double minTime)
+{
+    long ops = 0, allocs;
+    double start, elapsed;
+    FILE *out = fopen(NULL_DEVICE, "w"), *in = fopen(NULL_DEVICE, "r");
+    if (out == NULL || in == NULL || ui_initScreen(out, in) != 0)
+    {
+        fprintf(stderr, "ui_updateGrid: unable to create an offscreen screen, skipped\n");
+        return;
+    }
+    game_setMode(game, GM_VISUAL);
+    allocs = allocations;
+    start = util_getTime();
+    do
+    {
+        ui_updateGrid(game);
+        ops++;
+    } while ((elapsed = util_getTime() - start) < minTime);
+    report("ui_updateGrid", ops, elapsed, allocations - allocs);
+    ui_close();
+    fclose(out);
+    fclose(in);
+}
+
+int main(int argc, char *argv[])
+{
+    int seed = BENCH_SEED, timeMs = BENCH_TIME_MS, nlines, length;
+    double minTime;
+    Line *lines, *recorded;
+    Game *start, *middle, *end;
+    RolloutPolicy *policy = malloc(sizeof(RolloutPolicy));
+    char *weights = 0;
+
+    util_getArgValue(argc, argv, "--seed", &seed);
+    util_getArgValue(argc, argv, "--time", &timeMs);
+    util_getArgString(argc, argv, "--weights", &weights);
+    minTime = timeMs / 1000.0;
+
+    // the reference game: a seeded random playout
+    benchRandom = seed;
+    end = game_init();
+    nlines = playout(end);
+    lines = game_getLines(end, &length);
+    recorded = malloc(sizeof(Line) * nlines);
+    memcpy(recorded, lines, sizeof(Line) * nlines);
+    start = game_init();
+    middle = replay(recorded, nlines / 2);
+
+    benchComputeAllPossibilities("game_computeAllPossibilities/start", start, minTime);
+    benchComputeAllPossibilities("game_computeAllPossibilities/middle", middle, minTime);
+    benchComputeAllPossibilities("game_computeAllPossibilities/end", end, minTime);
+    benchConsumeLine(recorded, nlines, minTime);
+    benchUndoLine(recorded, nlines, minTime);
+    benchClone(middle, minTime);
+    benchExport(end, minTime);
+    benchImport(minTime);
+    remove(BENCH_SAVE_FILE);
+    benchRandom = seed;
+    benchPlayout(minTime);
+    rollout_init(policy, ROLLOUT_UNIFORM);
+    benchRollout("rollout/uniform", policy, seed, minTime);
+    rollout_init(policy, ROLLOUT_MOBILITY);
+    benchRollout("rollout/mobility", policy, seed, minTime);
+    rollout_init(policy, ROLLOUT_CENTRAL);
+    benchRollout("rollout/central", policy, seed, minTime);
+    if (weights != NULL && rollout_loadWeights(weights, policy) == 0)
+        benchRollout("rollout/learned", policy, seed, minTime);
+    else if (weights != NULL)
+        fprintf(stderr, "rollout/learned: unable to read %s, skipped\n", weights);
+    benchBatchPlayout("batch_playout/1", 1, seed, minTime);
+    benchBatchPlayout("batch_playout/8", 8, seed, minTime);
+    benchBatchPlayout("batch_playout/64", 64, seed, minTime);
+    benchUpdateGrid(middle, minTime);
+
+    printReport(seed, timeMs);
+
+    game_close(start);
+    game_close(middle);
+    game_close(end);
+    free(recorded);
+    free(policy);
+    free(weights);
+    return 0;
+}
@@ -1,8 +1,10 @@
 // IMPORTANT! If you don't have delayms.h, get it from here:
 // https://github.com/flarn2006/MiscPrograms/blob/master/delayms.h
 
-#include <vector>
+#include <chrono>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 
 //#include <curses.h>
@@ -10,6 +12,8 @@
 
 //#include "delayms.h"
 
+#include "../psys.h"
+
 #ifndef delayms
 #ifdef _WIN32
 #include <windows.h>
@@ -22,57 +26,57 @@
 
 #define TIME_STEP 0.01f
 #define MAX_PARTICLES 4096
+#define MAX_FRAME_STEPS 8
 #define VEL_INCREMENT 0.5f
 #define ACCEL_INCREMENT 2.0f
 #define AGE_INCREMENT 0.2f
 
-class Particle
-{
-private:
-    float vx, vy;
-    float ax, ay;
-    float age;
-
-public:
-    float x, y;
-
-    Particle(float startX, float startY, float maxSpeed)
-    {
-        x = startX;
-        y = startY;
+#define BENCH_SECONDS 1.0
 
-        vx = (float)rand() / (0.5f * RAND_MAX) - 1.0f;
-        vy = (float)rand() / (0.5f * RAND_MAX) - 1.0f;
-        vx *= maxSpeed;
-        vy *= maxSpeed;
-
-        ax = ay = 0.0f;
+static double now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-        age = 0.0f;
-    }
+/**
+ * Headless benchmark: simulate full systems of several sizes and report particles/sec
+ */
+static int bench()
+{
+    static const int sizes[] = {4096, 65536, 1048576};
+    size_t i, steps;
+    int n, kernel;
+    double start, elapsed;
 
-    void simulate(float time)
+    for (kernel = 0; kernel < 2; kernel++)
     {
-        x += vx * time;
-        y += vy * time;
-
-        vx += ax * time;
-        vy += ay * time;
-
-        age += time;
-    }
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        {
+            ParticleSystem *psys = psys_new(sizes[i]);
+            if (psys_setVectorized(psys, kernel == 1) != (kernel == 1))
+            {
+                printf("avx2 integrator not available\n");
+                psys_close(psys);
+                return 0;
+            }
+            for (n = 0; n < sizes[i]; n++)
+                psys_emit(psys, 0.0f, 0.0f, 10.0f);
 
-    float getAge()
-    {
-        return age;
-    }
+            steps = 0;
+            start = now();
+            do
+            {
+                psys_simulate(psys, TIME_STEP, 0.0f, 2.0f, 1e9f);
+                steps++;
+            } while ((elapsed = now() - start) < BENCH_SECONDS);
+            psys_close(psys);
 
-    void setAccel(float accelX, float accelY)
-    {
-        ax = accelX;
-        ay = accelY;
+            printf("%-6s %8d particles: %8zu steps in %.3f s, %.3e particles/sec\n", kernel ? "avx2" : "scalar",
+                   sizes[i], steps, elapsed, (double)steps * sizes[i] / elapsed);
+        }
     }
-};
+    return 0;
+}
 
 int main(int argc, char *argv[])
 {
@@ -85,7 +89,15 @@ int main(int argc, char *argv[])
     float maxAge = 1.0f;
     char display = 3;
 
-    std::vector<Particle> *psys = new std::vector<Particle>();
+    double lastTime, lag;
+    int steps;
+
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+    {
+        return bench();
+    }
+
+    ParticleSystem *psys = psys_new(MAX_PARTICLES);
 
     initscr();
     cbreak();
@@ -105,15 +117,29 @@ int main(int argc, char *argv[])
     init_pair(4, 6, 0); // cyan
 
     int quitNow = 0;
+    lastTime = now();
+    lag = 0.0;
     while (!quitNow)
     {
         erase();
 
-        std::vector<Particle>::iterator i;
-        for (i = psys->begin(); i != psys->end(); i++)
+        // fixed timestep: run as many simulation steps as real time elapsed,
+        // and emit one particle per step
+        lag += now() - lastTime;
+        lastTime = now();
+        for (steps = 0; lag >= TIME_STEP && steps < MAX_FRAME_STEPS; steps++)
         {
-            i->simulate(TIME_STEP);
-            float age = i->getAge();
+            psys_simulate(psys, TIME_STEP, accelX, accelY, maxAge);
+            psys_emit(psys, originX, originY, velocity);
+            lag -= TIME_STEP;
+        }
+        if (steps == MAX_FRAME_STEPS)
+            lag = 0.0; // too far behind: drop the remaining time instead of spiraling
+
+        int i;
+        for (i = 0; i < psys_size(psys); i++)
+        {
+            float age = psys_age(psys, i);
 
             if (age <= maxAge)
             {
@@ -133,20 +159,10 @@ int main(int argc, char *argv[])
 
                 attron(A_BOLD);
                 attron(COLOR_PAIR(pair));
-                mvprintw((int)i->y, (int)i->x * 2, "*");
+                mvprintw((int)psys_y(psys, i), (int)psys_x(psys, i) * 2, "*");
                 attroff(COLOR_PAIR(pair));
                 attroff(A_BOLD);
             }
-
-            i->setAccel(accelX, accelY);
-        }
-
-        Particle p(originX, originY, velocity);
-        psys->push_back(p);
-
-        if (psys->size() > MAX_PARTICLES)
-        {
-            psys->erase(psys->begin());
         }
 
         attron(A_BOLD);
@@ -218,7 +234,7 @@ int main(int argc, char *argv[])
             break;
 
         case 'x':
-            psys->clear();
+            psys_clear(psys);
             break;
         case '`':
             display++;
@@ -230,6 +246,6 @@ int main(int argc, char *argv[])
     }
 
     endwin();
-    delete psys;
+    psys_close(psys);
     return 0;
 }
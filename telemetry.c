@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telemetry.h"
+
+#ifdef MORPION_NO_TELEMETRY
+
+extern int telemetry_start(const char* filepath, double interval) {
+  return 1;
+}
+
+extern void telemetry_stop() {
+}
+
+#else
+
+#include <errno.h>
+#include <pthread.h>
+
+#include "globals.h"
+#include "utils.h"
+
+static const char* counterNames[TELEMETRY_COUNTERS] = {
+  "nodes", "playouts", "hits", "moves", "movegen_ns", "busy_ns"
+};
+
+_Thread_local TelemetryBlock* telemetryBlock = NULL;
+
+/**
+ * Reporter state
+ */
+static struct {
+  _Atomic(TelemetryBlock*) blocks; // never removed before telemetry_stop
+  atomic_int started;
+  FILE* file;
+  double interval;
+  double start;
+  int stopping;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_t thread;
+} telemetry = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER };
+
+extern void telemetry_attach() {
+  TelemetryBlock* block;
+  int unused;
+  if(!atomic_load(&telemetry.started) || telemetryBlock)
+    return;
+  // reuse the block of a finished thread: counters are totals, they keep adding up
+  for(block=atomic_load(&telemetry.blocks); block; block=block->next) {
+    unused = 0;
+    if(atomic_compare_exchange_strong(&block->used, &unused, 1))
+      break;
+  }
+  if(block==NULL) {
+    block = calloc(1, sizeof(TelemetryBlock));
+    atomic_init(&block->used, 1);
+    block->next = atomic_load(&telemetry.blocks);
+    while(!atomic_compare_exchange_weak(&telemetry.blocks, &block->next, block));
+  }
+  telemetryBlock = block;
+  atomic_store(&block->attached, telemetry_getTime());
+}
+
+extern void telemetry_detach() {
+  TelemetryBlock* block = telemetryBlock;
+  if(block==NULL)
+    return;
+  telemetry_countTime(TELEMETRY_BUSY_NS, atomic_load(&block->attached));
+  atomic_store(&block->attached, 0);
+  atomic_store(&block->used, 0);
+  telemetryBlock = NULL;
+}
+
+/**
+ * Merge the blocks and write a JSON line
+ * @param playouts, last: the playouts count and the time of the previous report, updated
+ */
+static void telemetry_report(long long* playouts, double* last) {
+  long long totals[TELEMETRY_COUNTERS], attached;
+  TelemetryBlock* block;
+  int i, threads = 0, bestScore = 0;
+  double now = util_getTime();
+  struct timespec ts;
+  memset(totals, 0, sizeof(totals));
+  for(block=atomic_load(&telemetry.blocks); block; block=block->next) {
+    for(i=0; i<TELEMETRY_COUNTERS; ++i)
+      totals[i] += atomic_load_explicit(&block->counters[i], memory_order_relaxed);
+    bestScore = MAX(bestScore, atomic_load_explicit(&block->bestScore, memory_order_relaxed));
+    if((attached = atomic_load_explicit(&block->attached, memory_order_relaxed))) { // still searching
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      totals[TELEMETRY_BUSY_NS] += ts.tv_sec*1000000000LL + ts.tv_nsec - attached;
+      ++ threads;
+    }
+  }
+  fprintf(telemetry.file, "{\"time\": %.3f, \"threads\": %d", now - telemetry.start, threads);
+  for(i=0; i<TELEMETRY_COUNTERS; ++i)
+    fprintf(telemetry.file, ", \"%s\": %lld", counterNames[i], totals[i]);
+  fprintf(telemetry.file, ", \"bookkeeping_ns\": %lld, \"best_score\": %d, \"playouts_per_s\": %.1f}\n",
+          totals[TELEMETRY_BUSY_NS] - totals[TELEMETRY_MOVEGEN_NS], bestScore,
+          (totals[TELEMETRY_PLAYOUTS] - *playouts) / MAX(now - *last, 1e-9));
+  fflush(telemetry.file);
+  *playouts = totals[TELEMETRY_PLAYOUTS];
+  *last = now;
+}
+
+static void* telemetry_reporter(void* arg) {
+  struct timespec deadline;
+  long long playouts = 0, ns;
+  double last = telemetry.start, next = telemetry.start, remaining;
+  pthread_mutex_lock(&telemetry.lock);
+  while(!telemetry.stopping) {
+    next += telemetry.interval;
+    remaining = next - util_getTime();
+    if(remaining>0) {
+      clock_gettime(CLOCK_REALTIME, &deadline); // the clock of the condition
+      ns = deadline.tv_nsec + (long long)(remaining*1e9);
+      deadline.tv_sec += ns/1000000000LL;
+      deadline.tv_nsec = ns%1000000000LL;
+      while(!telemetry.stopping && pthread_cond_timedwait(&telemetry.wake, &telemetry.lock, &deadline)!=ETIMEDOUT);
+    }
+    telemetry_report(&playouts, &last);
+  }
+  pthread_mutex_unlock(&telemetry.lock);
+  return NULL;
+}
+
+extern int telemetry_start(const char* filepath, double interval) {
+  if(atomic_load(&telemetry.started))
+    return 1;
+  if(filepath==NULL || strcmp(filepath, "-")==0)
+    telemetry.file = stderr;
+  else if((telemetry.file = fopen(filepath, "a"))==NULL)
+    return 1;
+  telemetry.interval = interval>0 ? interval : TELEMETRY_INTERVAL_DEFAULT;
+  telemetry.start = util_getTime();
+  telemetry.stopping = FALSE;
+  atomic_store(&telemetry.started, TRUE);
+  pthread_create(&telemetry.thread, NULL, telemetry_reporter, NULL);
+  return 0;
+}
+
+extern void telemetry_stop() {
+  TelemetryBlock *block, *next;
+  if(!atomic_load(&telemetry.started))
+    return;
+  pthread_mutex_lock(&telemetry.lock);
+  telemetry.stopping = TRUE;
+  pthread_cond_signal(&telemetry.wake);
+  pthread_mutex_unlock(&telemetry.lock);
+  pthread_join(telemetry.thread, NULL); // the reporter writes a last line
+  atomic_store(&telemetry.started, FALSE);
+  for(block=atomic_exchange(&telemetry.blocks, NULL); block; block=next) {
+    next = block->next;
+    free(block);
+  }
+  telemetryBlock = NULL;
+  if(telemetry.file!=stderr)
+    fclose(telemetry.file);
+}
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef _TELEMETRY_H
+#define _TELEMETRY_H
+/**
+ * Telemetry module
+ *
+ * Live counters of the searches, reported as JSON lines every few seconds by a reporter thread.
+ * Each search thread owns a counters block ( @see telemetry_attach ) and is the only one writing it,
+ * with plain relaxed atomic stores: counting costs no lock and no read-modify-write. The reporter
+ * merges the blocks by reading them, without stopping the threads.
+ * Building with MORPION_NO_TELEMETRY defined compiles every counter out.
+ */
+
+#ifndef MORPION_NO_TELEMETRY
+#include <stdatomic.h>
+#include <time.h>
+#endif
+
+#define TELEMETRY_INTERVAL_DEFAULT 5 // seconds
+
+/**
+ * Telemetry counters
+ */
+typedef enum {
+  TELEMETRY_NODES=0, // search positions evaluated
+  TELEMETRY_PLAYOUTS, // random games played
+  TELEMETRY_HITS, // positions found already searched (duplicates in a beam, daemon cache)
+  TELEMETRY_MOVES, // possible lines generated
+  TELEMETRY_MOVEGEN_NS, // time spent generating possible lines
+  TELEMETRY_BUSY_NS, // time spent attached by the threads (move generation included)
+  TELEMETRY_COUNTERS
+} TelemetryCounter;
+
+/**
+ * Start reporting
+ * @param filepath: the file JSON lines are appended to (NULL or "-" for stderr)
+ * @param interval: the time between two reports (s)
+ * @return 0 if success, 1 if the file can't be opened (or if telemetry is compiled out)
+ */
+extern int telemetry_start(const char* filepath, double interval);
+
+/**
+ * Stop reporting, after a last report
+ */
+extern void telemetry_stop();
+
+#ifndef MORPION_NO_TELEMETRY
+
+/**
+ * A counters block, owned by one thread at a time
+ */
+typedef struct _TelemetryBlock {
+  atomic_llong counters[TELEMETRY_COUNTERS];
+  atomic_int bestScore;
+  atomic_int used; // owned by a thread
+  atomic_llong attached; // time the owner attached (ns), counted in TELEMETRY_BUSY_NS on detach
+  struct _TelemetryBlock* next;
+} TelemetryBlock;
+
+extern _Thread_local TelemetryBlock* telemetryBlock; // the block of the calling thread, NULL if not attached
+
+/**
+ * Give the calling thread a counters block (a no-op if telemetry isn't started)
+ */
+extern void telemetry_attach();
+
+/**
+ * Release the block of the calling thread (its counts are kept in the totals)
+ * The time between attach and detach is counted as busy time.
+ */
+extern void telemetry_detach();
+
+/**
+ * Add to a counter of the calling thread
+ */
+static inline void telemetry_count(TelemetryCounter counter, long long n) {
+  TelemetryBlock* block = telemetryBlock;
+  if(block)
+    atomic_store_explicit(&block->counters[counter],
+                          atomic_load_explicit(&block->counters[counter], memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+/**
+ * Report a final score found by the calling thread
+ */
+static inline void telemetry_score(int score) {
+  TelemetryBlock* block = telemetryBlock;
+  if(block && score>atomic_load_explicit(&block->bestScore, memory_order_relaxed))
+    atomic_store_explicit(&block->bestScore, score, memory_order_relaxed);
+}
+
+/**
+ * Get a timestamp for time counters (ns), 0 if the calling thread isn't attached
+ */
+static inline long long telemetry_getTime() {
+  struct timespec ts;
+  if(telemetryBlock==NULL)
+    return 0;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Add the time elapsed since a timestamp to a time counter
+ */
+static inline void telemetry_countTime(TelemetryCounter counter, long long start) {
+  if(start)
+    telemetry_count(counter, telemetry_getTime() - start);
+}
+
+#else
+
+#define telemetry_attach()
+#define telemetry_detach()
+#define telemetry_count(counter, n)
+#define telemetry_score(score)
+#define telemetry_getTime() 0LL
+#define telemetry_countTime(counter, start) ((void)(start))
+
+#endif
+
+#endif
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tree.h"
+#include "globals.h"
+
+/**
+ * A block of children, during a collection
+ */
+typedef struct _TreeBlock {
+  int start;
+  int count;
+} TreeBlock;
+
+struct _Tree {
+  TreeNode* nodes;
+  int capacity;
+  int used;
+  int collections;
+  // collection buffers, allocated with the pool
+  int* stack;
+  TreeBlock* blocks;
+};
+
+static void tree_initNode(TreeNode* node, int move) {
+  node->visits = 0;
+  node->best = -1;
+  node->total = 0;
+  node->children = TREE_UNEXPANDED;
+  node->nchildren = 0;
+  node->move = move;
+}
+
+extern Tree* tree_new(int capacity) {
+  Tree* tree = malloc(sizeof(Tree));
+  capacity = MAX(capacity, TREE_CAPACITY_MIN);
+  tree->nodes = malloc(sizeof(TreeNode)*capacity);
+  tree->stack = malloc(sizeof(int)*capacity);
+  tree->blocks = malloc(sizeof(TreeBlock)*capacity);
+  if(tree->nodes==NULL || tree->stack==NULL || tree->blocks==NULL) {
+    free(tree->nodes);
+    free(tree->stack);
+    free(tree->blocks);
+    free(tree);
+    return NULL;
+  }
+  tree->capacity = capacity;
+  tree->collections = 0;
+  tree->used = 1;
+  tree_initNode(&tree->nodes[TREE_ROOT], -1);
+  return tree;
+}
+
+extern void tree_close(Tree* tree) {
+  free(tree->nodes);
+  free(tree->stack);
+  free(tree->blocks);
+  free(tree);
+}
+
+extern TreeNode* tree_getNodes(Tree* tree) {
+  return tree->nodes;
+}
+
+extern int tree_getSize(Tree* tree) {
+  return tree->used;
+}
+
+extern int tree_getCapacity(Tree* tree) {
+  return tree->capacity;
+}
+
+extern int tree_getCollections(Tree* tree) {
+  return tree->collections;
+}
+
+extern int tree_alloc(Tree* tree, int n) {
+  if(tree->used+n>tree->capacity)
+    return -1;
+  tree->used += n;
+  return tree->used-n;
+}
+
+/**
+ * List the blocks of children reachable from the root
+ * @return the number of blocks (the root is the first one)
+ */
+static int tree_getBlocks(Tree* tree) {
+  TreeNode* nodes = tree->nodes;
+  int i, node, children, nblocks = 1, depth = 0;
+  tree->blocks[0].start = TREE_ROOT;
+  tree->blocks[0].count = 1;
+  tree->stack[depth++] = TREE_ROOT;
+  while(depth>0) {
+    node = tree->stack[--depth];
+    if((children = nodes[node].children)<0 || nodes[node].nchildren==0)
+      continue;
+    tree->blocks[nblocks].start = children;
+    tree->blocks[nblocks++].count = nodes[node].nchildren;
+    for(i=0; i<nodes[node].nchildren; ++i)
+      tree->stack[depth++] = children+i;
+  }
+  return nblocks;
+}
+
+/**
+ * Count the nodes reachable from the root
+ */
+static int tree_countNodes(Tree* tree) {
+  int i, count = 0, nblocks = tree_getBlocks(tree);
+  for(i=0; i<nblocks; ++i)
+    count += tree->blocks[i].count;
+  return count;
+}
+
+/**
+ * Prune the children of the nodes visited less than a number of times (the root is kept)
+ */
+static void tree_prune(Tree* tree, int visits) {
+  TreeNode* nodes = tree->nodes;
+  int i, j, nblocks = tree_getBlocks(tree);
+  for(i=1; i<nblocks; ++i) {
+    for(j=tree->blocks[i].start; j<tree->blocks[i].start+tree->blocks[i].count; ++j) {
+      if(nodes[j].visits<visits && nodes[j].children>=0) {
+        nodes[j].children = TREE_UNEXPANDED;
+        nodes[j].nchildren = 0;
+      }
+    }
+  }
+}
+
+static int tree_compareBlocks(const void* a, const void* b) {
+  return ((TreeBlock*)a)->start - ((TreeBlock*)b)->start;
+}
+
+/**
+ * Get the new start of a block (blocks are sorted by start, count holds the new start)
+ */
+static int tree_getNewStart(TreeBlock* blocks, int nblocks, int start) {
+  int low = 0, high = nblocks-1, middle;
+  while(low<high) {
+    middle = (low+high)/2;
+    if(blocks[middle].start<start)
+      low = middle+1;
+    else
+      high = middle;
+  }
+  return blocks[low].count;
+}
+
+/**
+ * Move the reachable blocks at the start of the pool, in their order (a block only moves down)
+ * @return the number of nodes used
+ */
+static int tree_compact(Tree* tree) {
+  TreeNode* nodes = tree->nodes;
+  TreeBlock* blocks = tree->blocks;
+  int i, j, children, count, used = 0, nblocks = tree_getBlocks(tree);
+  qsort(blocks, nblocks, sizeof(TreeBlock), tree_compareBlocks);
+  for(i=0; i<nblocks; ++i) { // count is now the new start, the stack keeps the count
+    tree->stack[i] = blocks[i].count;
+    blocks[i].count = used;
+    used += tree->stack[i];
+  }
+  for(i=0; i<nblocks; ++i)
+    for(j=blocks[i].start; j<blocks[i].start+tree->stack[i]; ++j)
+      if((children = nodes[j].children)>=0 && nodes[j].nchildren>0)
+        nodes[j].children = tree_getNewStart(blocks, nblocks, children);
+  for(i=0; i<nblocks; ++i) {
+    count = tree->stack[i];
+    if(blocks[i].count!=blocks[i].start)
+      memmove(nodes+blocks[i].count, nodes+blocks[i].start, sizeof(TreeNode)*count);
+  }
+  return used;
+}
+
+extern void tree_collect(Tree* tree) {
+  int visits, rootVisits, used;
+  // children visits never exceed their parent ones: pruned nodes are the least visited subtrees
+  rootVisits = tree->nodes[TREE_ROOT].visits;
+  used = tree_countNodes(tree);
+  for(visits=2; used>tree->capacity/2 && visits/2<=rootVisits; visits*=2) {
+    tree_prune(tree, visits);
+    used = tree_countNodes(tree);
+  }
+  tree->used = tree_compact(tree);
+  ++ tree->collections;
+}
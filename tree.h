@@ -0,0 +1,83 @@
+#ifndef _TREE_H
+#define _TREE_H
+/**
+ * Tree module
+ *
+ * The nodes of a search tree, in a pool allocated once: the tree never uses more than its
+ * capacity. The children of a node are a block of consecutive nodes, taken from the pool.
+ * When the pool is full, the tree is collected ( @see tree_collect ): the subtrees of the least
+ * visited nodes are pruned (the nodes keep their statistics and can be expanded again), and the
+ * remaining nodes are compacted at the start of the pool, so node indices are only valid until
+ * the next collection.
+ * A tree is used by one thread at a time.
+ */
+
+#define TREE_ROOT 0 // index of the root node
+#define TREE_UNEXPANDED -1 // children of a leaf
+#define TREE_CAPACITY_MIN 4096 // nodes
+#define TREE_CAPACITY_DEFAULT (1<<20) // nodes, 44 MB with the collection buffers
+
+/**
+ * A tree
+ */
+typedef struct _Tree Tree;
+
+/**
+ * A node: the position after a move
+ */
+typedef struct _TreeNode {
+  int visits; // games played through the node (virtual losses of running games included)
+  int best; // best final score of these games (max backup), -1 if none
+  long long total; // sum of their final scores
+  int children; // index of the first child, TREE_UNEXPANDED
+  int nchildren; // 0 if the game is over
+  int move; // line index played from the parent node ( @see line_getIndex ), -1 for the root
+} TreeNode;
+
+/**
+ * Create a tree with a root node
+ * @param capacity: the number of nodes of the pool (at least TREE_CAPACITY_MIN)
+ * @return the tree, or NULL if the pool can't be allocated
+ */
+extern Tree* tree_new(int capacity);
+
+/**
+ * Free a tree and its pool
+ */
+extern void tree_close(Tree* tree);
+
+/**
+ * Get the nodes of a tree, by index
+ * @return the pool
+ */
+extern TreeNode* tree_getNodes(Tree* tree);
+
+/**
+ * Get the number of nodes used
+ */
+extern int tree_getSize(Tree* tree);
+
+/**
+ * Get the number of nodes of the pool
+ */
+extern int tree_getCapacity(Tree* tree);
+
+/**
+ * Get the number of collections since the tree was created
+ */
+extern int tree_getCollections(Tree* tree);
+
+/**
+ * Take a block of nodes from the pool
+ * @param n: the number of nodes
+ * @return the index of the first node, -1 if the pool is full ( @see tree_collect )
+ */
+extern int tree_alloc(Tree* tree, int n);
+
+/**
+ * Make room in a full tree: prune the subtrees of the least visited nodes until half of the pool
+ * is free, then compact the pool
+ */
+extern void tree_collect(Tree* tree);
+
+#endif
@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 // #include <curses.h>
@@ -7,6 +8,10 @@
 #include "game.h"
 #include "points.h"
 #include "globals.h"
+#include "profile.h"
+#include "psys.h"
+#include "saver.h"
+#include "utils.h"
 
 #define ESCAPE_KEY 27
 #define ENTER_KEY 10
@@ -23,6 +28,13 @@
 
 #define BUFFER_SIZE 64
 
+#define FX_RATE 30 // particle frames per second
+#define FX_MAX_STEPS 8 // simulation steps caught up in one frame
+#define FX_CAPACITY 4096
+#define FX_MAX_AGE 1.2f
+#define FX_SPEED 6.0f
+#define FX_GRAVITY 9.0f
+
 typedef enum
 {
     CLR_DEFAULT = 1,
@@ -43,6 +55,15 @@ typedef enum
 WINDOW* win_grid;
 WINDOW* win_message;
 WINDOW* win_title;
+WINDOW* win_fx; // the grid as drawn before particles
+
+static ParticleSystem *fxParticles;
+static double fxLastStep; // time of the last simulation step
+static int actionTimeout = -1;
+
+static int debugOverlay = FALSE;
+static double fxFrameTime, fxFrameTimeMax; // seconds
+static int fxDroppedFrames;
 
 /// Static functions
 
@@ -138,11 +159,111 @@ static void cleanGrid()
         mvwhline(win_grid, i, 1, ' ', wLength);
 }
 
+static void drawDebug()
+{
+    SaverStats saves;
+    if (!debugOverlay)
+        return;
+    move(0, 0);
+    clrtoeol();
+    mvprintw(0, 0, "fx: %4d particles | frame %.2f ms (max %.2f) | dropped %d", psys_size(fxParticles),
+             fxFrameTime * 1000, fxFrameTimeMax * 1000, fxDroppedFrames);
+    if (saver_isRunning())
+    {
+        saver_getStats(&saves);
+        printw(" | save pending %.2f ms, last %.2f ms (max %.2f), %ld superseded", saves.pending * 1000,
+               saves.lastLatency * 1000, saves.maxLatency * 1000, saves.superseded);
+    }
+}
+
+/**
+ * Simulate the particles up to now at a fixed timestep and draw them over the grid
+ */
+static void fxFrame(double now)
+{
+    int i, steps, pair, x, y, h, w;
+    float age;
+    double start = util_getTime();
+
+    steps = (int)((now - fxLastStep) * FX_RATE);
+    if (steps > 1)
+        fxDroppedFrames += steps - 1;
+    fxLastStep += (double)steps / FX_RATE;
+    if (steps > FX_MAX_STEPS)
+    { // far behind: drop the remaining time instead of spiraling
+        steps = FX_MAX_STEPS;
+        fxLastStep = now;
+    }
+    while (steps-- > 0)
+        psys_simulate(fxParticles, 1.0f / FX_RATE, 0.0f, FX_GRAVITY, FX_MAX_AGE);
+
+    copywin(win_fx, win_grid, 0, 0, 0, 0, getmaxy(win_grid) - 1, getmaxx(win_grid) - 1, FALSE);
+    getmaxyx(win_grid, h, w);
+    wattron(win_grid, A_BOLD);
+    for (i = 0; i < psys_size(fxParticles); ++i)
+    {
+        x = (int)(psys_x(fxParticles, i) * 2);
+        y = (int)psys_y(fxParticles, i);
+        if (x < 1 || y < 1 || x >= w - 1 || y >= h - 1)
+            continue;
+        age = psys_age(fxParticles, i);
+        pair = age < FX_MAX_AGE * 0.33f ? CLR_GREEN : (age < FX_MAX_AGE * 0.66f ? CLR_YELLOW : CLR_RED);
+        setColor(win_grid, pair);
+        mvwprintw(win_grid, y, x, "*");
+    }
+    wattroff(win_grid, A_BOLD);
+    wrefresh(win_grid);
+
+    fxFrameTime = util_getTime() - start;
+    fxFrameTimeMax = MAX(fxFrameTime, fxFrameTimeMax);
+    drawDebug();
+    refresh();
+}
+
+/**
+ * Wait for a key, animating particles at FX_RATE meanwhile
+ * The key is read as soon as it is typed: frames are only drawn between keys.
+ */
+static int waitKey()
+{
+    int ch = ERR, wait;
+    double now = util_getTime(), deadline = now + actionTimeout / 1000.0;
+
+    if (psys_size(fxParticles) == 0)
+        return wgetch(win_grid);
+
+    copywin(win_grid, win_fx, 0, 0, 0, 0, getmaxy(win_grid) - 1, getmaxx(win_grid) - 1, FALSE);
+    while (psys_size(fxParticles) > 0 && ch == ERR && (actionTimeout < 0 || now < deadline))
+    {
+        wait = (int)((fxLastStep + 1.0 / FX_RATE - now) * 1000) + 1;
+        if (actionTimeout >= 0)
+            wait = MIN(wait, (int)((deadline - now) * 1000) + 1);
+        wtimeout(win_grid, MAX(wait, 0));
+        ch = wgetch(win_grid);
+        now = util_getTime();
+        if (ch == ERR && now >= fxLastStep + 1.0 / FX_RATE)
+            fxFrame(now);
+    }
+    copywin(win_fx, win_grid, 0, 0, 0, 0, getmaxy(win_grid) - 1, getmaxx(win_grid) - 1, FALSE);
+    wtimeout(win_grid, actionTimeout);
+    if (ch == ERR && psys_size(fxParticles) == 0)
+    { // particles are gone: show the clean grid and keep waiting
+        wrefresh(win_grid);
+        if (actionTimeout >= 0)
+            wtimeout(win_grid, MAX((int)((deadline - util_getTime()) * 1000), 0));
+        ch = wgetch(win_grid);
+        wtimeout(win_grid, actionTimeout);
+    }
+    return ch;
+}
+
 // Functions
 
-extern void ui_init()
+/**
+ * Create the windows and colors on the current screen
+ */
+static void setup()
 {
-    initscr();
     ESCDELAY = 0;
     if (has_colors() == FALSE)
     {
@@ -158,6 +279,8 @@ extern void ui_init()
     keypad(win_title, TRUE);
     keypad(win_grid, TRUE);
     keypad(win_message, TRUE);
+    win_fx = dupwin(win_grid);
+    fxParticles = psys_new(FX_CAPACITY);
     curs_set(0);
     start_color();
     init_pair(CLR_DEFAULT, COLOR_WHITE, COLOR_BLACK);
@@ -180,26 +303,45 @@ extern void ui_init()
     ui_refresh();
 }
 
+extern void ui_init()
+{
+    initscr();
+    setup();
+}
+
+extern int ui_initScreen(FILE *out, FILE *in)
+{
+    if (newterm(getenv("TERM") ? NULL : "xterm", out, in) == NULL)
+        return 1;
+    resizeterm(WIN_MESSAGE_TOP + 3, WIN_MESSAGE_WIDTH + 2);
+    setup();
+    return 0;
+}
+
 extern void ui_close()
 {
     clrtoeol();
     ui_refresh();
     delwin(win_grid);
     delwin(win_message);
+    delwin(win_fx);
+    psys_close(fxParticles);
     endwin();
 }
 
 extern void ui_refresh()
 {
+    PROFILE_SCOPE(PROFILE_RENDER);
     wrefresh(win_grid);
     wrefresh(win_message);
     wrefresh(win_title);
+    drawDebug();
     refresh();
 }
 
 extern Action ui_getAction()
 {
-    int ch = wgetch(win_grid);
+    int ch = waitKey();
     switch (ch)
     {
     case KEY_LEFT:
@@ -235,6 +377,22 @@ extern Action ui_getAction()
     case 127:           // for macosx
         return Action_UNDO;
 
+    case KEY_HOME:
+        return Action_HOME;
+
+    case KEY_END:
+        return Action_END;
+
+    case '+':
+    case '=':
+        return Action_FASTER;
+
+    case '-':
+        return Action_SLOWER;
+
+    case 'g':
+        return Action_GOTO;
+
     default:
         ui_refresh();
         return Action_NONE;
@@ -242,6 +400,55 @@ extern Action ui_getAction()
     return Action_NONE;
 }
 
+extern void ui_setActionTimeout(int ms)
+{
+    actionTimeout = ms;
+    wtimeout(win_grid, ms);
+}
+
+extern int ui_promptNumber(char *str, int *value)
+{
+    char buf[BUFFER_SIZE];
+    int status;
+    setColor(win_message, CLR_MESSAGE);
+    ui_printMessage(str);
+    echo();
+    curs_set(1);
+    wmove(win_message, 1, (WIN_MESSAGE_WIDTH + strlen(str)) / 2 + 1);
+    status = wgetnstr(win_message, buf, BUFFER_SIZE - 1);
+    noecho();
+    curs_set(0);
+    if (status == ERR || sscanf(buf, "%d", value) != 1)
+        return 1;
+    return 0;
+}
+
+extern void ui_burst(Point p, int strength)
+{
+    Point g = toGraphicCoord(p);
+    if (psys_size(fxParticles) == 0)
+        fxLastStep = util_getTime();
+    while (strength-- > 0)
+        psys_emit(fxParticles, (g.x + 2) / 2.0f, g.y + 1, FX_SPEED);
+}
+
+extern void ui_celebrate()
+{
+    int i;
+    for (i = 0; i < 12; ++i)
+        ui_burst(point_new(rand() % GRID_SIZE, GRID_SIZE / 4 + rand() % (GRID_SIZE / 2)), 40);
+}
+
+extern void ui_setDebug(int enabled)
+{
+    debugOverlay = enabled;
+    if (!enabled)
+    {
+        move(0, 0);
+        clrtoeol();
+    }
+}
+
 extern void ui_printMessage_info(char *str)
 {
     setColor(win_message, CLR_MESSAGE);
@@ -329,6 +536,7 @@ extern void ui_printInfos(Game *game)
 
 extern void ui_updateGrid(Game *game)
 {
+    PROFILE_SCOPE(PROFILE_RENDER);
     Point points[GRID_SIZE * GRID_SIZE];
     int npoints;
 
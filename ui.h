@@ -7,6 +7,8 @@
  * @author Gaetan Renaudeau <pro@grenlibre.fr>
  */
 
+#include <stdio.h>
+
 #include "game.h"
 
 /**
@@ -14,6 +16,14 @@
  */
 extern void ui_init();
 
+/**
+ * Init the User Interface on given streams instead of the terminal
+ * (ex: offscreen rendering into /dev/null)
+ * @param out, in : the terminal output and input streams
+ * @return 0 if success, 1 if the screen can't be created
+ */
+extern int ui_initScreen(FILE* out, FILE* in);
+
 /**
  * Close the User Interface
  */
@@ -31,6 +41,21 @@ extern void ui_refresh();
  */
 extern Action ui_getAction();
 
+/**
+ * Set how long ui_getAction waits for a key
+ * @param ms : the delay in milliseconds, or -1 to wait forever (default)
+ */
+extern void ui_setActionTimeout(int ms);
+
+/**
+ * Ask the user for a number in the message area
+ * Blocking function.
+ * @param str : the question to display
+ * @param value : the number typed by the user
+ * @return 0 if a number was typed, 1 else
+ */
+extern int ui_promptNumber(char* str, int* value);
+
 /**
  * Print infos of current game state
  * @param game : the current game object
@@ -53,6 +78,24 @@ extern void ui_printMessage_info(char* str);
 extern void ui_printMessage_error(char* str);
 extern void ui_printMessage_success(char* str);
 
+/**
+ * Emit a particle burst over the grid
+ * Particles are animated at a fixed rate while ui_getAction waits for a key.
+ * @param p : the case where the burst starts
+ * @param strength : the number of particles to emit
+ */
+extern void ui_burst(Point p, int strength);
+
+/**
+ * Emit fireworks over the whole grid (ex: at game over)
+ */
+extern void ui_celebrate();
+
+/**
+ * Show or hide the debug overlay (particle frame time and dropped frames)
+ */
+extern void ui_setDebug(int enabled);
+
 
 
 #endif
@@ -4,6 +4,12 @@
 #include <errno.h>
 #include <limits.h>
 #include <ctype.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
 
 #include "utils.h"
 
@@ -32,6 +38,34 @@ int util_abs(int n) {
   return n<0 ? -n : n;
 }
 
+extern double util_getTime() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+extern int util_getCpuCount() {
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+  return sysconf(_SC_NPROCESSORS_ONLN) > 0 ? (int)sysconf(_SC_NPROCESSORS_ONLN) : 1;
+#endif
+}
+
+extern unsigned long long util_random(unsigned long long* state) {
+  unsigned long long z = (*state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+extern unsigned long long util_randomStream(unsigned long long seed, unsigned long long stream) {
+  unsigned long long state = seed ^ (stream * 0xD1B54A32D192ED03ULL);
+  return util_random(&state);
+}
+
 static void consumeArg(int index, char * argv[]) {
   *argv[index] = '\0';
 }
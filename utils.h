@@ -9,6 +9,34 @@
  */
 int util_abs(int);
 
+/**
+ * Get a monotonic time
+ * @return the time in seconds (from an unspecified origin)
+ */
+extern double util_getTime();
+
+/**
+ * Get the number of online processors
+ * @return the number of processors (at least 1)
+ */
+extern int util_getCpuCount();
+
+/**
+ * Get a pseudo random number (splitmix64)
+ * The same state always gives the same sequence, so each search can own its random stream.
+ * @param state: the generator state, updated
+ * @return a random 64 bits number
+ */
+extern unsigned long long util_random(unsigned long long* state);
+
+/**
+ * Get the state of a random stream derived from a seed (counter-based: the stream only depends
+ * on the seed and its number, not on the streams drawn before)
+ * @param stream: the number of the stream (an iteration, a task...)
+ * @return the generator state of the stream, for util_random
+ */
+extern unsigned long long util_randomStream(unsigned long long seed, unsigned long long stream);
+
 /**
  * Trim a string (remove extra spaces around words)
  * @return the trimed string